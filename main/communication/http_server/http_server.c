@@ -11,10 +11,22 @@
 #include "measurement_task.h"
 #include "safety_task.h"
 #include "globals.h"
+#include "sample_ring.h"
+#include "live_state.h"
+#include "fast_control.h"
+#include "waveform.h"
+#include "list_mode.h"
+#include "discharge_test.h"
+#include "iv_sweep.h"
+#include "blackbox.h"
+#include "supervisor.h"
+#include "load_state.h"
 #include "config.h"
 
 #include <string.h>
+#include <stdlib.h>
 #include "esp_system.h"
+#include "esp_heap_caps.h"
 #include "esp_wifi.h"
 #include "esp_event.h"
 #include "nvs_flash.h"
@@ -146,6 +158,7 @@ static const char *index_html =
 "            <p><strong>Amp Hours:</strong> <span id=\"Ah\">0.0000</span> Ah</p>"
 "            <p><strong>Watt Hours:</strong> <span id=\"Wh\">0.0000</span> Wh</p>"
 "            <p><strong>Internal Temperature:</strong> <span id=\"temperature_internal\">0.0000</span> °C</p>"
+"            <p><strong>Sensor Die Temperature:</strong> <span id=\"temperature_die\">0.0000</span> °C</p>"
 "            <p><strong>External Temperature 1:</strong> <span id=\"temperature_external_1\">0.0000</span> °C</p>"
 "            <p><strong>External Temperature 2:</strong> <span id=\"temperature_external_2\">0.0000</span> °C</p>"
 "            <p><strong>External Temperature 3:</strong> <span id=\"temperature_external_3\">0.0000</span> °C</p>"
@@ -156,6 +169,12 @@ static const char *index_html =
 "                <option value=\"MODE_CC\">Constant Current (CC)</option>"
 "                <option value=\"MODE_CV\">Constant Voltage (CV)</option>"
 "                <option value=\"MODE_CP\">Constant Power (CP)</option>"
+"                <option value=\"MODE_CR\">Constant Resistance (CR)</option>"
+"                <option value=\"MODE_DYNAMIC\">Dynamic</option>"
+"                <option value=\"MODE_WAVEFORM\">Waveform</option>"
+"                <option value=\"MODE_LIST\">List</option>"
+"                <option value=\"MODE_DISCHARGE\">Discharge Test</option>"
+"                <option value=\"MODE_SWEEP\">I-V Sweep</option>"
 "            </select>"
 "            <button onclick=\"updateControlMode()\">Set Mode</button>"
 "        </div>"
@@ -166,11 +185,128 @@ static const char *index_html =
 "                <li><span>CC Mode:</span> Target current (Amps).</li>"
 "                <li><span>CV Mode:</span> Target voltage (Volts).</li>"
 "                <li><span>CP Mode:</span> Target power (Watts).</li>"
+"                <li><span>CR Mode:</span> Target resistance (Ohms).</li>"
 "            </ul>"
 "            <input type=\"number\" id=\"setpoint\" step=\"0.01\" placeholder=\"Enter setpoint\">"
 "            <button onclick=\"updateSetpoint()\">Update Setpoint</button>"
 "        </div>"
 "        <div class=\"section\">"
+"            <h2>Dynamic Mode</h2>"
+"            <p>The current toggles between level 1 and level 2.</p>"
+"            <select id=\"dynamic_submode\">"
+"                <option value=\"continuous\">Continuous</option>"
+"                <option value=\"pulsed\">Pulsed (one pulse per trigger)</option>"
+"                <option value=\"triggered\">Triggered (toggle per trigger)</option>"
+"            </select>"
+"            <div class=\"input-group\">"
+"                <label for=\"dynamic_level_1\">Level 1 (A):</label>"
+"                <input type=\"number\" id=\"dynamic_level_1\" step=\"0.01\" value=\"0\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"dynamic_level_2\">Level 2 (A):</label>"
+"                <input type=\"number\" id=\"dynamic_level_2\" step=\"0.01\" value=\"1\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"dynamic_frequency\">Frequency (Hz):</label>"
+"                <input type=\"number\" id=\"dynamic_frequency\" step=\"1\" value=\"100\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"dynamic_duty\">Duty at level 2 (%):</label>"
+"                <input type=\"number\" id=\"dynamic_duty\" step=\"1\" value=\"50\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"dynamic_slew\">Slew rate (A/ms, 0 = step):</label>"
+"                <input type=\"number\" id=\"dynamic_slew\" step=\"0.01\" value=\"0\">"
+"            </div>"
+"            <button onclick=\"updateDynamic()\">Set Waveform</button>"
+"            <button onclick=\"triggerDynamic()\">Trigger</button>"
+"        </div>"
+"        <div class=\"section\">"
+"            <h2>Waveform</h2>"
+"            <p>Upload a CSV column of currents or powers, played back with linear interpolation.</p>"
+"            <input type=\"file\" id=\"waveform_file\" accept=\".csv,.txt\">"
+"            <div class=\"input-group\">"
+"                <label for=\"waveform_interval\">Interval between points (us):</label>"
+"                <input type=\"number\" id=\"waveform_interval\" step=\"100\" value=\"1000\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"waveform_unit\">Points are:</label>"
+"                <select id=\"waveform_unit\"><option value=\"A\">Current (A)</option><option value=\"W\">Power (W)</option></select>"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"waveform_loop\">Loop:</label>"
+"                <input type=\"checkbox\" id=\"waveform_loop\">"
+"            </div>"
+"            <button onclick=\"uploadWaveform()\">Upload</button>"
+"            <p><strong>RMS Error:</strong> <span id=\"waveform_rms\">-</span></p>"
+"        </div>"
+"        <div class=\"section\">"
+"            <h2>List</h2>"
+"            <textarea id=\"list_steps\" rows=\"6\" cols=\"60\">{\"repeat\": 1, \"steps\": [{\"mode\": \"MODE_CC\", \"setpoint\": 1.0, \"dwell_us\": 100000}, {\"mode\": \"MODE_CC\", \"setpoint\": 2.0, \"dwell_us\": 100000}]}</textarea>"
+"            <button onclick=\"uploadList()\">Upload</button>"
+"            <p><strong>Step:</strong> <span id=\"list_status\">-</span></p>"
+"        </div>"
+"        <div class=\"section\">"
+"            <h2>Discharge Test</h2>"
+"            <div class=\"input-group\">"
+"                <label for=\"discharge_mode\">Discharge at:</label>"
+"                <select id=\"discharge_mode\"><option value=\"MODE_CC\">Constant Current (A)</option><option value=\"MODE_CP\">Constant Power (W)</option><option value=\"MODE_CR\">Constant Resistance (Ω)</option></select>"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"discharge_setpoint\">Setpoint:</label>"
+"                <input type=\"number\" id=\"discharge_setpoint\" step=\"0.01\" value=\"1.0\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"discharge_cutoff\">Cutoff Voltage (V):</label>"
+"                <input type=\"number\" id=\"discharge_cutoff\" step=\"0.01\" value=\"3.0\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"discharge_hysteresis\">Hysteresis (V):</label>"
+"                <input type=\"number\" id=\"discharge_hysteresis\" step=\"0.01\" value=\"0.05\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"discharge_pulse_interval\">Resistance Pulse Interval (s, 0 for none):</label>"
+"                <input type=\"number\" id=\"discharge_pulse_interval\" step=\"1\" value=\"60\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"discharge_pulse_level\">Pulse Load (fraction of setpoint):</label>"
+"                <input type=\"number\" id=\"discharge_pulse_level\" step=\"0.05\" value=\"0.5\">"
+"            </div>"
+"            <button onclick=\"configureDischarge()\">Configure</button>"
+"            <p><strong>State:</strong> <span id=\"discharge_state\">-</span></p>"
+"            <p><strong>Capacity:</strong> <span id=\"discharge_capacity\">-</span></p>"
+"            <p><strong>Energy:</strong> <span id=\"discharge_energy\">-</span></p>"
+"            <p><strong>Duration:</strong> <span id=\"discharge_duration\">-</span></p>"
+"            <p><strong>Internal Resistance:</strong> <span id=\"discharge_resistance\">-</span></p>"
+"        </div>"
+"        <div class=\"section\">"
+"            <h2>I-V Sweep</h2>"
+"            <div class=\"input-group\">"
+"                <label for=\"sweep_reference\">Sweep:</label>"
+"                <select id=\"sweep_reference\"><option value=\"MODE_CC\">Current (CC)</option><option value=\"MODE_CV\">Voltage (CV)</option></select>"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"sweep_points\">Points:</label>"
+"                <input type=\"number\" id=\"sweep_points\" step=\"1\" value=\"50\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"sweep_max_current\">Max Current (A):</label>"
+"                <input type=\"number\" id=\"sweep_max_current\" step=\"0.1\" value=\"1.0\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"sweep_tolerance\">Settle Tolerance (fraction of full scale):</label>"
+"                <input type=\"number\" id=\"sweep_tolerance\" step=\"0.005\" value=\"0.01\">"
+"            </div>"
+"            <div class=\"input-group\">"
+"                <label for=\"sweep_timeout\">Settle Timeout (ms):</label>"
+"                <input type=\"number\" id=\"sweep_timeout\" step=\"100\" value=\"1000\">"
+"            </div>"
+"            <button onclick=\"configureSweep()\">Configure</button>"
+"            <button onclick=\"fetchSweep()\">Get Curve</button>"
+"            <p><strong>Maximum Power Point:</strong> <span id=\"sweep_mpp\">-</span></p>"
+"            <pre id=\"sweep_curve\"></pre>"
+"        </div>"
+"        <div class=\"section\">"
 "            <h2>Start/Stop</h2>"
 "            <button id=\"startstop_button\" onclick=\"toggleStartStop(this)\">Start</button>"
 "        </div>"
@@ -181,6 +317,7 @@ static const char *index_html =
 "        <div class=\"section\">"
 "            <h2>Reset</h2>"
 "            <button id=\"reset_button\" onclick=\"resetLoad()\">Reset Load</button>"
+"            <a href=\"/blackbox\" download=\"blackbox.json\">Download Last Fault Record</a>"
 "        </div>"
 "        <div class=\"section\">"
 "            <h2>Safety Limits</h2>"
@@ -237,6 +374,7 @@ static const char *index_html =
 "            document.getElementById('Ah').textContent = data.Ah.toFixed(4);"
 "            document.getElementById('Wh').textContent = data.Wh.toFixed(4);"
 "            document.getElementById('temperature_internal').textContent = data.temperature_internal.toFixed(4);"
+"            document.getElementById('temperature_die').textContent = data.temperature_die.toFixed(4);"
 "            document.getElementById('temperature_external_1').textContent = data.temperature_external_1.toFixed(4);"
 "            document.getElementById('temperature_external_2').textContent = data.temperature_external_2.toFixed(4);"
 "            document.getElementById('temperature_external_3').textContent = data.temperature_external_3.toFixed(4);"
@@ -253,7 +391,7 @@ static const char *index_html =
 "                const response = await fetch('/loadstate');"
 "                const data = await response.json();"
 "                const loadStateElement = document.getElementById('load_state');"
-"                loadStateElement.textContent = data.running ? \"Running\" : \"Stopped\";"
+"                loadStateElement.textContent = data.state;"
 "                loadStateElement.style.color = data.running ? \"#4CAF50\" : \"#FF0000\";"
 "            } catch (error) {"
 "                console.error('Error fetching load state:', error);"
@@ -275,6 +413,117 @@ static const char *index_html =
 "                body: mode,"
 "            });"
 "        }"
+"        async function updateDynamic() {"
+"            const dynamic = {"
+"                submode: document.getElementById('dynamic_submode').value,"
+"                level_1: parseFloat(document.getElementById('dynamic_level_1').value),"
+"                level_2: parseFloat(document.getElementById('dynamic_level_2').value),"
+"                frequency: parseFloat(document.getElementById('dynamic_frequency').value),"
+"                duty: parseFloat(document.getElementById('dynamic_duty').value),"
+"                slew: parseFloat(document.getElementById('dynamic_slew').value),"
+"            };"
+"            const response = await fetch('/dynamic', {"
+"                method: 'POST',"
+"                headers: { 'Content-Type': 'application/json' },"
+"                body: JSON.stringify(dynamic),"
+"            });"
+"            if (!response.ok) {"
+"                alert(await response.text());"
+"            }"
+"        }"
+"        async function triggerDynamic() {"
+"            await fetch('/trigger', { method: 'POST' });"
+"        }"
+"        async function uploadWaveform() {"
+"            const file = document.getElementById('waveform_file').files[0];"
+"            if (!file) {"
+"                return;"
+"            }"
+"            const interval = document.getElementById('waveform_interval').value;"
+"            const unit = document.getElementById('waveform_unit').value;"
+"            const loop = document.getElementById('waveform_loop').checked ? 1 : 0;"
+"            const response = await fetch(`/waveform?interval_us=${interval}&unit=${unit}&loop=${loop}`, {"
+"                method: 'POST',"
+"                body: await file.text(),"
+"            });"
+"            alert(await response.text());"
+"        }"
+"        async function fetchWaveformReport() {"
+"            try {"
+"                const response = await fetch('/waveform');"
+"                const data = await response.json();"
+"                document.getElementById('waveform_rms').textContent = data.samples > 0 ? `${data.rms_error.toFixed(4)} ${data.unit}` : '-';"
+"            } catch (error) {"
+"                console.error('Error fetching waveform report:', error);"
+"            }"
+"        }"
+"        async function uploadList() {"
+"            const response = await fetch('/list', {"
+"                method: 'POST',"
+"                headers: { 'Content-Type': 'application/json' },"
+"                body: document.getElementById('list_steps').value,"
+"            });"
+"            alert(await response.text());"
+"        }"
+"        async function fetchListStatus() {"
+"            try {"
+"                const response = await fetch('/list');"
+"                const data = await response.json();"
+"                document.getElementById('list_status').textContent = data.running ? `${data.step + 1} of ${data.steps}, pass ${data.pass + 1}${data.finished ? ' (finished)' : ''}` : '-';"
+"            } catch (error) {"
+"                console.error('Error fetching list status:', error);"
+"            }"
+"        }"
+"        async function configureDischarge() {"
+"            const discharge = {"
+"                mode: document.getElementById('discharge_mode').value,"
+"                setpoint: parseFloat(document.getElementById('discharge_setpoint').value),"
+"                cutoff_voltage: parseFloat(document.getElementById('discharge_cutoff').value),"
+"                hysteresis: parseFloat(document.getElementById('discharge_hysteresis').value),"
+"                pulse_interval_s: parseInt(document.getElementById('discharge_pulse_interval').value),"
+"                pulse_level: parseFloat(document.getElementById('discharge_pulse_level').value),"
+"            };"
+"            const response = await fetch('/discharge', {"
+"                method: 'POST',"
+"                headers: { 'Content-Type': 'application/json' },"
+"                body: JSON.stringify(discharge),"
+"            });"
+"            alert(await response.text());"
+"        }"
+"        async function fetchDischargeReport() {"
+"            try {"
+"                const response = await fetch('/discharge');"
+"                const data = await response.json();"
+"                document.getElementById('discharge_state').textContent = data.state;"
+"                document.getElementById('discharge_capacity').textContent = `${data.capacity_ah.toFixed(4)} Ah`;"
+"                document.getElementById('discharge_energy').textContent = `${data.energy_wh.toFixed(4)} Wh`;"
+"                document.getElementById('discharge_duration').textContent = `${data.duration_s.toFixed(0)} s`;"
+"                document.getElementById('discharge_resistance').textContent = data.resistance_samples > 0 ? `${(data.internal_resistance * 1000).toFixed(1)} mΩ` : '-';"
+"            } catch (error) {"
+"                console.error('Error fetching discharge report:', error);"
+"            }"
+"        }"
+"        async function configureSweep() {"
+"            const sweep = {"
+"                reference: document.getElementById('sweep_reference').value,"
+"                points: parseInt(document.getElementById('sweep_points').value),"
+"                max_current: parseFloat(document.getElementById('sweep_max_current').value),"
+"                settle_tolerance: parseFloat(document.getElementById('sweep_tolerance').value),"
+"                settle_timeout_ms: parseFloat(document.getElementById('sweep_timeout').value),"
+"            };"
+"            const response = await fetch('/sweep', {"
+"                method: 'POST',"
+"                headers: { 'Content-Type': 'application/json' },"
+"                body: JSON.stringify(sweep),"
+"            });"
+"            alert(await response.text());"
+"        }"
+"        async function fetchSweep() {"
+"            const response = await fetch('/sweep');"
+"            const data = await response.json();"
+"            document.getElementById('sweep_mpp').textContent = data.points > 0 ? `${data.mpp.power.toFixed(3)} W at ${data.mpp.voltage.toFixed(3)} V, ${data.mpp.current.toFixed(4)} A (${data.state}, ${data.duration_ms.toFixed(0)} ms)` : '-';"
+"            document.getElementById('sweep_curve').textContent = data.curve.map(point => point.join('\\t')).join('\\n');"
+"        }"
 "        async function toggleStartStop(button) {"
 "            const action = button.textContent === \"Start\" ? \"start\" : \"stop\";"
 "            await fetch('/startstop', {"
@@ -302,6 +551,9 @@ static const char *index_html =
 "        }"
 "        setInterval(fetchMeasurements, 1000);"
 "        setInterval(fetchLoadState, 1000);"
+"        setInterval(fetchWaveformReport, 1000);"
+"        setInterval(fetchListStatus, 1000);"
+"        setInterval(fetchDischargeReport, 1000);"
 "    </script>"
 "</body>"
 "</html>";
@@ -334,15 +586,17 @@ static esp_err_t index_handler(httpd_req_t *req) {
  */
 static esp_err_t get_measurement_handler(httpd_req_t *req) {
     MeasurementData measurement;
-    if (xQueuePeek(measurement_queue, &measurement, pdMS_TO_TICKS(10)) == pdTRUE) {
-        char resp[512];
+    if (sample_ring_latest(&measurement_ring, &measurement)) {
+        char resp[768];
         snprintf(resp, sizeof(resp),
-                 "{\"voltage\": %.4f, \"current\": %.4f, \"power\": %.4f, "
-                 "\"temperature_internal\": %.2f, \"temperature_external_1\": %.2f, "
-                 "\"temperature_external_2\": %.2f, \"temperature_external_3\": %.2f, \"Ah\": %.4f, \"Wh\": %.4f}",
-                 measurement.bus_voltage, measurement.current, measurement.power,
-                 measurement.temperature_internal, measurement.temperature_external_1,
-                 measurement.temperature_external_2, measurement.temperature_external_3, measurement.Ah, measurement.Wh);
+                 "{\"voltage\": %.4f, \"shunt_voltage\": %.6f, \"current\": %.4f, \"power\": %.4f, "
+                 "\"temperature_internal\": %.2f, \"temperature_die\": %.2f, \"temperature_external_1\": %.2f, "
+                 "\"temperature_external_2\": %.2f, \"temperature_external_3\": %.2f, \"Ah\": %.4f, \"Wh\": %.4f, "
+                 "\"charge_lsb_seconds\": %lld, \"energy_lsb_seconds\": %lld, \"timestamp_us\": %lld, \"sequence\": %lu, \"list_step\": %lu, \"quality\": %d}",
+                 measurement.bus_voltage, measurement.shunt_voltage, measurement.current, measurement.power,
+                 measurement.temperature_internal, measurement.temperature_die, measurement.temperature_external_1,
+                 measurement.temperature_external_2, measurement.temperature_external_3, measurement.Ah, measurement.Wh,
+                 measurement.charge_lsb_seconds, measurement.energy_lsb_seconds, measurement.timestamp_us, measurement.sequence, measurement.list_step, measurement.quality);
         httpd_resp_set_type(req, "application/json");
         httpd_resp_send(req, resp, strlen(resp));
     } else {
@@ -374,12 +628,8 @@ static esp_err_t set_setpoint_handler(httpd_req_t *req) {
 
     float setpoint = atof(content);
 
-    // Writes new setpoint to queue:
-    xQueueOverwrite(setpoint_queue, &setpoint);
-
-    // Sets event group bits, signals that new data is ready to be read by tasks that need setpoint.
-    xEventGroupSetBits(signal_event_group, HMI_SETPOINT_BIT);
-    xEventGroupSetBits(signal_event_group, CONTROL_SETPOINT_BIT);
+    // Publishes the new setpoint, the tasks that need it see the update count change
+    live_state_set_setpoint(setpoint);
 
     httpd_resp_send(req, "Setpoint updated", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
@@ -389,7 +639,7 @@ static esp_err_t set_setpoint_handler(httpd_req_t *req) {
  * @brief Handler for starting or stopping the load.
  *
  * This handler responds to POST requests to the `/startstop` endpoint by
- * toggling the start/stop state of the load based on the received command.
+ * posting a start or stop command to the safety task, which owns the load state.
  *
  * @param req Pointer to the HTTP request.
  * @return ESP_OK on success, or an error code on failure.
@@ -407,11 +657,15 @@ static esp_err_t start_stop_handler(httpd_req_t *req) {
     }
     content[recv_size] = '\0';
 
-    // Toggle the event group bit based on received command
+    bool queued = true;
     if (strcmp(content, "start") == 0) {
-        xEventGroupSetBits(signal_event_group, START_STOP_BIT);
+        queued = load_state_command(LOAD_COMMAND_START);
     } else if (strcmp(content, "stop") == 0) {
-        xEventGroupClearBits(signal_event_group, START_STOP_BIT);
+        queued = load_state_command(LOAD_COMMAND_STOP);
+    }
+    if (!queued) {
+        httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Load command queue full");
+        return ESP_FAIL;
     }
 
     httpd_resp_send(req, "OK", HTTPD_RESP_USE_STRLEN);
@@ -453,17 +707,43 @@ static esp_err_t set_safety_handler(httpd_req_t *req) {
     safety.soft_max_current = cJSON_GetObjectItem(root, "soft_max_current")->valuedouble;
     safety.soft_max_temperature = cJSON_GetObjectItem(root, "soft_max_temperature")->valuedouble;
 
-    if (xQueueOverwrite(safety_queue, &safety) != pdPASS) {
-        cJSON_Delete(root);
-        httpd_resp_send_500(req);
-        return ESP_FAIL;
-    }
+    live_state_set_limits(&safety);
 
     cJSON_Delete(root);
     httpd_resp_send(req, "Safety limits updated", HTTPD_RESP_USE_STRLEN);
     return ESP_OK;
 }
 
+/**
+ * @brief Names of the control modes, indexed by ControlMode.
+ */
+static const char *const mode_names[MODE_COUNT] = {
+    [MODE_CC] = "MODE_CC",
+    [MODE_CV] = "MODE_CV",
+    [MODE_CP] = "MODE_CP",
+    [MODE_CR] = "MODE_CR",
+    [MODE_DYNAMIC] = "MODE_DYNAMIC",
+    [MODE_WAVEFORM] = "MODE_WAVEFORM",
+    [MODE_LIST] = "MODE_LIST",
+    [MODE_DISCHARGE] = "MODE_DISCHARGE",
+    [MODE_SWEEP] = "MODE_SWEEP",
+};
+
+/**
+ * @brief Look up a control mode by name.
+ *
+ * @param name The name, such as "MODE_CC".
+ * @return The mode, or MODE_COUNT if the name is unknown.
+ */
+static ControlMode parse_mode(const char *name) {
+    for (int mode = 0; mode < MODE_COUNT; mode++) {
+        if (strcmp(name, mode_names[mode]) == 0) {
+            return (ControlMode)mode;
+        }
+    }
+    return MODE_COUNT;
+}
+
 static esp_err_t set_mode_handler(httpd_req_t *req) {
     char content[20];
     size_t recv_size = MIN(req->content_len, sizeof(content) - 1);
@@ -472,32 +752,677 @@ static esp_err_t set_mode_handler(httpd_req_t *req) {
     if (ret <= 0) return ESP_FAIL;
     content[recv_size] = '\0';
 
-    ControlMode mode;
-    if (strcmp(content, "MODE_CC") == 0) {
-        mode = MODE_CC;
-    } else if (strcmp(content, "MODE_CV") == 0) {
-        mode = MODE_CV;
-    } else if (strcmp(content, "MODE_CP") == 0) {
-        mode = MODE_CP;
+    ControlMode mode = parse_mode(content);
+    if (mode == MODE_COUNT) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    live_state_set_mode(mode);
+
+    httpd_resp_send(req, "Mode updated", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for setting the dynamic mode waveform.
+ *
+ * This handler processes POST requests to the `/dynamic` endpoint. The JSON
+ * body holds the sub-mode ("continuous", "pulsed" or "triggered"), the two
+ * current levels in A, the frequency in Hz, the duty cycle at level 2 in %
+ * and the slew rate in A/ms (0 steps at once). In pulsed sub-mode a pulse
+ * lasts the duty cycle of one period.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t set_dynamic_handler(httpd_req_t *req) {
+    char content[200];
+    size_t recv_size = MIN(req->content_len, sizeof(content) - 1);
+    int ret = httpd_req_recv(req, content, recv_size);
+
+    if (ret <= 0) return ESP_FAIL;
+    content[recv_size] = '\0';
+
+    cJSON *root = cJSON_Parse(content);
+    if (!root) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    cJSON *submode = cJSON_GetObjectItem(root, "submode");
+    cJSON *level_1 = cJSON_GetObjectItem(root, "level_1");
+    cJSON *level_2 = cJSON_GetObjectItem(root, "level_2");
+    cJSON *frequency = cJSON_GetObjectItem(root, "frequency");
+    cJSON *duty = cJSON_GetObjectItem(root, "duty");
+    cJSON *slew = cJSON_GetObjectItem(root, "slew");
+    if (!cJSON_IsString(submode) || !cJSON_IsNumber(level_1) || !cJSON_IsNumber(level_2) ||
+        !cJSON_IsNumber(frequency) || !cJSON_IsNumber(duty) || !cJSON_IsNumber(slew)) {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing dynamic mode field");
+        return ESP_FAIL;
+    }
+
+    DynamicConfig dynamic;
+    if (strcmp(submode->valuestring, "continuous") == 0) {
+        dynamic.submode = DYNAMIC_CONTINUOUS;
+    } else if (strcmp(submode->valuestring, "pulsed") == 0) {
+        dynamic.submode = DYNAMIC_PULSED;
+    } else if (strcmp(submode->valuestring, "triggered") == 0) {
+        dynamic.submode = DYNAMIC_TRIGGERED;
     } else {
+        dynamic.submode = DYNAMIC_SUBMODE_COUNT;
+    }
+
+    bool valid = (dynamic.submode != DYNAMIC_SUBMODE_COUNT) &&
+                 (level_1->valuedouble >= 0) && (level_1->valuedouble <= MAX_CURRENT) &&
+                 (level_2->valuedouble >= 0) && (level_2->valuedouble <= MAX_CURRENT) &&
+                 (frequency->valuedouble > 0) && (frequency->valuedouble <= DYNAMIC_MAX_FREQUENCY_HZ) &&
+                 (duty->valuedouble >= 0) && (duty->valuedouble <= 100) && (slew->valuedouble >= 0);
+    if (!valid) {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid dynamic mode waveform");
+        return ESP_FAIL;
+    }
+
+    dynamic.level_1_ma = (int32_t)(level_1->valuedouble * 1000.0);
+    dynamic.level_2_ma = (int32_t)(level_2->valuedouble * 1000.0);
+    dynamic.period_us = (uint32_t)(1000000.0 / frequency->valuedouble);
+    dynamic.level_2_us = (uint32_t)(dynamic.period_us * duty->valuedouble / 100.0);
+    dynamic.slew_ma_per_ms = (uint32_t)(slew->valuedouble * 1000.0);
+    cJSON_Delete(root);
+
+    live_state_set_dynamic(&dynamic);
+
+    httpd_resp_send(req, "Dynamic mode updated", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for triggering dynamic mode.
+ *
+ * This handler responds to POST requests to the `/trigger` endpoint. In the
+ * pulsed sub-mode a trigger gives one pulse, in the triggered sub-mode it
+ * toggles the level.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t trigger_handler(httpd_req_t *req) {
+    live_state_trigger_dynamic();
+    httpd_resp_send(req, "Triggered", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Store one parsed waveform point.
+ *
+ * @param table The table being uploaded.
+ * @param capacity Number of points allocated.
+ * @param token The number, NUL terminated.
+ * @return true if the point is a number within the rating of the load and there was room for it.
+ */
+static bool waveform_store_point(WaveformTable *table, uint32_t capacity, const char *token) {
+    char *end;
+    float value = strtof(token, &end);
+    float maximum = (table->unit == WAVEFORM_POWER) ? (MAX_VOLTAGE * MAX_CURRENT) : MAX_CURRENT;
+    if ((*end != '\0') || (value < 0) || (value > maximum) || (table->count >= capacity)) {
+        return false;
+    }
+    table->points[table->count++] = value;
+    return true;
+}
+
+/**
+ * @brief Handler for uploading a waveform table.
+ *
+ * This handler processes POST requests to the `/waveform` endpoint. The query
+ * string holds the interval between the points in us (`interval_us`), the
+ * unit of the points (`unit=A` or `unit=W`) and `loop=1` to loop. The body is
+ * the points, separated by commas, spaces or new lines, such as a CSV column.
+ * The body is parsed as it arrives, so the table is never held as text.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t set_waveform_handler(httpd_req_t *req) {
+    char query[64];
+    char value[16];
+    WaveformTable table = {.points = NULL, .count = 0, .interval_us = 0, .loop = false, .unit = WAVEFORM_CURRENT};
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "interval_us", value, sizeof(value)) == ESP_OK) {
+            table.interval_us = strtoul(value, NULL, 10);
+        }
+        if (httpd_query_key_value(query, "unit", value, sizeof(value)) == ESP_OK) {
+            table.unit = (strcmp(value, "W") == 0) ? WAVEFORM_POWER : WAVEFORM_CURRENT;
+        }
+        if (httpd_query_key_value(query, "loop", value, sizeof(value)) == ESP_OK) {
+            table.loop = (strcmp(value, "1") == 0) || (strcmp(value, "true") == 0);
+        }
+    }
+    if (table.interval_us < WAVEFORM_MIN_INTERVAL_US) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "interval_us missing or too short");
+        return ESP_FAIL;
+    }
+
+    uint32_t capacity;
+    table.points = waveform_alloc(&capacity);
+    if (table.points == NULL) {
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
 
-    if (xQueueOverwrite(mode_queue, &mode) != pdPASS) {
+    // Parse the points chunk by chunk, a number may be split between two chunks
+    char chunk[256];
+    char token[16];
+    size_t token_length = 0;
+    size_t remaining = req->content_len;
+    bool valid = true;
+    while (valid && (remaining > 0)) {
+        int ret = httpd_req_recv(req, chunk, MIN(remaining, sizeof(chunk)));
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (ret <= 0) {
+            heap_caps_free(table.points);
+            return ESP_FAIL;
+        }
+        remaining -= ret;
+
+        for (int i = 0; valid && (i < ret); i++) {
+            char c = chunk[i];
+            if ((c == ',') || (c == ' ') || (c == '\n') || (c == '\r') || (c == '\t') || (c == ';')) {
+                if (token_length > 0) {
+                    token[token_length] = '\0';
+                    valid = waveform_store_point(&table, capacity, token);
+                    token_length = 0;
+                }
+            } else if (token_length < sizeof(token) - 1) {
+                token[token_length++] = c;
+            } else {
+                valid = false;
+            }
+        }
+    }
+    if (valid && (token_length > 0)) {
+        token[token_length] = '\0';
+        valid = waveform_store_point(&table, capacity, token);
+    }
+
+    if (!valid || (table.count < 2)) {
+        heap_caps_free(table.points);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Points must be at least two numbers within the rating of the load");
+        return ESP_FAIL;
+    }
+
+    waveform_load(&table);
+
+    char resp[64];
+    snprintf(resp, sizeof(resp), "Waveform loaded, %lu points", table.count);
+    httpd_resp_send(req, resp, HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for retrieving the waveform playback report.
+ *
+ * This handler responds to GET requests to the `/waveform` endpoint with the
+ * loaded table and the RMS error of the achieved versus the requested profile.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t get_waveform_handler(httpd_req_t *req) {
+    WaveformReport report;
+    waveform_get_report(&report);
+
+    char resp[320];
+    snprintf(resp, sizeof(resp),
+             "{\"loaded\": %s, \"points\": %lu, \"interval_us\": %lu, \"unit\": \"%s\", \"loop\": %s, \"psram\": %s, "
+             "\"playing\": %s, \"finished\": %s, \"elapsed_s\": %.3f, \"samples\": %lu, \"rms_error\": %.4f}",
+             report.loaded ? "true" : "false", report.count, report.interval_us,
+             (report.unit == WAVEFORM_POWER) ? "W" : "A", report.loop ? "true" : "false", report.in_psram ? "true" : "false",
+             report.playing ? "true" : "false", report.finished ? "true" : "false", report.elapsed_s,
+             report.samples, report.rms_error);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, resp, strlen(resp));
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for uploading a list mode list.
+ *
+ * This handler processes POST requests to the `/list` endpoint. The JSON body
+ * holds `repeat`, the number of times the list is run (0 until stopped), and
+ * `steps`, an array of objects with `mode` (MODE_CC, MODE_CV, MODE_CP or
+ * MODE_CR), `setpoint` and `dwell_us`. A list with a dwell shorter than
+ * LIST_MIN_DWELL_US is rejected, the step could fall between two samples.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t set_list_handler(httpd_req_t *req) {
+    if (req->content_len > LIST_MAX_STEPS * 80) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "List too long");
+        return ESP_FAIL;
+    }
+    char *content = malloc(req->content_len + 1);
+    if (content == NULL) {
         httpd_resp_send_500(req);
         return ESP_FAIL;
     }
+    size_t received = 0;
+    while (received < req->content_len) {
+        int ret = httpd_req_recv(req, content + received, req->content_len - received);
+        if (ret == HTTPD_SOCK_ERR_TIMEOUT) {
+            continue;
+        }
+        if (ret <= 0) {
+            free(content);
+            return ESP_FAIL;
+        }
+        received += ret;
+    }
+    content[received] = '\0';
 
-    httpd_resp_send(req, "Mode updated", HTTPD_RESP_USE_STRLEN);
+    cJSON *root = cJSON_Parse(content);
+    free(content);
+    if (!root) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    static ListProgram program; // Too large for the HTTP server stack, only this handler uses it
+    memset(&program, 0, sizeof(program));
+    cJSON *repeat = cJSON_GetObjectItem(root, "repeat");
+    cJSON *steps = cJSON_GetObjectItem(root, "steps");
+    bool valid = cJSON_IsNumber(repeat) && (repeat->valuedouble >= 0) && cJSON_IsArray(steps) &&
+                 (cJSON_GetArraySize(steps) > 0) && (cJSON_GetArraySize(steps) <= LIST_MAX_STEPS);
+    if (valid) {
+        program.repeat = (uint32_t)repeat->valuedouble;
+        cJSON *step;
+        cJSON_ArrayForEach(step, steps) {
+            cJSON *mode = cJSON_GetObjectItem(step, "mode");
+            cJSON *setpoint = cJSON_GetObjectItem(step, "setpoint");
+            cJSON *dwell = cJSON_GetObjectItem(step, "dwell_us");
+            ControlMode step_mode = cJSON_IsString(mode) ? parse_mode(mode->valuestring) : MODE_COUNT;
+            if ((step_mode > MODE_CR) || !cJSON_IsNumber(setpoint) || (setpoint->valuedouble < 0) ||
+                !cJSON_IsNumber(dwell) || (dwell->valuedouble < LIST_MIN_DWELL_US)) {
+                valid = false;
+                break;
+            }
+            program.steps[program.count].mode = step_mode;
+            program.steps[program.count].setpoint = (float)setpoint->valuedouble;
+            program.steps[program.count].dwell_us = (uint32_t)dwell->valuedouble;
+            program.count++;
+        }
+    }
+    cJSON_Delete(root);
+
+    if (!valid) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid list");
+        return ESP_FAIL;
+    }
+
+    list_mode_load(&program);
+
+    httpd_resp_send(req, "List loaded", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for retrieving the list mode state.
+ *
+ * This handler responds to GET requests to the `/list` endpoint with the
+ * current step and pass of the run and when the step started.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t get_list_handler(httpd_req_t *req) {
+    ListStatus status;
+    list_mode_get_status(&status);
+
+    char resp[320];
+    snprintf(resp, sizeof(resp),
+             "{\"loaded\": %s, \"steps\": %lu, \"repeat\": %lu, \"running\": %s, \"finished\": %s, "
+             "\"step\": %lu, \"pass\": %lu, \"list_step\": %lu, \"step_started_us\": %lld, \"step_scheduled_us\": %lld}",
+             status.loaded ? "true" : "false", status.count, status.repeat,
+             status.running ? "true" : "false", status.finished ? "true" : "false",
+             status.step, status.pass, status.steps_started, status.step_started_us, status.step_scheduled_us);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, resp, strlen(resp));
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for configuring the battery discharge test.
+ *
+ * This handler processes POST requests to the `/discharge` endpoint. The JSON
+ * body holds `mode` (MODE_CC, MODE_CP or MODE_CR), `setpoint`, `cutoff_voltage`,
+ * `hysteresis`, `pulse_interval_s` (0 for no internal resistance pulses) and
+ * `pulse_level`, the load during a pulse as a fraction of the setpoint current.
+ * The progress of the previous test is cleared.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t set_discharge_handler(httpd_req_t *req) {
+    char content[256];
+    size_t recv_size = MIN(req->content_len, sizeof(content) - 1);
+    int ret = httpd_req_recv(req, content, recv_size);
+
+    if (ret <= 0) return ESP_FAIL;
+    content[recv_size] = '\0';
+
+    cJSON *root = cJSON_Parse(content);
+    if (!root) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    cJSON *mode = cJSON_GetObjectItem(root, "mode");
+    cJSON *setpoint = cJSON_GetObjectItem(root, "setpoint");
+    cJSON *cutoff_voltage = cJSON_GetObjectItem(root, "cutoff_voltage");
+    cJSON *hysteresis = cJSON_GetObjectItem(root, "hysteresis");
+    cJSON *pulse_interval = cJSON_GetObjectItem(root, "pulse_interval_s");
+    cJSON *pulse_level = cJSON_GetObjectItem(root, "pulse_level");
+    if (!cJSON_IsString(mode) || !cJSON_IsNumber(setpoint) || !cJSON_IsNumber(cutoff_voltage) ||
+        !cJSON_IsNumber(hysteresis) || !cJSON_IsNumber(pulse_interval) || !cJSON_IsNumber(pulse_level)) {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing discharge test field");
+        return ESP_FAIL;
+    }
+
+    DischargeConfig config = {
+        .mode = parse_mode(mode->valuestring),
+        .setpoint = (float)setpoint->valuedouble,
+        .cutoff_voltage = (float)cutoff_voltage->valuedouble,
+        .hysteresis = (float)hysteresis->valuedouble,
+        .pulse_interval_s = (pulse_interval->valuedouble > 0) ? (uint32_t)pulse_interval->valuedouble : 0,
+        .pulse_level = (float)pulse_level->valuedouble,
+    };
+    cJSON_Delete(root);
+
+    bool valid = ((config.mode == MODE_CC) || (config.mode == MODE_CP) || (config.mode == MODE_CR)) &&
+                 (config.setpoint > 0) && ((config.mode != MODE_CR) || (config.setpoint >= MIN_RESISTANCE)) &&
+                 (config.cutoff_voltage > 0) && (config.cutoff_voltage < MAX_VOLTAGE) && (config.hysteresis >= 0) &&
+                 ((config.pulse_interval_s == 0) || ((config.pulse_level > 0) && (config.pulse_level < 1)));
+    if (!valid) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid discharge test");
+        return ESP_FAIL;
+    }
+
+    discharge_test_configure(&config);
+
+    httpd_resp_send(req, "Discharge test configured", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for retrieving the battery discharge test report.
+ *
+ * This handler responds to GET requests to the `/discharge` endpoint with the
+ * state of the test and the capacity, energy, duration and internal
+ * resistance measured so far. Once the state is `finished` the report is
+ * final and stays available, across resets, until a new test is configured.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t get_discharge_handler(httpd_req_t *req) {
+    static const char *const state_names[] = {
+        [DISCHARGE_IDLE] = "idle",
+        [DISCHARGE_RUNNING] = "running",
+        [DISCHARGE_PAUSED] = "paused",
+        [DISCHARGE_FINISHED] = "finished",
+    };
+
+    DischargeReport report;
+    discharge_test_get_report(&report);
+
+    char resp[512];
+    snprintf(resp, sizeof(resp),
+             "{\"state\": \"%s\", \"mode\": \"%s\", \"setpoint\": %.3f, \"cutoff_voltage\": %.3f, \"hysteresis\": %.3f, "
+             "\"capacity_ah\": %.4f, \"energy_wh\": %.4f, \"duration_s\": %.1f, \"start_voltage\": %.3f, \"end_voltage\": %.3f, "
+             "\"internal_resistance\": %.4f, \"last_resistance\": %.4f, \"resistance_samples\": %lu}",
+             state_names[report.state], mode_names[report.config.mode], report.config.setpoint,
+             report.config.cutoff_voltage, report.config.hysteresis, report.capacity_ah, report.energy_wh,
+             report.duration_s, report.start_voltage, report.end_voltage, report.internal_resistance,
+             report.last_resistance, report.resistance_samples);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, resp, strlen(resp));
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for configuring the I-V sweep.
+ *
+ * This handler processes POST requests to the `/sweep` endpoint. The JSON body
+ * holds `reference` (MODE_CC or MODE_CV), `points`, `max_current`, the current
+ * of the last point of a CC sweep, and `settle_tolerance`, how close to its
+ * reference a point has to stay to count as settled, as a fraction of full
+ * scale. The optional `settle_timeout_ms` is the longest wait for a point to
+ * settle, SWEEP_SETTLE_TIMEOUT_US if it is missing.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t set_sweep_handler(httpd_req_t *req) {
+    char content[200];
+    size_t recv_size = MIN(req->content_len, sizeof(content) - 1);
+    int ret = httpd_req_recv(req, content, recv_size);
+
+    if (ret <= 0) return ESP_FAIL;
+    content[recv_size] = '\0';
+
+    cJSON *root = cJSON_Parse(content);
+    if (!root) {
+        httpd_resp_send_500(req);
+        return ESP_FAIL;
+    }
+
+    cJSON *reference = cJSON_GetObjectItem(root, "reference");
+    cJSON *points = cJSON_GetObjectItem(root, "points");
+    cJSON *max_current = cJSON_GetObjectItem(root, "max_current");
+    cJSON *settle_tolerance = cJSON_GetObjectItem(root, "settle_tolerance");
+    cJSON *settle_timeout_ms = cJSON_GetObjectItem(root, "settle_timeout_ms");
+    if (!cJSON_IsString(reference) || !cJSON_IsNumber(points) || !cJSON_IsNumber(max_current) ||
+        !cJSON_IsNumber(settle_tolerance)) {
+        cJSON_Delete(root);
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Missing sweep field");
+        return ESP_FAIL;
+    }
+
+    SweepConfig config = {
+        .reference = parse_mode(reference->valuestring),
+        .points = (points->valuedouble > 0) ? (uint32_t)points->valuedouble : 0,
+        .max_current = (float)max_current->valuedouble,
+        .settle_tolerance = (float)settle_tolerance->valuedouble,
+        .settle_timeout_us = SWEEP_SETTLE_TIMEOUT_US,
+    };
+    bool timeout_valid = true;
+    if (settle_timeout_ms != NULL) {
+        timeout_valid = cJSON_IsNumber(settle_timeout_ms) && (settle_timeout_ms->valuedouble >= 1) &&
+                        (settle_timeout_ms->valuedouble <= 60000);
+        config.settle_timeout_us = timeout_valid ? (uint32_t)(settle_timeout_ms->valuedouble * 1000) : 0;
+    }
+    cJSON_Delete(root);
+
+    bool valid = ((config.reference == MODE_CC) || (config.reference == MODE_CV)) &&
+                 (config.points >= 2) && (config.points <= SWEEP_MAX_POINTS) &&
+                 (config.max_current > 0) && (config.max_current <= MAX_CURRENT) &&
+                 (config.settle_tolerance > 0) && (config.settle_tolerance < 1) && timeout_valid;
+    if (!valid) {
+        httpd_resp_send_err(req, HTTPD_400_BAD_REQUEST, "Invalid sweep");
+        return ESP_FAIL;
+    }
+
+    iv_sweep_configure(&config);
+
+    httpd_resp_send(req, "Sweep configured", HTTPD_RESP_USE_STRLEN);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for retrieving the I-V curve.
+ *
+ * This handler responds to GET requests to the `/sweep` endpoint with the
+ * curve of the last sweep, as an array of [voltage, current, power] points
+ * from open circuit, and the maximum power point. The voltage and current of
+ * the last point are reported as `end_voltage` and `end_current`. `isc`, the
+ * short-circuit current extrapolated to 0 V, and `fill_factor` are only
+ * reported if the sweep reached a short, below SWEEP_SHORT_CIRCUIT_FRACTION of
+ * the open-circuit voltage, and are null otherwise. The curve is sent in chunks
+ * of several points, so the response does not need a buffer for all of them.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t get_sweep_handler(httpd_req_t *req) {
+    static const char *const state_names[] = {
+        [SWEEP_IDLE] = "idle",
+        [SWEEP_RUNNING] = "running",
+        [SWEEP_FINISHED] = "finished",
+        [SWEEP_ABORTED] = "aborted",
+    };
+    static SweepReport report; // Too large for the HTTP server stack, only this handler uses it
+    iv_sweep_get_report(&report);
+
+    uint32_t unsettled = 0;
+    for (uint32_t i = 0; i < report.count; i++) {
+        unsettled += report.points[i].settled ? 0 : 1;
+    }
+    SweepPoint mpp = (report.count > 0) ? report.points[report.mpp] : (SweepPoint){0};
+    SweepPoint end = (report.count > 0) ? report.points[report.count - 1] : (SweepPoint){0};
+    float open_circuit_voltage = (report.count > 0) ? report.points[0].voltage : 0.0f;
+
+    // Isc and the fill factor only mean something if the sweep got down to a short. Isc is then extrapolated to 0 V
+    // along the last two points, otherwise both are null and end_current is all there is
+    char short_circuit[64] = "\"isc\": null, \"fill_factor\": null";
+    if ((report.count >= 2) && (end.voltage <= SWEEP_SHORT_CIRCUIT_FRACTION * open_circuit_voltage)) {
+        SweepPoint before = report.points[report.count - 2];
+        float short_circuit_current = end.current;
+        if (before.voltage > end.voltage) {
+            short_circuit_current += (end.current - before.current) * end.voltage / (before.voltage - end.voltage);
+        }
+        float fill_factor = (short_circuit_current > 0) ? mpp.power / (open_circuit_voltage * short_circuit_current) : 0.0f;
+        snprintf(short_circuit, sizeof(short_circuit), "\"isc\": %.4f, \"fill_factor\": %.3f", short_circuit_current,
+                 fill_factor);
+    }
+
+    char resp[512];
+    snprintf(resp, sizeof(resp),
+             "{\"state\": \"%s\", \"reference\": \"%s\", \"points\": %lu, \"unsettled\": %lu, \"duration_ms\": %.1f, "
+             "\"voc\": %.3f, \"end_voltage\": %.3f, \"end_current\": %.4f, %s, "
+             "\"mpp\": {\"voltage\": %.3f, \"current\": %.4f, \"power\": %.3f}, \"curve\": [",
+             state_names[report.state], (report.config.reference == MODE_CV) ? "MODE_CV" : "MODE_CC", report.count,
+             unsettled, (float)report.duration_us * 1e-3f, open_circuit_voltage, end.voltage, end.current,
+             short_circuit, mpp.voltage, mpp.current, mpp.power);
+
+    httpd_resp_set_type(req, "application/json");
+    size_t length = strlen(resp);
+    for (uint32_t i = 0; i < report.count; i++) {
+        // Send what is buffered when another point might not fit
+        if (sizeof(resp) - length < 48) {
+            httpd_resp_send_chunk(req, resp, length);
+            length = 0;
+        }
+        length += snprintf(resp + length, sizeof(resp) - length, "%s[%.3f, %.4f, %.3f]", (i == 0) ? "" : ", ",
+                           report.points[i].voltage, report.points[i].current, report.points[i].power);
+    }
+    httpd_resp_send_chunk(req, resp, length);
+    httpd_resp_send_chunk(req, "]}", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, NULL, 0);
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for downloading a fault record.
+ *
+ * This handler responds to GET requests to the `/blackbox` endpoint with the
+ * newest fault record, or an older one with `?record=N` where 0 is the newest.
+ * The record holds the safety bits that tripped, the controller state at the
+ * trip and the samples around it as [t_ms, voltage, current, power,
+ * temperature, quality] rows, with t_ms relative to the trigger sample. The
+ * samples are sent in chunks, so the response does not need a buffer for all
+ * of them.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t get_blackbox_handler(httpd_req_t *req) {
+    static const struct {
+        uint32_t bit;
+        const char *name;
+    } cause_names[] = {
+        {OVERVOLTAGE_BIT, "overvoltage"},
+        {OVERCURRENT_BIT, "overcurrent"},
+        {UNDERVOLTAGE_BIT, "undervoltage"},
+        {OVERTEMPERATURE_BIT, "overtemperature"},
+        {HW_TRIP_BIT, "hardware"},
+        {OVERPOWER_BIT, "overpower"},
+        {DEADLINE_BIT, "deadline"},
+    };
+    static BlackboxRecord record; // Too large for the HTTP server stack, only this handler uses it
+    char query[32];
+    char value[8];
+    uint32_t age = 0;
+
+    if (httpd_req_get_url_query_str(req, query, sizeof(query)) == ESP_OK) {
+        if (httpd_query_key_value(query, "record", value, sizeof(value)) == ESP_OK) {
+            age = strtoul(value, NULL, 10);
+        }
+    }
+    if (!blackbox_read(age, &record)) {
+        httpd_resp_send_err(req, HTTPD_404_NOT_FOUND, "No fault record");
+        return ESP_FAIL;
+    }
+
+    char resp[512];
+    size_t length = snprintf(resp, sizeof(resp), "{\"number\": %lu, \"cause\": [", record.number);
+    bool first = true;
+    for (size_t i = 0; i < sizeof(cause_names) / sizeof(cause_names[0]); i++) {
+        if (record.cause & cause_names[i].bit) {
+            length += snprintf(resp + length, sizeof(resp) - length, "%s\"%s\"", first ? "" : ", ", cause_names[i].name);
+            first = false;
+        }
+    }
+    length += snprintf(resp + length, sizeof(resp) - length,
+                       "], \"trigger_sequence\": %lu, \"trigger_us\": %lld, "
+                       "\"control\": {\"mode\": \"%s\", \"setpoint\": %.4f, \"duty_cycle\": %.2f, \"integral\": %.2f}, "
+                       "\"pre_samples\": %lu, \"samples\": [",
+                       record.trigger_sequence, record.trigger_us,
+                       (record.control.mode < MODE_COUNT) ? mode_names[record.control.mode] : "unknown",
+                       record.control.setpoint, record.control.duty_cycle, record.control.integral, record.pre_count);
+
+    httpd_resp_set_type(req, "application/json");
+    for (uint32_t i = 0; i < record.count; i++) {
+        // Send what is buffered when another sample might not fit
+        if (sizeof(resp) - length < 80) {
+            httpd_resp_send_chunk(req, resp, length);
+            length = 0;
+        }
+        const BlackboxSample *sample = &record.samples[i];
+        length += snprintf(resp + length, sizeof(resp) - length, "%s[%.3f, %.3f, %.4f, %.3f, %.1f, %lu]", (i == 0) ? "" : ", ",
+                           (float)(sample->timestamp_us - record.trigger_us) * 1e-3f, sample->bus_voltage,
+                           sample->current, sample->power, sample->temperature_internal, sample->quality);
+    }
+    httpd_resp_send_chunk(req, resp, length);
+    httpd_resp_send_chunk(req, "]}", HTTPD_RESP_USE_STRLEN);
+    httpd_resp_send_chunk(req, NULL, 0);
     return ESP_OK;
 }
 
 /**
  * @brief Handler for resetting the load.
  *
- * This handler responds to POST requests to the `/reset` endpoint by setting
- * the RESET_BIT in the signal event group.
+ * This handler responds to POST requests to the `/reset` endpoint by posting
+ * a reset command to the safety task, which owns the load state.
  *
  * @param req Pointer to the HTTP request.
  * @return ESP_OK on success, or an error code on failure.
@@ -516,8 +1441,11 @@ static esp_err_t reset_handler(httpd_req_t *req) {
     content[recv_size] = '\0';
 
     if (strcmp(content, "reset") == 0) {
-        xEventGroupSetBits(signal_event_group, RESET_BIT);
-        ESP_LOGE(TAG, "Reset signal triggered: %lu", xEventGroupGetBits(signal_event_group));
+        if (!load_state_command(LOAD_COMMAND_RESET)) {
+            httpd_resp_send_err(req, HTTPD_500_INTERNAL_SERVER_ERROR, "Load command queue full");
+            return ESP_FAIL;
+        }
+        ESP_LOGI(TAG, "Reset command posted");
     }
 
     httpd_resp_send(req, "Reset triggered", HTTPD_RESP_USE_STRLEN);
@@ -528,19 +1456,111 @@ static esp_err_t reset_handler(httpd_req_t *req) {
  * @brief Handler for checking if the load is running.
  *
  * This handler responds to GET requests to the `/loadstate` endpoint by
- * returning a JSON response indicating whether the load is running or not.
+ * returning a JSON response with the published load state, whether the load is
+ * running, the fault bits, the version of the state and the latency of the
+ * last command that changed it.
  *
  * @param req Pointer to the HTTP request.
  * @return ESP_OK on success, or an error code on failure.
  */
 static esp_err_t get_load_state_handler(httpd_req_t *req) {
-    // Check the START_STOP_BIT in the signal event group
-    EventBits_t bits = xEventGroupGetBits(signal_event_group);
-    bool is_running = (bits & START_STOP_BIT) != 0;
+    LoadStatus load;
+    uint32_t version = load_state_get(&load);
 
     // Create a JSON response
-    char resp[50];
-    snprintf(resp, sizeof(resp), "{\"running\": %s}", is_running ? "true" : "false");
+    char resp[160];
+    snprintf(resp, sizeof(resp),
+             "{\"running\": %s, \"state\": \"%s\", \"faults\": %lu, \"resets\": %lu, \"version\": %lu, \"command_latency_us\": %lu}",
+             (load.state == LOAD_RUNNING) ? "true" : "false", load_state_name(load.state), load.faults, load.resets,
+             version, load.command_latency_us);
+
+    httpd_resp_set_type(req, "application/json");
+    httpd_resp_send(req, resp, strlen(resp));
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for retrieving runtime statistics.
+ *
+ * This handler responds to GET requests to the `/statistics` endpoint by
+ * returning the latest measurement task statistics in JSON format, with the
+ * control loop timing and the deadline counters of the supervised tasks.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t get_statistics_handler(httpd_req_t *req) {
+    static const char *const supervised_names[SUPERVISED_COUNT] = {
+        [SUPERVISED_MEASUREMENT] = "measurement",
+        [SUPERVISED_CONTROL] = "control",
+        [SUPERVISED_SAFETY] = "safety",
+    };
+    MeasurementStatistics statistics;
+    ControlStatistics control_statistics = {0};
+    SupervisorStatistics supervisor_statistics;
+    xQueuePeek(control_statistics_queue, &control_statistics, 0);
+    supervisor_get_statistics(&supervisor_statistics);
+    if (xQueuePeek(measurement_statistics_queue, &statistics, pdMS_TO_TICKS(10)) == pdTRUE) {
+        char resp[1024];
+        size_t length = snprintf(resp, sizeof(resp),
+                 "{\"samples_per_second\": %.1f, \"scl_speed_hz\": %lu, "
+                 "\"conversions\": %lu, \"samples\": %lu, \"missed_conversions\": %lu, \"duplicate_samples\": %lu, "
+                 "\"i2c_retries\": %lu, \"i2c_recoveries\": %lu, \"i2c_failures\": %lu, "
+                 "\"sensors\": {\"ina237\": {\"rate_hz\": %.1f, \"cpu_us\": %.1f}, "
+                 "\"ntc_internal\": {\"rate_hz\": %.1f, \"cpu_us\": %.1f}, "
+                 "\"ntc_external\": {\"rate_hz\": %.1f, \"cpu_us\": %.1f}}, "
+                 "\"control\": {\"loops_per_second\": %.1f, \"period_avg_us\": %.1f, \"period_max_us\": %.1f, "
+                 "\"latency_avg_us\": %.1f, \"latency_max_us\": %.1f, \"samples_skipped\": %lu}, \"deadlines\": {",
+                 statistics.samples_per_second, statistics.scl_speed_hz,
+                 statistics.conversions, statistics.samples, statistics.missed_conversions, statistics.duplicate_samples,
+                 statistics.i2c_retries, statistics.i2c_recoveries, statistics.i2c_failures,
+                 statistics.sensors[SENSOR_INA237].rate_hz, statistics.sensors[SENSOR_INA237].cpu_us,
+                 statistics.sensors[SENSOR_NTC_INTERNAL].rate_hz, statistics.sensors[SENSOR_NTC_INTERNAL].cpu_us,
+                 statistics.sensors[SENSOR_NTC_EXTERNAL].rate_hz, statistics.sensors[SENSOR_NTC_EXTERNAL].cpu_us,
+                 control_statistics.loops_per_second, control_statistics.period_avg_us, control_statistics.period_max_us,
+                 control_statistics.latency_avg_us, control_statistics.latency_max_us, control_statistics.samples_skipped);
+        for (int task = 0; task < SUPERVISED_COUNT; task++) {
+            length += snprintf(resp + length, sizeof(resp) - length,
+                               "%s\"%s\": {\"misses\": %lu, \"max_late_us\": %lu, \"stale_events\": %lu}",
+                               (task == 0) ? "" : ", ", supervised_names[task], supervisor_statistics.deadline_misses[task],
+                               supervisor_statistics.max_late_us[task], supervisor_statistics.stale_events[task]);
+        }
+        snprintf(resp + length, sizeof(resp) - length, "}}");
+        httpd_resp_set_type(req, "application/json");
+        httpd_resp_send(req, resp, strlen(resp));
+    } else {
+        httpd_resp_send_500(req);
+    }
+    return ESP_OK;
+}
+
+/**
+ * @brief Handler for retrieving the fast control timing.
+ *
+ * This handler responds to GET requests to the `/fastcontrol` endpoint by
+ * returning the interrupt count and the jitter histogram of the fast control
+ * path in JSON format. Bin i holds the periods of
+ * FAST_CONTROL_PERIOD_US - FAST_CONTROL_JITTER_BINS / 2 + i us, the outer bins
+ * also hold everything beyond them.
+ *
+ * @param req Pointer to the HTTP request.
+ * @return ESP_OK on success, or an error code on failure.
+ */
+static esp_err_t get_fast_control_handler(httpd_req_t *req) {
+    FastControlStatistics statistics;
+    fast_control_get_statistics(&statistics);
+
+    char resp[512];
+    int length = snprintf(resp, sizeof(resp),
+                          "{\"enabled\": %s, \"active\": %s, \"period_us\": %d, \"ticks\": %lu, \"stale_ticks\": %lu, "
+                          "\"period_min_us\": %lu, \"period_max_us\": %lu, \"histogram\": [",
+                          FAST_CONTROL_ENABLED ? "true" : "false", fast_control_active() ? "true" : "false",
+                          FAST_CONTROL_PERIOD_US, statistics.ticks, statistics.stale_ticks,
+                          statistics.period_min_us, statistics.period_max_us);
+    for (int i = 0; i < FAST_CONTROL_JITTER_BINS; i++) {
+        length += snprintf(resp + length, sizeof(resp) - length, "%s%lu", (i == 0) ? "" : ", ", statistics.jitter_histogram[i]);
+    }
+    snprintf(resp + length, sizeof(resp) - length, "]}");
 
     httpd_resp_set_type(req, "application/json");
     httpd_resp_send(req, resp, strlen(resp));
@@ -560,6 +1580,7 @@ httpd_handle_t start_webserver()
     // Create http handle and config.
     httpd_handle_t server = NULL;
     httpd_config_t config = HTTPD_DEFAULT_CONFIG();
+    config.max_uri_handlers = 24; // The default of 8 is not enough for all endpoints
 
     // Start http server with the above handle and config
     esp_err_t ret = httpd_start(&server, &config);
@@ -630,6 +1651,110 @@ httpd_handle_t start_webserver()
         };
         httpd_register_uri_handler(server, &loadstate_uri);
 
+        httpd_uri_t statistics_uri = {
+            .uri       = "/statistics",
+            .method    = HTTP_GET,
+            .handler   = get_statistics_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &statistics_uri);
+
+        httpd_uri_t fast_control_uri = {
+            .uri       = "/fastcontrol",
+            .method    = HTTP_GET,
+            .handler   = get_fast_control_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &fast_control_uri);
+
+        httpd_uri_t dynamic_uri = {
+            .uri       = "/dynamic",
+            .method    = HTTP_POST,
+            .handler   = set_dynamic_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &dynamic_uri);
+
+        httpd_uri_t trigger_uri = {
+            .uri       = "/trigger",
+            .method    = HTTP_POST,
+            .handler   = trigger_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &trigger_uri);
+
+        httpd_uri_t waveform_upload_uri = {
+            .uri       = "/waveform",
+            .method    = HTTP_POST,
+            .handler   = set_waveform_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &waveform_upload_uri);
+
+        httpd_uri_t waveform_report_uri = {
+            .uri       = "/waveform",
+            .method    = HTTP_GET,
+            .handler   = get_waveform_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &waveform_report_uri);
+
+        httpd_uri_t list_upload_uri = {
+            .uri       = "/list",
+            .method    = HTTP_POST,
+            .handler   = set_list_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &list_upload_uri);
+
+        httpd_uri_t list_status_uri = {
+            .uri       = "/list",
+            .method    = HTTP_GET,
+            .handler   = get_list_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &list_status_uri);
+
+        httpd_uri_t discharge_config_uri = {
+            .uri       = "/discharge",
+            .method    = HTTP_POST,
+            .handler   = set_discharge_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &discharge_config_uri);
+
+        httpd_uri_t discharge_report_uri = {
+            .uri       = "/discharge",
+            .method    = HTTP_GET,
+            .handler   = get_discharge_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &discharge_report_uri);
+
+        httpd_uri_t sweep_config_uri = {
+            .uri       = "/sweep",
+            .method    = HTTP_POST,
+            .handler   = set_sweep_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &sweep_config_uri);
+
+        httpd_uri_t sweep_curve_uri = {
+            .uri       = "/sweep",
+            .method    = HTTP_GET,
+            .handler   = get_sweep_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &sweep_curve_uri);
+
+        httpd_uri_t blackbox_uri = {
+            .uri       = "/blackbox",
+            .method    = HTTP_GET,
+            .handler   = get_blackbox_handler,
+            .user_ctx  = NULL
+        };
+        httpd_register_uri_handler(server, &blackbox_uri);
+
     } else {
         ESP_LOGI(TAG, "Server failed to start");
     }
@@ -22,6 +22,7 @@
 #define POWER_SWITCH_RELAY_PIN 45 /**< GPIO pin used for relay to physically disconnect DUT from laod. */
 #define I2C_SDA_PIN 11          /**< GPIO pin used for I2C SDA. */
 #define I2C_SCL_PIN 12          /**< GPIO pin used for I2C SCL. */
+#define INA237_ALERT_PIN 14     /**< GPIO pin connected to the INA237 ALERT output (open drain, active low). */
 
 // WiFi Configuration
 #define CONFIG_WIFI_SSID "Sondre"       /**< WiFi SSID for connecting the ESP32-S3. */
@@ -31,18 +32,19 @@
 #define MAX_CURRENT 11.0      /**< Maximum allowable current in amperes (A). */
 #define MAX_VOLTAGE 50.0      /**< Maximum allowable voltage in volts (V). */
 #define MAX_TEMPERATURE 125.0 /**< Maximum allowable temperature in degrees Celsius (°C). */
+#define MIN_RESISTANCE 0.1    /**< Smallest constant resistance setpoint in ohms, below it the load draws nothing (Ω). */
 
 // Bits for protection triggering (safety_event_group)
 #define OVERVOLTAGE_BIT 1 << 0     /**< Event group bit for overvoltage protection. */
 #define OVERCURRENT_BIT 1 << 1     /**< Event group bit for overcurrent protection. */
 #define UNDERVOLTAGE_BIT 1 << 2    /**< Event group bit for undervoltage protection. */
 #define OVERTEMPERATURE_BIT 1 << 3 /**< Event group bit for overtemperature protection. */
+#define HW_TRIP_BIT 1 << 4         /**< Event group bit for a trip of the INA237 limit comparators. */
+#define OVERPOWER_BIT 1 << 5       /**< Event group bit for the power limit or the MOSFET safe operating area. */
+#define DEADLINE_BIT 1 << 6        /**< Event group bit for stale samples or a supervised task that missed its deadline. */
 
 // Bits for signal event group
-#define HMI_SETPOINT_BIT 1 << 0           /**< Event group bit for HMI setpoint updates. */
-#define CONTROL_SETPOINT_BIT 1 << 2       /**< Event group bit for control setpoint updates. */
-#define START_STOP_BIT 1 << 3             /**< Event group bit for start/stop control. */
-#define RESET_BIT 1 << 4                  /**< Event group bit for reset control. */
+#define SOA_DERATE_BIT 1 << 5             /**< Event group bit set by the safety task while the load should back off to stay in the SOA. */
 
 // Bits for WiFi event group and WiFi-related operations
 #define WIFI_SUCCESS 1 << 0 /**< Event group bit for successful WiFi connection. */
@@ -61,8 +63,46 @@
 #define PWM_TIMER LEDC_TIMER_0                 /**< LEDC timer used for PWM. */
 
 // INA237 Registers
-#define INA237_VBUS_REG 0x05    /**< INA237 Bus voltage register */
-#define INA237_CURRENT_REG 0x07 /**< INA237 current read register */
+#define INA237_CONFIG_REG 0x00     /**< INA237 configuration register */
+#define INA237_ADC_CONFIG_REG 0x01 /**< INA237 ADC configuration register */
+#define INA237_SHUNT_CAL_REG 0x02  /**< INA237 shunt calibration register */
+#define INA237_VSHUNT_REG 0x04     /**< INA237 shunt voltage register, first register of the result frame */
+#define INA237_VBUS_REG 0x05       /**< INA237 Bus voltage register */
+#define INA237_DIETEMP_REG 0x06    /**< INA237 die temperature register */
+#define INA237_CURRENT_REG 0x07    /**< INA237 current read register */
+#define INA237_POWER_REG 0x08      /**< INA237 power register (24 bit), last register of the result frame */
+#define INA237_DIAG_ALRT_REG 0x0B  /**< INA237 diagnostic flags and alert register */
+#define INA237_SOVL_REG 0x0C       /**< INA237 shunt overvoltage threshold register */
+#define INA237_SUVL_REG 0x0D       /**< INA237 shunt undervoltage threshold register */
+#define INA237_BOVL_REG 0x0E       /**< INA237 bus overvoltage threshold register */
+#define INA237_BUVL_REG 0x0F       /**< INA237 bus undervoltage threshold register */
+#define INA237_MANUFACTURER_ID_REG 0x3E /**< INA237 manufacturer ID register */
+#define INA237_MANUFACTURER_ID 0x5449   /**< Expected manufacturer ID ("TI") */
+#define INA237_ADDRESS 0b1000000        /**< I2C address of the INA237 (A0 = A1 = GND) */
+
+// INA237 Conversion Timing
+#define INA237_ADC_CONFIG 0b1111100100000000 /**< Continuous shunt, bus and temperature, VBUSCT = VSHCT = 540 us, VTCT = 50 us, no averaging. Gives one conversion every ~1.13 ms. */
+#define INA237_DIAG_ALRT_CNVR 0b0100000000000000 /**< DIAG_ALRT value routing conversion ready to the ALERT pin (transparent, active low). */
+#define INA237_ALERT_TIMEOUT_MS 20 /**< Time to wait for a conversion ready alert before reading anyway (must be at least one tick). */
+#define INA237_ALERT_SIMULATED 0   /**< Set to 1 to drive the measurement task from an esp_timer instead of the ALERT pin. */
+#define INA237_ADC_CONFIG_FAST 0b1011010010000000 /**< Continuous shunt and bus only, VBUSCT = VSHCT = 150 us, no averaging. One conversion every ~300 us, used with FAST_CONTROL_ENABLED. The die temperature is not updated. */
+#define INA237_ALERT_SIMULATED_PERIOD_US 1130 /**< Period of the simulated ALERT source in microseconds. */
+#define INA237_CONVERSION_PERIOD_US (FAST_CONTROL_ENABLED ? 300 : 1130) /**< Time between two conversions with the ADC configuration in use (us). */
+#define INA237_HW_PROTECTION 0 /**< Set to 1 to route the INA237 limit comparators to the ALERT pin. The measurement task is then paced by an esp_timer, as with INA237_ALERT_SIMULATED, so samples lose the conversion-ready pacing and timestamps. */
+#define INA237_DIAG_ALRT_LIMITS 0b1000000000000000 /**< DIAG_ALRT value latching the limit alerts on the ALERT pin (active low), without conversion ready. */
+#define INA237_DIAG_ALRT_SHNTOL (1 << 6) /**< DIAG_ALRT flag, shunt voltage over SOVL. */
+#define INA237_DIAG_ALRT_SHNTUL (1 << 5) /**< DIAG_ALRT flag, shunt voltage under SUVL. */
+#define INA237_DIAG_ALRT_BUSOL (1 << 4)  /**< DIAG_ALRT flag, bus voltage over BOVL. */
+#define INA237_DIAG_ALRT_BUSUL (1 << 3)  /**< DIAG_ALRT flag, bus voltage under BUVL. */
+#define INA237_SHUNT_CAL 2500 /**< SHUNT_CAL register value, the CURRENT register is VSHUNT x 4096 / SHUNT_CAL. */
+
+// INA237 Result Frame (VSHUNT, VBUS, DIETEMP, CURRENT and POWER read in one transaction)
+#define INA237_FRAME_LENGTH 11              /**< Bytes in the result frame: four 16 bit registers and the 24 bit power register. */
+#define INA237_VSHUNT_LSB (5.0 / 1000000.0) /**< Shunt voltage LSB with ADCRANGE = 0 (V). */
+#define INA237_VBUS_LSB (3.125 / 1000.0)    /**< Bus voltage LSB (V). */
+#define INA237_DIETEMP_LSB 0.125            /**< Die temperature LSB, value is in bits 15-4 (°C). */
+#define INA237_CURRENT_LSB (8.0 / 32768.0)  /**< Current LSB (A). */
+#define INA237_POWER_LSB (0.2 * INA237_CURRENT_LSB) /**< Power LSB, fixed at 0.2 x current LSB (W). */
 
 // I2C Related
 #define I2C_PORT -1                        /**< I2C port number. -1 indicates unconfigured. */
@@ -70,6 +110,107 @@
 #define GLITCH_IGNORE_COUNT 7              /**< Number of glitches to ignore on the I2C bus. */
 #define INTERNAL_PULLUP 1                  /**< Enable (1) or disable (0) internal pull-up resistors. */
 #define DEV_ADDR_LENGTH I2C_ADDR_BIT_LEN_7 /**< I2C device address length in bits (7-bit addressing). */
+#define I2C_PROBE_TIMEOUT_MS 10            /**< Timeout for a single transfer while validating a bus speed. */
+#define I2C_TIMEOUT_MS 2                   /**< Timeout for a single transfer attempt (ms). */
+#define I2C_RETRIES 1                      /**< Extra attempts after a failed transfer, each preceded by a bus recovery. */
+
+// I2C Bus Profiles
+// The INA237 supports up to 2.94 MHz in HS-mode, but the ESP32-S3 I2C controller cannot send the HS master code,
+// so fast-plus is the fastest profile that can be used.
+#define I2C_SPEED_STANDARD 100000  /**< Standard mode SCL speed (Hz). */
+#define I2C_SPEED_FAST 400000      /**< Fast mode SCL speed (Hz). */
+#define I2C_SPEED_FAST_PLUS 1000000 /**< Fast-plus mode SCL speed (Hz). */
+#define INA237_I2C_SPEED I2C_SPEED_FAST_PLUS /**< Preferred SCL speed for the INA237, slower profiles are tried if validation fails. */
+#define INA237_PROBE_READS 16      /**< Number of manufacturer ID reads that must all succeed to accept a bus speed. */
+
+// Control loop
+#define CONTROL_SAMPLE_TIMEOUT_MS 20 /**< Longest wait for a new sample before the control loop runs its housekeeping anyway. */
+#define CONTROL_LOG_PERIOD_MS 1000   /**< Minimum interval between the periodic control log messages. */
+#define CONTROL_STOPPED_DELAY_MS 100 /**< Delay of each control loop iteration while the load is off, cut short by a load state change. */
+
+// Regulator
+#define REGULATOR_FIXED_POINT 0 /**< Set to 1 to run the control task regulator in Q15/Q31 fixed point instead of float. */
+
+// Fast control path
+#define FAST_CONTROL_ENABLED 0       /**< Set to 1 to regulate constant current from a timer interrupt instead of the control task. */
+#define FAST_CONTROL_PERIOD_US 100   /**< Period of the fast control interrupt (us), 10 kHz. */
+#define FAST_CONTROL_KP 8.0          /**< Proportional gain of the fast path (% duty per A). */
+#define FAST_CONTROL_KI 50.0         /**< Integral gain of the fast path (% duty per A·s). */
+#define FAST_CONTROL_STALE_TICKS 20  /**< Interrupts without a new current reading before the duty cycle is held (2 ms). */
+#define FAST_CONTROL_JITTER_BINS 17  /**< Bins of 1 us in the jitter histogram, centred on FAST_CONTROL_PERIOD_US. */
+
+// Dynamic mode
+#if FAST_CONTROL_ENABLED
+#define DYNAMIC_MAX_FREQUENCY_HZ (1000000 / (4 * FAST_CONTROL_PERIOD_US)) /**< Highest square wave frequency, four fast control ticks per period (2.5 kHz). */
+#else
+#define DYNAMIC_MAX_FREQUENCY_HZ 200 /**< Highest square wave frequency, about four INA237 samples per period. */
+#endif
+
+// Waveform playback
+#define WAVEFORM_MAX_POINTS_PSRAM 65536  /**< Largest waveform table when it fits in PSRAM (256 kB). */
+#define WAVEFORM_MAX_POINTS_INTERNAL 4096 /**< Largest waveform table in internal RAM, used when there is no PSRAM (16 kB). */
+#define WAVEFORM_MIN_INTERVAL_US 100      /**< Shortest interval between two waveform points (us). */
+
+// List mode
+#define LIST_MAX_STEPS 64        /**< Largest number of steps in a list. */
+#define LIST_MIN_DWELL_US (2 * INA237_CONVERSION_PERIOD_US) /**< Shortest dwell time of a step, two INA237 samples so a late sample cannot skip it (us). */
+
+// Battery discharge test
+#define DISCHARGE_CUTOFF_CONFIRM_US 500000 /**< Time the voltage must stay below the cutoff before the test ends (us). */
+#define DISCHARGE_PULSE_US 100000          /**< Length of a reduced-load pulse for the internal resistance (us). */
+#define DISCHARGE_AVERAGE_US 10000         /**< Voltage and current are averaged over the end of each level of a pulse (us). */
+#define DISCHARGE_MIN_STEP_A 0.05          /**< Smallest current step an internal resistance is computed from (A). */
+#define DISCHARGE_SAVE_PERIOD_MS 60000     /**< Interval at which the progress of a running test is saved to NVS. */
+
+// I-V sweep
+#define SWEEP_MAX_POINTS 128           /**< Largest number of points in an I-V sweep. */
+#define SWEEP_SETTLE_WINDOW_US 50000    /**< Time a point must stay at its reference before it counts as settled, a few CC loop time constants (us). */
+#define SWEEP_SETTLE_TIMEOUT_US 1000000 /**< Default longest wait for a point to settle, it is recorded as unsettled after (us). */
+#define SWEEP_AVERAGE_SAMPLES 4        /**< Samples averaged into each point once it has settled. */
+#define SWEEP_SHORT_CIRCUIT_FRACTION 0.02 /**< A point below this fraction of the open-circuit voltage ends a sweep, the source is shorted. */
+
+// Safe operating area
+#define SOA_DERATE_LEVEL 0.5         /**< Fraction of the SOA pulse budget above which the load backs off. */
+#define SOA_DERATE_STEP 0.01         /**< Fraction the reference is backed off by on every sample while derating. */
+#define SOA_DERATE_MIN 0.05          /**< Lowest fraction of the reference the derate backs off to, the SOA trip covers the rest. */
+#define SOA_DERATE_RECOVERY_STEP 0.001 /**< Fraction of the reference given back on every sample once the derate is over. */
+#define SOA_COOLING_US 100000.0      /**< Time constant the SOA budget comes back with below the DC curve, die and case (us). */
+#define SAFETY_SAMPLE_TIMEOUT_MS 10 /**< Longest wait of the safety task for a new sample, the relays and reset are handled at least this often. */
+
+// Load state machine
+#define LOAD_COMMAND_QUEUE_LENGTH 8 /**< Start, stop and reset commands that can wait for the safety task. */
+#define LOAD_STATE_NOTIFY_INDEX 1   /**< Task notification index the control task is woken on when the load state changes, index 0 counts samples. */
+
+// Fault recorder
+#define BLACKBOX_PRE_SAMPLES 128        /**< Samples recorded before the trip, ~145 ms. PRE + POST must leave room in the sample ring. */
+#define BLACKBOX_POST_SAMPLES 64        /**< Samples recorded from the trip on, ~72 ms. */
+#define BLACKBOX_POST_TIMEOUT_US 500000 /**< Longest wait for the post-trigger samples, the record is written with what there is after (us). */
+#define BLACKBOX_PARTITION_LABEL "blackbox" /**< Label of the flash partition the records are written to. */
+#define BLACKBOX_PARTITION_SUBTYPE 0x40     /**< Data subtype of the blackbox partition, see partitions.csv. */
+#define BLACKBOX_MAGIC 0x42424F58           /**< Marks a slot that holds a record ("BBOX"). */
+
+// Deadline supervision. A task is overdue once its deadline has passed, a sample is stale once it is older than the bound.
+#define SUPERVISOR_DEADLINE_MARGIN_US 50000 /**< Added to every deadline, covers the 10 ms tick and short flash stalls (us). */
+#define MEASUREMENT_DEADLINE_US (INA237_ALERT_TIMEOUT_MS * 1000 + SUPERVISOR_DEADLINE_MARGIN_US) /**< Longest time between two measurement task heartbeats (us). */
+#define CONTROL_DEADLINE_US (CONTROL_SAMPLE_TIMEOUT_MS * 1000 + SUPERVISOR_DEADLINE_MARGIN_US)   /**< Longest time between two control task heartbeats while the load runs (us). */
+#define CONTROL_STOPPED_DEADLINE_US ((CONTROL_STOPPED_DELAY_MS + CONTROL_SAMPLE_TIMEOUT_MS) * 1000 + SUPERVISOR_DEADLINE_MARGIN_US) /**< Longest time between two control task heartbeats while the load is off (us). */
+#define SAFETY_DEADLINE_US (SAFETY_SAMPLE_TIMEOUT_MS * 1000 + SUPERVISOR_DEADLINE_MARGIN_US)     /**< Longest time between two safety task heartbeats (us). */
+#define CONTROL_SAMPLE_MAX_AGE_US 25000  /**< Oldest good sample the control task regulates on, older ones switch the duty cycle off until fresh ones arrive (us). */
+#define SAFETY_SAMPLE_MAX_AGE_US 100000  /**< Oldest good sample the safety task accepts while the load runs, older ones trip DEADLINE_BIT (us). */
+
+// Sample ring
+#define SAMPLE_RING_LENGTH 256 /**< Measurement samples kept in the sample ring, ~290 ms at the INA237 rate. Must be a power of two. */
+
+// Statistics
+#define STATISTICS_PERIOD_MS 1000 /**< Interval at which tasks publish their runtime statistics. */
+
+// Sensor schedule, in INA237 samples (~885 per second). A sensor runs on the samples where sample % period == phase.
+#define SCHEDULE_INA237_PERIOD 1         /**< INA237 voltage and current read on every sample. */
+#define SCHEDULE_INA237_PHASE 0          /**< Phase of the INA237 read. */
+#define SCHEDULE_NTC_INTERNAL_PERIOD 18  /**< Internal NTC (and DMA frame drain) at ~50 Hz. */
+#define SCHEDULE_NTC_INTERNAL_PHASE 1    /**< Phase of the internal NTC, offset so it does not share a sample with the external probes. */
+#define SCHEDULE_NTC_EXTERNAL_PERIOD 177 /**< External NTC probes at ~5 Hz. */
+#define SCHEDULE_NTC_EXTERNAL_PHASE 10   /**< Phase of the external NTC probes. */
 
 // NTC Related
 #define R1_NTC_VDIV 10000   /**< Value of R1 in the voltage divider for NTC thermistor. */
@@ -77,5 +218,16 @@
 #define R0_NTC 10000        /**< Reference resistance for NTC thermistor. */
 #define B_NTC_INTERNAL 3500 /**< B value for internal NTC thermistor. */
 #define B_NTC_EXTERNAL 3500 /**< B value for external NTC thermistors. */
+#define NTC_ADC_CHANNEL_INTERNAL 3   /**< ADC1 channel of the internal NTC (GPIO 4). */
+#define NTC_ADC_CHANNEL_EXTERNAL_1 0 /**< ADC1 channel of external NTC probe 1 (GPIO 1). */
+#define NTC_ADC_CHANNEL_EXTERNAL_2 1 /**< ADC1 channel of external NTC probe 2 (GPIO 2). */
+#define NTC_ADC_CHANNEL_EXTERNAL_3 4 /**< ADC1 channel of external NTC probe 3 (GPIO 5), moved from ADC2 (GPIO 17) which is shared with Wi-Fi. */
+#define NTC_ADC_SAMPLE_FREQ_HZ 2000  /**< Total continuous ADC conversion rate, 500 Hz per NTC channel. */
+#define NTC_ADC_FRAME_SIZE 256       /**< Bytes per DMA frame, 64 conversions or 16 per channel (~32 ms). */
+#define NTC_ADC_BUFFER_SIZE 1024     /**< Bytes in the continuous ADC ring buffer, four frames. */
+#define NTC_ADC_MAX 4095    /**< Maximum raw value of the 12 bit ADC. */
+#define NTC_TABLE_SHIFT 5   /**< log2 of the ADC codes between two temperature table entries (32 codes). */
+#define NTC_TABLE_MIN_T -55.0 /**< Lowest temperature stored in the table (°C), colder readings are clamped. */
+#define NTC_TABLE_MAX_T 250.0 /**< Highest temperature stored in the table (°C), hotter readings are clamped. */
 
 #endif
\ No newline at end of file
@@ -1,5 +1,6 @@
 #include <stdio.h>
 #include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 #include "esp_log.h"
 
 /**
@@ -7,7 +8,8 @@
  * @brief Implementation of ADC initialization and reading functions.
  * 
  * This file contains the functions for initializing an ADC unit, configuring ADC channels,
- * and reading values from ADC channels.
+ * and reading values from ADC channels, either one conversion at a time or continuously
+ * through DMA.
  * 
  *
  * @date 2025-05-12
@@ -88,4 +90,106 @@ int adc_read(adc_oneshot_unit_handle_t adc_handle_name, adc_channel_t channel){
     return adc_raw;
 }
 
+/**
+ * @brief Initialises ADC1 in continuous mode.
+ *
+ * This function sets up a DMA driven scan of the given ADC1 channels, which runs
+ * in the background and fills the driver's ring buffer.
+ *
+ * @param adc_handle_name Pointer to the continuous ADC handle.
+ * @param channels The ADC1 channels to scan, in scan order.
+ * @param channel_count Number of channels in the scan.
+ * @param atten The attenuation to use for all channels.
+ * @param sample_freq_hz Total conversion rate, shared by all channels.
+ * @param frame_size Bytes per DMA frame, must be a multiple of SOC_ADC_DIGI_RESULT_BYTES.
+ * @param buffer_size Bytes in the driver's ring buffer.
+ *
+ * @details Only ADC1 is used, ADC2 is shared with Wi-Fi on the ESP32-S3 and cannot be scanned by DMA while it runs.
+ * @details The scan is started before the function returns, so the first frame is ready after
+ * @details frame_size / SOC_ADC_DIGI_RESULT_BYTES conversions.
+ */
+void adc_continuous_unit_init(adc_continuous_handle_t *adc_handle_name, const adc_channel_t *channels, size_t channel_count,
+                              adc_atten_t atten, uint32_t sample_freq_hz, uint32_t frame_size, uint32_t buffer_size)
+{
+    //Configuration for the DMA frames and ring buffer.
+    adc_continuous_handle_cfg_t adc_handle_cfg = {
+        .max_store_buf_size = buffer_size,
+        .conv_frame_size = frame_size,
+    };
+    ESP_ERROR_CHECK(adc_continuous_new_handle(&adc_handle_cfg, adc_handle_name));
+
+    //One pattern entry per channel, converted in this order.
+    adc_digi_pattern_config_t pattern[SOC_ADC_PATT_LEN_MAX] = {0};
+    for (size_t i = 0; i < channel_count; i++)
+    {
+        pattern[i].atten = atten;
+        pattern[i].channel = channels[i];
+        pattern[i].unit = ADC_UNIT_1;
+        pattern[i].bit_width = SOC_ADC_DIGI_MAX_BITWIDTH;
+    }
+
+    adc_continuous_config_t adc_cfg = {
+        .pattern_num = channel_count,
+        .adc_pattern = pattern,
+        .sample_freq_hz = sample_freq_hz,
+        .conv_mode = ADC_CONV_SINGLE_UNIT_1,
+        .format = ADC_DIGI_OUTPUT_FORMAT_TYPE2,
+    };
+    ESP_ERROR_CHECK(adc_continuous_config(*adc_handle_name, &adc_cfg));
+    ESP_ERROR_CHECK(adc_continuous_start(*adc_handle_name));
+    ESP_LOGI(TAG, "ADC continuous mode started, %d channels at %lu Hz", (int)channel_count, sample_freq_hz);
+}
+
+/**
+ * @brief Averages all conversions waiting in the continuous ADC ring buffer.
+ *
+ * This function does not block. It drains every complete frame and averages the
+ * results per channel.
+ *
+ * @param adc_handle_name The continuous ADC handle.
+ * @param frame Buffer of frame_size bytes to read the frames into.
+ * @param frame_size Bytes per DMA frame.
+ * @param channels The scanned channels, in the same order as at init.
+ * @param channel_count Number of scanned channels.
+ * @param averages Output, the averaged raw value per channel. Left untouched for channels without new results.
+ * @return Returns the number of conversions averaged, 0 if no new frame was ready.
+ *
+ * @details The ESP32-S3 has no hardware averaging in continuous mode, so the results are summed here.
+ * @details That is a few additions per result, compared to a blocking oneshot conversion per channel.
+ */
+uint32_t adc_continuous_read_average(adc_continuous_handle_t adc_handle_name, uint8_t *frame, uint32_t frame_size,
+                                     const adc_channel_t *channels, size_t channel_count, uint16_t *averages)
+{
+    uint32_t sum[SOC_ADC_PATT_LEN_MAX] = {0};
+    uint32_t count[SOC_ADC_PATT_LEN_MAX] = {0};
+    uint32_t total = 0;
+    uint32_t length = 0;
 
+    //Drain every frame that is ready without waiting for new ones.
+    while (adc_continuous_read(adc_handle_name, frame, frame_size, &length, 0) == ESP_OK)
+    {
+        for (uint32_t i = 0; i + SOC_ADC_DIGI_RESULT_BYTES <= length; i += SOC_ADC_DIGI_RESULT_BYTES)
+        {
+            adc_digi_output_data_t *result = (adc_digi_output_data_t *)&frame[i];
+            for (size_t c = 0; c < channel_count; c++)
+            {
+                if (result->type2.channel == channels[c])
+                {
+                    sum[c] += result->type2.data;
+                    count[c]++;
+                    total++;
+                    break;
+                }
+            }
+        }
+    }
+
+    for (size_t c = 0; c < channel_count; c++)
+    {
+        if (count[c] != 0)
+        {
+            averages[c] = (sum[c] + count[c] / 2) / count[c];
+        }
+    }
+    return total;
+}
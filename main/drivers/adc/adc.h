@@ -3,6 +3,7 @@
 
 #include <stdio.h>
 #include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 #include "esp_log.h"
 
 /**
@@ -10,7 +11,8 @@
  * @brief Implementation of ADC initialization and reading functions.
  * 
  * This file contains the functions for initializing an ADC unit, configuring ADC channels,
- * and reading values from ADC channels.
+ * and reading values from ADC channels, either one conversion at a time or continuously
+ * through DMA.
  * 
  *
  * @date 2025-05-12
@@ -55,4 +57,42 @@ void adc_channel_init(adc_oneshot_unit_handle_t adc_handle_name,
 int adc_read(adc_oneshot_unit_handle_t adc_handle_name,
              adc_channel_t channel);
 
+/**
+ * @brief Initialises ADC1 in continuous mode.
+ *
+ * This function sets up a DMA driven scan of the given ADC1 channels, which runs
+ * in the background and fills the driver's ring buffer.
+ *
+ * @param adc_handle_name Pointer to the continuous ADC handle.
+ * @param channels The ADC1 channels to scan, in scan order.
+ * @param channel_count Number of channels in the scan.
+ * @param atten The attenuation to use for all channels.
+ * @param sample_freq_hz Total conversion rate, shared by all channels.
+ * @param frame_size Bytes per DMA frame, must be a multiple of SOC_ADC_DIGI_RESULT_BYTES.
+ * @param buffer_size Bytes in the driver's ring buffer.
+ */
+void adc_continuous_unit_init(adc_continuous_handle_t *adc_handle_name,
+                              const adc_channel_t *channels, size_t channel_count,
+                              adc_atten_t atten, uint32_t sample_freq_hz,
+                              uint32_t frame_size, uint32_t buffer_size);
+
+/**
+ * @brief Averages all conversions waiting in the continuous ADC ring buffer.
+ *
+ * This function does not block. It drains every complete frame and averages the
+ * results per channel.
+ *
+ * @param adc_handle_name The continuous ADC handle.
+ * @param frame Buffer of frame_size bytes to read the frames into.
+ * @param frame_size Bytes per DMA frame.
+ * @param channels The scanned channels, in the same order as at init.
+ * @param channel_count Number of scanned channels.
+ * @param averages Output, the averaged raw value per channel. Left untouched for channels without new results.
+ * @return Returns the number of conversions averaged, 0 if no new frame was ready.
+ */
+uint32_t adc_continuous_read_average(adc_continuous_handle_t adc_handle_name,
+                                     uint8_t *frame, uint32_t frame_size,
+                                     const adc_channel_t *channels, size_t channel_count,
+                                     uint16_t *averages);
+
 #endif
\ No newline at end of file
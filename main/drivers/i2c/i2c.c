@@ -2,10 +2,11 @@
 #include "esp_log.h"
 #include "driver/i2c_master.h"
 #include "driver/i2c_slave.h"
-#include "freertos/freeRTOS.h"
+#include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "config.h"
 #include "globals.h"
+#include "i2c.h"
 
 /**
  * @file I2C.c
@@ -16,11 +17,18 @@
  * with the INA237 IC in mind.
  * The file contains the source code for I2C initilisation, device addition and data transmission functions.
  * 
+ * All transfers go through i2c_transfer(), which uses a bounded timeout, retries a failed
+ * transfer after resetting the bus and returns the error instead of aborting, so a glitch
+ * on the bus costs one sample instead of hanging or rebooting the firmware.
+ * 
  *
  * @date 2025-05-12
  */
 static const char* TAG = "I2C";
 
+static i2c_master_bus_handle_t i2c_bus = NULL; /**< Bus used for recovery, set by i2c_init(). */
+static I2CStatistics i2c_statistics = {0};     /**< Error counters for the transfer layer. */
+
 /**
  * @brief Function for initialising I2C with a bus handle.
  * 
@@ -43,6 +51,7 @@ void i2c_init(i2c_master_bus_handle_t *bus_handle_name, gpio_num_t sda_pin, gpio
 
     //Initialise the I2C master bus with the above config.
     ESP_ERROR_CHECK(i2c_new_master_bus(&i2c_mst_config, bus_handle_name));
+    i2c_bus = *bus_handle_name;
     vTaskDelay(pdMS_TO_TICKS(10));
 };
 
@@ -69,7 +78,7 @@ void i2c_add_device(i2c_master_bus_handle_t bus_handle_name, i2c_master_dev_hand
     ESP_ERROR_CHECK(i2c_master_bus_add_device(bus_handle_name, &dev_cfg, dev_handle_name));
 
     // Probe the I2C device to check if it is present.
-    esp_err_t check = i2c_master_probe(bus_handle_name, device_address, -1);
+    esp_err_t check = i2c_master_probe(bus_handle_name, device_address, I2C_PROBE_TIMEOUT_MS);
     if (check == ESP_OK)
     {
         ESP_LOGI(TAG, "I2C Address found at %d", device_address);
@@ -81,24 +90,142 @@ void i2c_add_device(i2c_master_bus_handle_t bus_handle_name, i2c_master_dev_hand
 };
 
 
+/**
+ * @brief Function for recovering a stuck I2C bus.
+ * 
+ * @details Resets the controller state machine and clocks out up to nine SCL pulses so a
+ * @details device holding SDA low releases it, followed by a stop condition.
+ */
+static void i2c_bus_recover(){
+    if (i2c_bus == NULL)
+    {
+        return;
+    }
+    i2c_statistics.recoveries++;
+    esp_err_t err = i2c_master_bus_reset(i2c_bus);
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Bus recovery failed: %s", esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief Function for performing one I2C transfer with retry.
+ * 
+ * @param dev_handle_name Handle to the I2C device.
+ * @param write_buffer Bytes to write.
+ * @param write_length Number of bytes to write.
+ * @param read_buffer Buffer for the read bytes, or NULL for a write only transfer.
+ * @param read_length Number of bytes to read.
+ * @return esp_err_t ESP_OK on success, or the error of the last attempt.
+ * 
+ * @details Every attempt is bounded by I2C_TIMEOUT_MS. A failed attempt is followed by a bus
+ * @details recovery and up to I2C_RETRIES new attempts, so the worst case latency is bounded.
+ */
+static esp_err_t i2c_transfer(i2c_master_dev_handle_t dev_handle_name, const uint8_t *write_buffer, size_t write_length, uint8_t *read_buffer, size_t read_length){
+    esp_err_t err = ESP_FAIL;
+    for (int attempt = 0; attempt <= I2C_RETRIES; attempt++)
+    {
+        if (attempt > 0)
+        {
+            i2c_statistics.retries++;
+            i2c_bus_recover();
+        }
+
+        if (read_buffer == NULL)
+        {
+            err = i2c_master_transmit(dev_handle_name, write_buffer, write_length, I2C_TIMEOUT_MS);
+        }
+        else
+        {
+            err = i2c_master_transmit_receive(dev_handle_name, write_buffer, write_length, read_buffer, read_length, I2C_TIMEOUT_MS);
+        }
+
+        if (err == ESP_OK)
+        {
+            return ESP_OK;
+        }
+    }
+    i2c_statistics.failures++;
+    return err;
+}
+
+/**
+ * @brief Function for reading the transfer layer error counters.
+ * 
+ * @param statistics Struct the counters are copied to.
+ */
+void i2c_get_statistics(I2CStatistics *statistics){
+    *statistics = i2c_statistics;
+}
+
+/**
+ * @brief Function for removing an I2C device from the bus.
+ * 
+ * @param dev_handle_name Handle to the I2C device.
+ * 
+ * @details Used when a device has to be re-added, for example with a different clock speed.
+ */
+void i2c_remove_device(i2c_master_dev_handle_t dev_handle_name){
+    ESP_ERROR_CHECK(i2c_master_bus_rm_device(dev_handle_name));
+}
+
+/**
+ * @brief Function for checking that a register reads back an expected value.
+ * 
+ * @param dev_handle_name Handle to the I2C device.
+ * @param register_address Address of the register to read.
+ * @param expected_value The value the register is expected to hold.
+ * @param reads Number of consecutive reads that must all succeed.
+ * @return esp_err_t ESP_OK if every read matched, ESP_ERR_INVALID_RESPONSE on a mismatch, or the transfer error.
+ * 
+ * @details Unlike the other transfers in this file this does not retry or recover the bus, the first
+ * @details failed read is returned at once, it is meant for validating a bus configuration before it is used.
+ */
+esp_err_t i2c_validate_register(i2c_master_dev_handle_t dev_handle_name, uint8_t register_address, uint16_t expected_value, int reads){
+    uint8_t read_buffer[2] = {0};
+    for (int i = 0; i < reads; i++)
+    {
+        esp_err_t err = i2c_master_transmit_receive(dev_handle_name, &register_address, sizeof(register_address), read_buffer, sizeof(read_buffer), I2C_PROBE_TIMEOUT_MS);
+        if (err != ESP_OK)
+        {
+            return err;
+        }
+        if (((read_buffer[0] << 8) | read_buffer[1]) != expected_value)
+        {
+            return ESP_ERR_INVALID_RESPONSE;
+        }
+    }
+    return ESP_OK;
+}
+
 /**
  * @brief Function for writing data to an I2C device.
  * 
  * @param dev_handle_name Handle to the I2C device.
  * @param register_address Address of the register to write to.
  * @param data_to_write Data to write to the register.
+ * @return esp_err_t ESP_OK on success, or an error code if every attempt failed.
  * 
  * @details This function writes data to the specified register of the I2C device..
  */
-void i2c_write(i2c_master_dev_handle_t dev_handle_name, uint8_t register_address, uint16_t data_to_write){
+esp_err_t i2c_write(i2c_master_dev_handle_t dev_handle_name, uint8_t register_address, uint16_t data_to_write){
     uint8_t write_buffer[3] = {0};
     write_buffer[0] = register_address; // Set the register address.
     write_buffer[1] = (data_to_write >> 8) & 0xFF;  // Set the high byte of the data.
     write_buffer[2] = data_to_write & 0xFF; // Set the low byte of the data.
 
     // Transmit the data to the I2C device.
-    ESP_ERROR_CHECK(i2c_master_transmit(dev_handle_name, write_buffer, sizeof(write_buffer), -1));
-    ESP_LOGI(TAG, "Wrote 0x%04X to register 0x%02X", data_to_write, register_address);
+    esp_err_t err = i2c_transfer(dev_handle_name, write_buffer, sizeof(write_buffer), NULL, 0);
+    if (err == ESP_OK)
+    {
+        ESP_LOGI(TAG, "Wrote 0x%04X to register 0x%02X", data_to_write, register_address);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Failed to write register 0x%02X: %s", register_address, esp_err_to_name(err));
+    }
+    return err;
 }
 
 /**
@@ -106,12 +233,13 @@ void i2c_write(i2c_master_dev_handle_t dev_handle_name, uint8_t register_address
  * 
  * @param dev_handle_name Handle of the I2C device.
  * @param register_address Address of the register pointer
+ * @return esp_err_t ESP_OK on success, or an error code if every attempt failed.
  * 
  * @details This function sets the register pointer of the I2C device to the specified register.
  */
-void i2c_set_register_pointer(i2c_master_dev_handle_t dev_handle_name, uint8_t register_address){
+esp_err_t i2c_set_register_pointer(i2c_master_dev_handle_t dev_handle_name, uint8_t register_address){
     // Transmit the register address to set the register pointer.
-    ESP_ERROR_CHECK(i2c_master_transmit(dev_handle_name, &register_address, sizeof(register_address), -1));
+    return i2c_transfer(dev_handle_name, &register_address, sizeof(register_address), NULL, 0);
 }
 
 /**
@@ -119,26 +247,44 @@ void i2c_set_register_pointer(i2c_master_dev_handle_t dev_handle_name, uint8_t r
  * 
  * @param dev_handle_name Handle to the I2C device.
  * @param register_address Address of the register to read from
- * @return float Returns the data read from the register
+ * @param data Where the signed register value is stored.
+ * @return esp_err_t ESP_OK on success, or an error code if every attempt failed.
  * 
  * @details This function reads data from the specified register of the I2C device.
- * @details The function will return the read data.
+ * @details On failure the value pointed to by data is left unchanged.
  */
-float i2c_read(i2c_master_dev_handle_t dev_handle_name, uint8_t register_address){
-    // Set the register pointer to a desired register to read from.
-    i2c_set_register_pointer(dev_handle_name, register_address);
-
+esp_err_t i2c_read(i2c_master_dev_handle_t dev_handle_name, uint8_t register_address, int16_t *data){
     // Buffer to hold the read data.
     uint8_t read_buffer[2] = {0};
 
-    // Receive the data from the I2C device
-    ESP_ERROR_CHECK(i2c_master_receive(dev_handle_name, read_buffer, sizeof(read_buffer), -1));
+    // Set the register pointer and receive the data from the I2C device
+    esp_err_t err = i2c_transfer(dev_handle_name, &register_address, sizeof(register_address), read_buffer, sizeof(read_buffer));
+    if (err != ESP_OK)
+    {
+        return err;
+    }
 
     // Combine the read data into a single value
     uint16_t combined_data = (read_buffer[0] << 8) | read_buffer[1];
-    int16_t signed_data = (int16_t)combined_data;
-    float result = (float)signed_data;
+    *data = (int16_t)combined_data;
     //ESP_LOGI(TAG, "Read data from register 0x%02X: 0x%04X", register_address, combined_data);
-    return result;
+    return ESP_OK;
 }
 
+/**
+ * @brief Function for reading a block of consecutive registers from an I2C device.
+ * 
+ * @param dev_handle_name Handle to the I2C device.
+ * @param start_register Address of the first register to read from.
+ * @param read_buffer Buffer the raw bytes are written to.
+ * @param length Number of bytes to read.
+ * @return esp_err_t ESP_OK on success, or an error code if every attempt failed.
+ * 
+ * @details The register pointer is written and the data read back in a single transaction
+ * @details with a repeated start, instead of a separate transmit and receive.
+ * @details The bytes are returned as sent by the device (MSB first), decoding is left to the caller.
+ */
+esp_err_t i2c_read_block(i2c_master_dev_handle_t dev_handle_name, uint8_t start_register, uint8_t *read_buffer, size_t length){
+    // Write the register pointer and read the data back with a repeated start.
+    return i2c_transfer(dev_handle_name, &start_register, sizeof(start_register), read_buffer, length);
+}
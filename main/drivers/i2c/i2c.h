@@ -20,6 +20,16 @@
  * @date 2025-05-12
  */
 
+/**
+ * @brief Error counters for the I2C transfer layer.
+ */
+typedef struct
+{
+    uint32_t retries;    /**< Transfers attempted again after a failure. */
+    uint32_t recoveries; /**< Bus recoveries performed. */
+    uint32_t failures;   /**< Transfers that failed on every attempt. */
+} I2CStatistics;
+
 
 /**
  * @brief Function for initialising I2C with a bus handle.
@@ -45,34 +55,80 @@ void i2c_add_device(i2c_master_bus_handle_t bus_handle_name,
                     uint16_t device_address,
                     uint32_t scl_clock_speed);
 
+/**
+ * @brief Function for removing an I2C device from the bus.
+ * 
+ * @param dev_handle_name Handle to the I2C device.
+ */
+void i2c_remove_device(i2c_master_dev_handle_t dev_handle_name);
+
+/**
+ * @brief Function for checking that a register reads back an expected value.
+ * 
+ * @param dev_handle_name Handle to the I2C device.
+ * @param register_address Address of the register to read.
+ * @param expected_value The value the register is expected to hold.
+ * @param reads Number of consecutive reads that must all succeed.
+ * @return esp_err_t ESP_OK if every read matched, or an error code.
+ */
+esp_err_t i2c_validate_register(i2c_master_dev_handle_t dev_handle_name,
+                                uint8_t register_address,
+                                uint16_t expected_value,
+                                int reads);
+
 /**
  * @brief Function for writing data to an I2C device.
  * 
  * @param dev_handle_name Handle to the I2C device.
  * @param register_address Address of the register to write to.
  * @param data_to_write Data to write to the register.
+ * @return esp_err_t ESP_OK on success, or an error code if every attempt failed.
  */
-void i2c_write(i2c_master_dev_handle_t dev_handle_name,
-               uint8_t register_address,
-               uint16_t data_to_write);
+esp_err_t i2c_write(i2c_master_dev_handle_t dev_handle_name,
+                    uint8_t register_address,
+                    uint16_t data_to_write);
 
 /**
  * @brief Function for setting the register pointer of an I2C device.
  * 
  * @param dev_handle_name Handle of the I2C device.
  * @param register_address Address of the register pointer
+ * @return esp_err_t ESP_OK on success, or an error code if every attempt failed.
  */
-void i2c_set_register_pointer(i2c_master_dev_handle_t dev_handle_name,
-                              uint8_t register_address);
+esp_err_t i2c_set_register_pointer(i2c_master_dev_handle_t dev_handle_name,
+                                   uint8_t register_address);
 
 /**
  * @brief Function for reading data from an I2C device from a specific register.
  * 
  * @param dev_handle_name Handle to the I2C device.
  * @param register_address Address of the register to read from
- * @return float Returns the data read from the register
+ * @param data Where the signed register value is stored.
+ * @return esp_err_t ESP_OK on success, or an error code if every attempt failed.
+ */
+esp_err_t i2c_read(i2c_master_dev_handle_t dev_handle_name,
+                   uint8_t register_address,
+                   int16_t *data);
+
+/**
+ * @brief Function for reading a block of consecutive registers from an I2C device.
+ * 
+ * @param dev_handle_name Handle to the I2C device.
+ * @param start_register Address of the first register to read from.
+ * @param read_buffer Buffer the raw bytes are written to.
+ * @param length Number of bytes to read.
+ * @return esp_err_t ESP_OK on success, or an error code if every attempt failed.
+ */
+esp_err_t i2c_read_block(i2c_master_dev_handle_t dev_handle_name,
+                         uint8_t start_register,
+                         uint8_t *read_buffer,
+                         size_t length);
+
+/**
+ * @brief Function for reading the transfer layer error counters.
+ * 
+ * @param statistics Struct the counters are copied to.
  */
-float i2c_read(i2c_master_dev_handle_t dev_handle_name,
-               uint8_t register_address);
+void i2c_get_statistics(I2CStatistics *statistics);
 
 #endif
\ No newline at end of file
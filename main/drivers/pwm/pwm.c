@@ -90,4 +90,18 @@ void pwm_update_duty(float duty_cycle_percentage, ledc_channel_t PWM_CHANNEL)
     ESP_ERROR_CHECK(ledc_set_duty(PWM_SPEED_MODE, PWM_CHANNEL, pwm_setpoint));
     ESP_ERROR_CHECK(ledc_update_duty(PWM_SPEED_MODE, PWM_CHANNEL));
     //ESP_LOGI(TAG, "PWM duty cycle set to %lu (%.2f%%)", pwm_setpoint, duty_cycle_percentage);
-}
\ No newline at end of file
+}
+
+/**
+ * @brief Reads back the PWM duty cycle.
+ *
+ * Returns the duty cycle the channel is running at, also when it was set by
+ * something other than pwm_update_duty, such as the fast control interrupt.
+ *
+ * @param PWM_CHANNEL The PWM channel to read.
+ * @return The duty cycle as a percentage (0.0 to 100.0).
+ */
+float pwm_get_duty(ledc_channel_t PWM_CHANNEL)
+{
+    return (float)ledc_get_duty(PWM_SPEED_MODE, PWM_CHANNEL) * (100.0f / ((1 << PWM_TIMER_RESOLUTION) - 1));
+}
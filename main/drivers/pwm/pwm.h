@@ -33,5 +33,16 @@ void pwm_init();
  */
 void pwm_update_duty(float duty_cycle_percentage, ledc_channel_t PWM_CHANNEL);
 
+/**
+ * @brief Reads back the PWM duty cycle.
+ *
+ * Returns the duty cycle the channel is running at, also when it was set by
+ * something other than pwm_update_duty, such as the fast control interrupt.
+ *
+ * @param PWM_CHANNEL The PWM channel to read.
+ * @return The duty cycle as a percentage (0.0 to 100.0).
+ */
+float pwm_get_duty(ledc_channel_t PWM_CHANNEL);
+
 #endif
 
@@ -3,6 +3,7 @@
 
 #include "freertos/FreeRTOS.h"
 #include "freertos/queue.h"
+#include "freertos/task.h"
 #include "freertos/event_groups.h"
 
 /**
@@ -20,17 +21,23 @@
 /// @name Queues
 /// Queues used for inter-task communication.
 //@{
-extern QueueHandle_t mode_queue;        /**< Queue for control mode updates. Declared in main.c */
-extern QueueHandle_t setpoint_queue;    /**< Queue for setpoint values. Declared in main.c */
-extern QueueHandle_t safety_queue;      /**< Queue for safety-related data. Declared in main.c */
-extern QueueHandle_t measurement_queue; /**< Queue for processed measurement data. Declared in main.c */
+extern QueueHandle_t measurement_statistics_queue; /**< Queue for measurement task statistics. Declared in main.c */
+extern QueueHandle_t control_statistics_queue;     /**< Queue for control task statistics. Declared in main.c */
+extern QueueHandle_t load_command_queue;           /**< Queue for start, stop and reset commands to the safety task. Declared in main.c */
+//@}
+
+/// @name Task Handles
+/// Handles of tasks that are notified by other tasks.
+//@{
+extern TaskHandle_t control_task_handle; /**< Control task, notified on every new measurement sample. Declared in main.c */
+extern TaskHandle_t safety_task_handle;  /**< Safety task, notified on every new measurement sample. Declared in main.c */
 //@}
 
 /// @name Event Groups
 /// Event groups used for task synchronization and signaling.
 //@{
 extern EventGroupHandle_t signal_event_group; /**< Event group for signaling between tasks. */
-extern EventGroupHandle_t safety_event_group; /**< Event group for safety-related events. */
+extern EventGroupHandle_t safety_event_group; /**< Event group for safety-related events, written by the safety task and the hardware protection interrupt. */
 //@}
 
 /**
@@ -52,26 +59,100 @@ typedef struct
     float soft_max_temperature; /**< Soft maximum allowable temperature set by the user (°C) */
 } SafetyData;                   // The difference between soft and non soft limits is that the soft limits will trigger the system regulate the PWM to stay within the limits, the others will open relays to completelt shut off the load.
 
+/**
+ * @brief Enumeration for the quality of a measurement sample.
+ */
+typedef enum
+{
+    MEASUREMENT_OK,        /**< Fresh conversion read successfully. */
+    MEASUREMENT_DUPLICATE, /**< Read successfully, but no new conversion was signalled. */
+    MEASUREMENT_I2C_ERROR  /**< The INA237 could not be read, electrical values are from the previous sample. */
+} MeasurementQuality;
+
 /**
  * @brief Data structure for processed measurement data.
  *
  * This structure holds the processed measurement data, including voltage,
  * current, power, and temperature. These values are updated by the measurement
- * task and shared with other tasks via the `measurement_queue`.
+ * task and shared with other tasks via the `measurement_ring`.
  */
 typedef struct
 {
     float bus_voltage;            /**< Measured bus voltage (V). */
+    float shunt_voltage;          /**< Measured shunt voltage (V). */
     float current;                /**< Measured current (A). */
-    float power;                  /**< Calculated power (W). */
+    float power;                  /**< Measured power (W). */
     float Ah;                     /**< Calculated Ampere-hours (Ah). */
     float Wh;                     /**< Calculated Watt-hours (Wh). */
+    int64_t charge_lsb_seconds;   /**< Exact integrated charge in whole current LSB-seconds (INA237_CURRENT_LSB A·s each). */
+    int64_t energy_lsb_seconds;   /**< Exact integrated energy in whole power LSB-seconds (INA237_POWER_LSB J each). */
+    int64_t timestamp_us;         /**< Time the conversion completed, from esp_timer (us). */
+    uint32_t sequence;            /**< Sequence number in the sample ring, consecutive samples differ by one. */
+    uint32_t list_step;           /**< Steps started in the current list mode run when the sample was taken, 0 outside a run. */
     float temperature_internal;   /**< Measured internal temperature (°C). */
+    float temperature_die;        /**< Measured INA237 die temperature (°C). */
     float temperature_external_1; /**< Measured external temperature probe 1 (°C)*/
     float temperature_external_2; /**< Measured external temperature probe 2 (°C)*/
     float temperature_external_3; /**< Measured external temperature probe 3 (°C)*/
+    MeasurementQuality quality;   /**< Quality of the INA237 values in this sample. */
 } MeasurementData;
 
+/**
+ * @brief Sensors scheduled by the measurement task.
+ */
+typedef enum
+{
+    SENSOR_INA237,       /**< INA237 voltage, current and power. */
+    SENSOR_NTC_INTERNAL, /**< Internal NTC, including the continuous ADC frame drain. */
+    SENSOR_NTC_EXTERNAL, /**< External NTC probes. */
+    SENSOR_COUNT         /**< Number of scheduled sensors. */
+} MeasurementSensor;
+
+/**
+ * @brief Achieved rate and CPU time of one scheduled sensor.
+ */
+typedef struct
+{
+    float rate_hz; /**< Runs per second over the last statistics period. */
+    float cpu_us;  /**< Average CPU time per run over the last statistics period (us). */
+} SensorStatistics;
+
+/**
+ * @brief Runtime statistics for the measurement task.
+ *
+ * These counters are published to the `measurement_statistics_queue` once per
+ * statistics period. They show how well the measurement task keeps up with the
+ * conversion ready alerts from the INA237.
+ */
+typedef struct
+{
+    uint32_t conversions;        /**< Conversion ready alerts received since start-up. */
+    uint32_t samples;            /**< Samples read and published since start-up. */
+    uint32_t missed_conversions; /**< Conversions that completed without being read. */
+    uint32_t duplicate_samples;  /**< Samples read without a new conversion (alert timed out). */
+    float samples_per_second;    /**< Achieved sample rate over the last statistics period. */
+    uint32_t scl_speed_hz;       /**< I2C SCL speed the INA237 was validated at (Hz). */
+    uint32_t i2c_retries;        /**< I2C transfers attempted again after a failure. */
+    uint32_t i2c_recoveries;     /**< I2C bus recoveries performed. */
+    uint32_t i2c_failures;       /**< I2C transfers that failed on every attempt. */
+    SensorStatistics sensors[SENSOR_COUNT]; /**< Rate and CPU time of each scheduled sensor. */
+} MeasurementStatistics;
+
+/**
+ * @brief Runtime statistics for the control task.
+ *
+ * Published to the `control_statistics_queue` once per statistics period.
+ */
+typedef struct
+{
+    float loops_per_second;   /**< Control iterations per second over the last statistics period. */
+    float period_avg_us;      /**< Average time between control iterations (us). */
+    float period_max_us;      /**< Longest time between control iterations (us). */
+    float latency_avg_us;     /**< Average time from the end of a conversion to the PWM update (us). */
+    float latency_max_us;     /**< Longest time from the end of a conversion to the PWM update (us). */
+    uint32_t samples_skipped; /**< Samples published without a control iteration seeing them, since start-up. */
+} ControlStatistics;
+
 /**
  * @brief Enumeration for control modes.
  *
@@ -82,7 +163,41 @@ typedef enum
 {
     MODE_CC, /**< Constant Current mode. */
     MODE_CV, /**< Constant Voltage mode. */
-    MODE_CP  /**< Constant Power mode. */
+    MODE_CP, /**< Constant Power mode. */
+    MODE_CR, /**< Constant Resistance mode. */
+    MODE_DYNAMIC, /**< Dynamic mode, the current toggles between two levels. */
+    MODE_WAVEFORM, /**< Waveform mode, an uploaded current or power table is played back. */
+    MODE_LIST, /**< List mode, an uploaded list of mode, setpoint and dwell time steps is run. */
+    MODE_DISCHARGE, /**< Battery discharge test, CC, CP or CR down to a cutoff voltage. */
+    MODE_SWEEP, /**< I-V sweep from open circuit to short circuit. */
+    MODE_COUNT /**< Number of control modes. */
 } ControlMode;
 
+/**
+ * @brief Enumeration for the sub-modes of dynamic mode.
+ */
+typedef enum
+{
+    DYNAMIC_CONTINUOUS, /**< Toggle between level 1 and level 2 every period. */
+    DYNAMIC_PULSED,     /**< Stay at level 1, every trigger gives one pulse at level 2. */
+    DYNAMIC_TRIGGERED,  /**< Every trigger toggles between level 1 and level 2. */
+    DYNAMIC_SUBMODE_COUNT /**< Number of dynamic sub-modes. */
+} DynamicSubmode;
+
+/**
+ * @brief Structure to hold the dynamic mode waveform.
+ *
+ * Integer units, so the waveform can be generated from the fast control
+ * interrupt.
+ */
+typedef struct
+{
+    DynamicSubmode submode;  /**< Sub-mode. */
+    int32_t level_1_ma;      /**< Base current level (mA). */
+    int32_t level_2_ma;      /**< Pulse current level (mA). */
+    uint32_t period_us;      /**< Period of the square wave in continuous sub-mode (us). */
+    uint32_t level_2_us;     /**< Time at level 2 per period or per pulse (us). */
+    uint32_t slew_ma_per_ms; /**< Largest change of the current reference (mA/ms), 0 steps at once. */
+} DynamicConfig;
+
 #endif // GLOBALS_H
\ No newline at end of file
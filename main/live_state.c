@@ -0,0 +1,138 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "live_state.h"
+
+/**
+ * @file live_state.c
+ * @brief Implementation of the live state of the load.
+ *
+ * The settings are protected by a seqlock. A writer makes the version odd,
+ * changes the settings and makes the version even again. A reader copies the
+ * settings and retries if the version was odd or changed during the copy. The
+ * writers run inside a critical section, so they are short, never preempted on
+ * their own core and never interleave with each other.
+ *
+ * This replaces the setpoint, mode and safety queues. A reader gets the whole
+ * snapshot in a few hundred nanoseconds with no kernel call, where each queue
+ * peek took a critical section.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+static LiveState live_state = {
+    .version = 0,
+    .settings = {.mode = MODE_CC},
+    .writer_lock = portMUX_INITIALIZER_UNLOCKED,
+}; /**< The live settings of the load. */
+
+/**
+ * @brief Start a write, the version becomes odd.
+ */
+static inline void live_state_write_begin(void)
+{
+    taskENTER_CRITICAL(&live_state.writer_lock);
+    atomic_fetch_add_explicit(&live_state.version, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+}
+
+/**
+ * @brief End a write, the version becomes even.
+ */
+static inline void live_state_write_end(void)
+{
+    atomic_fetch_add_explicit(&live_state.version, 1, memory_order_release);
+    taskEXIT_CRITICAL(&live_state.writer_lock);
+}
+
+/**
+ * @brief Read a consistent snapshot of the live settings.
+ *
+ * @param settings Output, the snapshot.
+ * @return The version of the snapshot, it changes on every write.
+ */
+uint32_t live_state_get(LiveSettings *settings)
+{
+    uint32_t version_before;
+    uint32_t version_after;
+    do
+    {
+        version_before = atomic_load_explicit(&live_state.version, memory_order_acquire);
+        memcpy(settings, &live_state.settings, sizeof(LiveSettings));
+        atomic_thread_fence(memory_order_acquire);
+        version_after = atomic_load_explicit(&live_state.version, memory_order_relaxed);
+    } while ((version_before & 1) || (version_before != version_after));
+    return version_before;
+}
+
+/**
+ * @brief Get the current version of the live settings without reading them.
+ *
+ * @return The version, it changes on every write.
+ */
+uint32_t live_state_version(void)
+{
+    return atomic_load_explicit(&live_state.version, memory_order_acquire);
+}
+
+/**
+ * @brief Publish a new setpoint.
+ *
+ * @param setpoint The new setpoint.
+ */
+void live_state_set_setpoint(float setpoint)
+{
+    live_state_write_begin();
+    live_state.settings.setpoint = setpoint;
+    live_state.settings.setpoint_updates++;
+    live_state_write_end();
+}
+
+/**
+ * @brief Publish a new control mode.
+ *
+ * @param mode The new control mode.
+ */
+void live_state_set_mode(ControlMode mode)
+{
+    live_state_write_begin();
+    live_state.settings.mode = mode;
+    live_state_write_end();
+}
+
+/**
+ * @brief Publish new safety limits.
+ *
+ * @param limits The new safety limits.
+ */
+void live_state_set_limits(const SafetyData *limits)
+{
+    live_state_write_begin();
+    live_state.settings.limits = *limits;
+    live_state.settings.limits_set = true;
+    live_state_write_end();
+}
+
+/**
+ * @brief Publish a new dynamic mode waveform.
+ *
+ * @param dynamic The new waveform.
+ */
+void live_state_set_dynamic(const DynamicConfig *dynamic)
+{
+    live_state_write_begin();
+    live_state.settings.dynamic = *dynamic;
+    live_state.settings.dynamic_updates++;
+    live_state_write_end();
+}
+
+/**
+ * @brief Trigger dynamic mode, for the pulsed and triggered sub-modes.
+ */
+void live_state_trigger_dynamic(void)
+{
+    live_state_write_begin();
+    live_state.settings.dynamic_triggers++;
+    live_state_write_end();
+}
@@ -0,0 +1,94 @@
+#ifndef LIVE_STATE_H
+#define LIVE_STATE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "globals.h"
+
+/**
+ * @file live_state.h
+ * @brief Header file for the live state of the load.
+ *
+ * This file contains the declarations for the settings shared between the user
+ * interfaces and the control and safety tasks. The settings are published with
+ * a seqlock, so readers get a consistent snapshot without blocking.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Settings written by the user interfaces.
+ */
+typedef struct
+{
+    float setpoint;            /**< Setpoint in the unit of the current mode (A, V or W). */
+    uint32_t setpoint_updates; /**< Incremented on every setpoint write, so readers can tell a new setpoint from a repeated one. */
+    ControlMode mode;          /**< Current control mode. */
+    SafetyData limits;         /**< User-defined safety limits. */
+    bool limits_set;           /**< true once the safety limits have been written. */
+    DynamicConfig dynamic;     /**< Waveform of dynamic mode. */
+    uint32_t dynamic_updates;  /**< Incremented on every dynamic mode waveform write. */
+    uint32_t dynamic_triggers; /**< Incremented on every dynamic mode trigger. */
+} LiveSettings;
+
+/**
+ * @brief Seqlock protected live settings.
+ */
+typedef struct
+{
+    atomic_uint_least32_t version; /**< Odd while a write is in progress, incremented twice per write. */
+    LiveSettings settings;         /**< The published settings. */
+    portMUX_TYPE writer_lock;      /**< Serialises writers, readers never take it. */
+} LiveState;
+
+/**
+ * @brief Read a consistent snapshot of the live settings.
+ *
+ * @param settings Output, the snapshot.
+ * @return The version of the snapshot, it changes on every write.
+ */
+uint32_t live_state_get(LiveSettings *settings);
+
+/**
+ * @brief Get the current version of the live settings without reading them.
+ *
+ * @return The version, it changes on every write.
+ */
+uint32_t live_state_version(void);
+
+/**
+ * @brief Publish a new setpoint.
+ *
+ * @param setpoint The new setpoint.
+ */
+void live_state_set_setpoint(float setpoint);
+
+/**
+ * @brief Publish a new control mode.
+ *
+ * @param mode The new control mode.
+ */
+void live_state_set_mode(ControlMode mode);
+
+/**
+ * @brief Publish new safety limits.
+ *
+ * @param limits The new safety limits.
+ */
+void live_state_set_limits(const SafetyData *limits);
+
+/**
+ * @brief Publish a new dynamic mode waveform.
+ *
+ * @param dynamic The new waveform.
+ */
+void live_state_set_dynamic(const DynamicConfig *dynamic);
+
+/**
+ * @brief Trigger dynamic mode, for the pulsed and triggered sub-modes.
+ */
+void live_state_trigger_dynamic(void);
+
+#endif // LIVE_STATE_H
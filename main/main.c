@@ -16,10 +16,15 @@
 #include "driver/ledc.h"
 #include "safety_task.h"
 #include "globals.h"
+#include "sample_ring.h"
 #include "config.h"
 #include "safety_task.h"
 #include "wifi.h"
 #include "http_server.h"
+#include "nvs_flash.h"
+#include "discharge_test.h"
+#include "blackbox.h"
+#include "load_state.h"
 
 /**
  * @file main.c
@@ -35,10 +40,16 @@
  */
 
 // Declare queues
-QueueHandle_t mode_queue;        /**< Queue for control mode updates. */
-QueueHandle_t setpoint_queue;    /**< Queue for setpoint values. */
-QueueHandle_t measurement_queue; /**< Queue for processed measurement data. */
-QueueHandle_t safety_queue;      /**< Queue for safety-related data. */
+QueueHandle_t measurement_statistics_queue; /**< Queue for measurement task statistics. */
+QueueHandle_t control_statistics_queue;     /**< Queue for control task statistics. */
+QueueHandle_t load_command_queue;           /**< Queue for start, stop and reset commands to the safety task. */
+
+// Declare sample rings
+SampleRing measurement_ring; /**< Ring of processed measurement samples. */
+
+// Declare task handles
+TaskHandle_t control_task_handle = NULL; /**< Handle of the control task. */
+TaskHandle_t safety_task_handle = NULL;  /**< Handle of the safety task. */
 
 // Declare event groups
 EventGroupHandle_t signal_event_group; /**< Event group for signaling between tasks. */
@@ -60,51 +71,52 @@ void app_main()
     safety_event_group = xEventGroupCreate();
 
     // Create queues
-    safety_queue = xQueueCreate(1, sizeof(SafetyData));
-    if (safety_queue == NULL)
+    measurement_statistics_queue = xQueueCreate(1, sizeof(MeasurementStatistics));
+    if (measurement_statistics_queue == NULL)
     {
-        ESP_LOGE(TAG, "Safety queue failed to create.");
+        ESP_LOGE(TAG, "Measurement statistics queue failed to create.");
     }
     else
     {
-        ESP_LOGI(TAG, "Safety queue created.");
+        ESP_LOGI(TAG, "Measurement statistics queue created.");
     }
 
-    setpoint_queue = xQueueCreate(1, sizeof(float));
-    if (setpoint_queue == NULL)
+    control_statistics_queue = xQueueCreate(1, sizeof(ControlStatistics));
+    if (control_statistics_queue == NULL)
     {
-        ESP_LOGE(TAG, "Setpoint queue failed to create.");
+        ESP_LOGE(TAG, "Control statistics queue failed to create.");
     }
     else
     {
-        ESP_LOGI(TAG, "Setpoint queue created.");
+        ESP_LOGI(TAG, "Control statistics queue created.");
     }
 
-    mode_queue = xQueueCreate(1, sizeof(ControlMode));
-    if (mode_queue == NULL)
+    load_command_queue = xQueueCreate(LOAD_COMMAND_QUEUE_LENGTH, sizeof(LoadCommand));
+    if (load_command_queue == NULL)
     {
-        ESP_LOGE(TAG, "Mode queue failed to create.");
+        ESP_LOGE(TAG, "Load command queue failed to create.");
     }
     else
     {
-        ESP_LOGI(TAG, "Mode queue created.");
+        ESP_LOGI(TAG, "Load command queue created.");
     }
 
-    measurement_queue = xQueueCreate(1, sizeof(MeasurementData));
-    if (measurement_queue == NULL)
-    {
-        ESP_LOGE(TAG, "Measurement queue failed to create.");
-    }
-    else
+    // Initialise NVS before the tasks start, a discharge test interrupted by a reset is resumed from it
+    esp_err_t ret = nvs_flash_init();
+    if (ret == ESP_ERR_NVS_NO_FREE_PAGES || ret == ESP_ERR_NVS_NEW_VERSION_FOUND)
     {
-        ESP_LOGI(TAG, "Measurement queue created.");
+        ESP_ERROR_CHECK(nvs_flash_erase());
+        ret = nvs_flash_init();
     }
+    ESP_ERROR_CHECK(ret);
+    discharge_test_restore();
+    blackbox_init();
 
     // Set tasks to cores
-    xTaskCreatePinnedToCore(safety_task, "Safety Task", 4096, NULL, 3, NULL, 1);
+    xTaskCreatePinnedToCore(safety_task, "Safety Task", 4096, NULL, 3, &safety_task_handle, 1);
     xTaskCreatePinnedToCore(measurement_task, "Measurement Task", 4096, NULL, 2, NULL, 1);
     xTaskCreatePinnedToCore(hmi_task, "HMI Task", 4096, NULL, 1, NULL, 1);
-    xTaskCreatePinnedToCore(control_task, "Control Task", 4096, NULL, 2, NULL, 1);
+    xTaskCreatePinnedToCore(control_task, "Control Task", 4096, NULL, 2, &control_task_handle, 1);
 
     // Start WiFi and HTTP server
     wifi_start();      // This module starts its own FreeRTOS task through esp_wifi_start() with priority 23 and an event loop task with priority 20.
@@ -1,3 +1,4 @@
+#include <math.h>
 #include "control_task.h"
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
@@ -9,6 +10,20 @@
 #include "pwm.h"
 #include "safety_task.h"
 #include "globals.h"
+#include "sample_ring.h"
+#include "live_state.h"
+#include "fast_control.h"
+#include "regulator.h"
+#include "dynamic_load.h"
+#include "waveform.h"
+#include "list_mode.h"
+#include "discharge_test.h"
+#include "iv_sweep.h"
+#include "hw_protection.h"
+#include "blackbox.h"
+#include "supervisor.h"
+#include "load_state.h"
+#include "esp_timer.h"
 #include "config.h"
 
 /**
@@ -17,14 +32,42 @@
  *
  * This file contains the implementation of the control task, which is responsible
  * for managing the operation of the programmable electrical load. The task adjusts
- * the PWM duty cycle based on the selected mode (CC, CV, CP), setpoint, and measurement
+ * the PWM duty cycle based on the selected mode (CC, CV, CP, CR, dynamic, waveform, list), setpoint, and measurement
  * data. It also handles safety triggers and start/stop signals.
  *
+ * The setpoint, mode and soft limits are read as one snapshot from the live
+ * state and the measurement from the sample ring, neither of which blocks.
+ * The loop is woken by the measurement task for every new sample, so the
+ * regulator runs once per conversion with dt taken from the sample timestamps.
+ *
+ * The load runs while the state published by the safety task is LOAD_RUNNING.
+ * This task only posts a stop when a list, discharge test or sweep ends, and
+ * sleeps while the load is off until the safety task wakes it on a change.
+ *
  * @date 2025-05-12
  */
 
 static const char *TAG = "CONTROL_TASK"; /**< Tag for logging messages from the control task. */
 
+/**
+ * @brief Calculate the current reference of constant resistance mode.
+ *
+ * @param resistance The resistance setpoint (Ω).
+ * @param voltage The measured bus voltage (V).
+ * @return The current the load should draw, 0 to MAX_CURRENT (A).
+ */
+static float constant_resistance_reference(float resistance, float voltage)
+{
+    // A resistance at or near zero would ask for unlimited current, draw nothing instead
+    if (resistance < MIN_RESISTANCE || voltage <= 0.0f)
+    {
+        return 0.0f;
+    }
+
+    float current = voltage / resistance;
+    return (current > MAX_CURRENT) ? MAX_CURRENT : current;
+}
+
 /**
  * @brief Control task for managing load operation modes.
  *
@@ -36,243 +79,448 @@ static const char *TAG = "CONTROL_TASK"; /**< Tag for logging messages from the
  */
 void control_task(void *paramter)
 {
-    ControlMode mode = MODE_CC;   /**< Current control mode (default is Constant Current). */
-    MeasurementData measurements; /**< Struct to hold the latest measurement data. */
+    ControlMode mode = MODE_CC;         /**< Current control mode (default is Constant Current). */
+    MeasurementData measurements = {0}; /**< Struct to hold the latest measurement data. */
+    LiveSettings settings;              /**< Snapshot of the setpoint, mode and limits. */
+    uint32_t setpoint_updates = 0;      /**< Setpoint update count of the last setpoint taken over. */
+    LoadStatus load;                    /**< Snapshot of the load state. */
+    uint32_t load_resets = 0;           /**< Reset count of the last reset handled. */
 
     SafetyData safety_data = {/**< Struct to hold the soft safety limits */
                               .soft_max_current = 0,
                               .soft_max_voltage = 0,
                               .soft_max_temperature = 0};
 
+    ControlStatistics statistics = {0};       /**< Loop statistics published to the statistics queue. */
+    int64_t loop_time = esp_timer_get_time(); /**< Start of the current iteration (us). */
+    int64_t statistics_time = loop_time;      /**< Time of the last statistics update (us). */
+    int64_t period_sum_us = 0;                /**< Sum of the iteration periods since the last update (us). */
+    int64_t period_max_us = 0;                /**< Longest iteration period since the last update (us). */
+    uint32_t loops = 0;                       /**< Iterations since the last statistics update. */
+
     float duty_cycle = 0.0; /**< Current PWM duty cycle (0% to 100%). */
     float setpoint = 0.0;   /**< Current setpoint value. */
-
-    // PI regulator paramters for CC mode
-    const float Kp_CC = 8.0;  /**< Proportional gain CC */
-    const float Ki_CC = 50.0; /**< Integral gain CC */
-
-    // PI regulator paramters for CC mode
-    const float Kp_CV = 1.0; /**< Proportional gain CC */
-    const float Ki_CV = 0.1; /**< Integral gain CC */
-
-    // PI regulator paramters for CC mode
-    const float Kp_CP = 1.0; /**< Proportional gain CC */
-    const float Ki_CP = 0.1; /**< Integral gain CC */
-
-    float error = 0.0;          /**< Current error (setpoint - measured current). */
-    float integral_error = 0.0; /**< Accumulated integral error. */
-
-    TickType_t previous_tick = xTaskGetTickCount(); /**< Previous tick value for time calculations. */
-    TickType_t current_tick;                        /**< Current tick value for time calculations. */
-    float dt = 0;                                   /**< Time step in seconds. */
+    float soa_scale = 1.0f; /**< Fraction of the reference the load runs at, below 1 while the SOA derates. */
+
+    Regulator regulator = {0}; /**< PI regulator, switched to the descriptor of the current mode. */
+
+    DynamicLoad dynamic_load = {0};  /**< Waveform generator of dynamic mode. */
+    bool dynamic_running = false;    /**< true while dynamic mode runs, false restarts the waveform. */
+    uint32_t dynamic_updates = 0;    /**< Waveform update count of the waveform running. */
+    uint32_t dynamic_triggers = 0;   /**< Trigger count of the last trigger handled. */
+    bool waveform_running = false;   /**< true while waveform mode runs, false restarts the playback. */
+    bool list_running = false;       /**< true while list mode runs, false restarts the list. */
+    bool discharge_running = false;  /**< true while a discharge test runs, false pauses it. */
+    bool sweep_running = false;      /**< true while an I-V sweep runs, false restarts it. */
+
+    uint32_t previous_sequence = 0;     /**< Sequence number of the previous sample, 0 if none. */
+    int64_t previous_timestamp_us = 0;  /**< Timestamp of the previous sample regulated on (us), 0 after a stop. */
+    int64_t good_sample_us = 0;         /**< Timestamp of the newest sample the INA237 was read for (us). */
+    bool stale_safe_state = false;      /**< true while the duty cycle is off because the samples are stale. */
+    bool new_sample = false;            /**< true if a sample arrived since the previous iteration. */
+    int32_t dt_us = 0;                  /**< Time step in microseconds, between the conversions of two samples. */
+    int64_t latency_sum_us = 0;         /**< Sum of the sample to PWM latencies since the last update (us). */
+    int64_t latency_max_us = 0;         /**< Longest sample to PWM latency since the last update (us). */
+    uint32_t updates = 0;               /**< Regulator updates since the last statistics update. */
+    int64_t log_time = 0;               /**< Time of the last periodic log message (us). */
+    bool log_due = false;               /**< true on iterations that may log, limits logging to once per CONTROL_LOG_PERIOD_MS. */
 
     pwm_init(); /**< Initialize the PWM module. */
+    supervisor_register(SUPERVISED_CONTROL, CONTROL_STOPPED_DEADLINE_US);
+#if FAST_CONTROL_ENABLED
+    fast_control_init(); /**< Create the fast constant current timer on this core. */
+#endif
 
     while (1)
     {
-        // Get the current tick count to calculate dt
-        current_tick = xTaskGetTickCount();
-        dt = (float)(current_tick - previous_tick) / (float)configTICK_RATE_HZ;
-        previous_tick = current_tick;
-
-        // Check if the setpoint has been updated
-        if ((xEventGroupGetBits(signal_event_group) & CONTROL_SETPOINT_BIT) == CONTROL_SETPOINT_BIT)
+        // Wait for the measurement task to publish a new sample. The timeout keeps start/stop
+        // and the safety handling alive if the samples stop.
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(CONTROL_SAMPLE_TIMEOUT_MS));
+
+        // Measure the loop period
+        int64_t now = esp_timer_get_time();
+        int64_t period_us = now - loop_time;
+        loop_time = now;
+        period_sum_us += period_us;
+        period_max_us = (period_us > period_max_us) ? period_us : period_max_us;
+        loops++;
+
+        // Limit the periodic log messages, the loop runs once per conversion
+        log_due = (now - log_time) >= (int64_t)CONTROL_LOG_PERIOD_MS * 1000;
+        if (log_due)
         {
-            ESP_LOGI(TAG, "Received setpoint data");
-            xEventGroupClearBits(signal_event_group, CONTROL_SETPOINT_BIT);
-            xQueuePeek(setpoint_queue, &setpoint, pdMS_TO_TICKS(1));
-            vTaskDelay(pdMS_TO_TICKS(1));
+            log_time = now;
         }
 
-        // Retrieve the latest measurement data
-        if (xQueuePeek(measurement_queue, &measurements, pdTICKS_TO_MS(1)) == pdTRUE)
+        // Retrieve the setpoint, mode and soft safety limits in one snapshot
+        live_state_get(&settings);
+        mode = settings.mode;
+        if (settings.limits_set)
         {
-            vTaskDelay(pdMS_TO_TICKS(1));
+            safety_data = settings.limits;
         }
 
-        // Retrieve the current mode
-        if (xQueuePeek(mode_queue, &mode, pdTICKS_TO_MS(1)) == pdTRUE)
+        // Take over the setpoint only when it has been written, the soft limits lower the local copy
+        if (settings.setpoint_updates != setpoint_updates)
         {
-            vTaskDelay(pdMS_TO_TICKS(1));
+            ESP_LOGI(TAG, "Received setpoint data");
+            setpoint_updates = settings.setpoint_updates;
+            setpoint = settings.setpoint;
         }
 
-        // Retrieve the soft safety limits
-        if (xQueuePeek(safety_queue, &safety_data, pdTICKS_TO_MS(1)) == pdTRUE)
+        // Retrieve the latest measurement data and take dt from the conversion timestamps
+        new_sample = sample_ring_latest(&measurement_ring, &measurements) && (measurements.sequence != previous_sequence);
+        if (new_sample)
         {
-            vTaskDelay(pdMS_TO_TICKS(1));
+            if (previous_sequence != 0)
+            {
+                statistics.samples_skipped += measurements.sequence - previous_sequence - 1;
+            }
+            dt_us = (previous_timestamp_us == 0) ? 0 : (int32_t)(measurements.timestamp_us - previous_timestamp_us);
+            previous_sequence = measurements.sequence;
+            previous_timestamp_us = measurements.timestamp_us;
         }
 
-        // Check if the load should be started and no safety triggers are active
-        if ((((xEventGroupGetBits(signal_event_group) & START_STOP_BIT) == START_STOP_BIT) & (xEventGroupGetBits(safety_event_group) == 0)) | (((xEventGroupGetBits(signal_event_group))&RESET_BIT) == RESET_BIT))
-        {
-
-            switch (mode)
-            {
-            case MODE_CC: // Constant Current Mode
-                          // Control logic here
+        // The safety task owns the load state. A hardware trip is also seen through its flag, the fault bit
+        // is set from the interrupt through the timer task and only then reaches the state.
+        load_state_get(&load);
+        bool running = (load.state == LOAD_RUNNING) && !hw_protection_tripped();
 
-                // Calculate the error
-                error = setpoint - measurements.current;
+        // Check in with the supervisor, the loop sleeps between iterations while the load is off
+        supervisor_heartbeat(SUPERVISED_CONTROL, running ? CONTROL_DEADLINE_US : CONTROL_STOPPED_DEADLINE_US);
 
-                // Update the integral term
-                integral_error += error * dt;
+        // A sample with an I2C error repeats old values, so the age is that of the newest good sample
+        if (new_sample && (measurements.quality != MEASUREMENT_I2C_ERROR))
+        {
+            good_sample_us = measurements.timestamp_us;
+        }
+        bool stale = (now - good_sample_us) > CONTROL_SAMPLE_MAX_AGE_US;
+        if (!stale)
+        {
+            stale_safe_state = false;
+        }
 
-                // Anti-windup: Clamp the integral term to prevent excessive accumulation
-                if (integral_error > 100.0) // Adjust this limit as needed
+        if (running && stale)
+        {
+            // The samples are too old to regulate on. Switch the duty cycle off, regulation starts again from
+            // zero once fresh samples arrive. The safety task opens the relays if this lasts.
+            if (!stale_safe_state)
+            {
+                ESP_LOGW(TAG, "Newest sample is %lld us old, duty cycle off", now - good_sample_us);
+                supervisor_note_stale(SUPERVISED_CONTROL);
+                stale_safe_state = true;
+            }
+            fast_control_stop();
+            duty_cycle = 0;
+            regulator_reset(&regulator);
+            pwm_update_duty(duty_cycle, PWM_CHANNEL_LOAD);
+        }
+        else if (running && (!new_sample || (measurements.quality == MEASUREMENT_I2C_ERROR)))
+        {
+            // No new sample, or the INA237 could not be read. Hold the duty cycle instead of regulating on stale data
+        }
+        else if (running && (mode >= MODE_COUNT))
+        {
+            ESP_LOGE(TAG, "Invalid mode");
+        }
+        else if (running)
+        {
+            // List mode owns the mode and setpoint during a run, its steps advance on the sample timestamps.
+            // The run restarts when the mode is entered or the load is started, and stops the load when it ends.
+            ControlMode active_mode = mode;
+            float active_setpoint = setpoint;
+            if (mode == MODE_LIST)
+            {
+                if (!list_running)
                 {
-                    integral_error = 100.0;
+                    list_mode_restart();
+                    list_running = true;
                 }
-                else if (integral_error < -100.0)
+                active_mode = MODE_CC;
+                active_setpoint = 0.0f;
+                if (!list_mode_step(measurements.timestamp_us, &active_mode, &active_setpoint))
                 {
-                    integral_error = -100.0;
+                    ESP_LOGI(TAG, "List finished, stopping the load");
+                    load_state_command(LOAD_COMMAND_STOP);
                 }
+            }
+            else
+            {
+                list_running = false;
+            }
 
-                // Calculate the control output (duty cycle)
-                duty_cycle = Kp_CC * error + Ki_CC * integral_error;
-
-                // Clamp the duty cycle to valid range (0% to 100%)
-                if (duty_cycle > 100.0)
-                {
-                    duty_cycle = 100.0;
-                }
-                else if (duty_cycle < 0.0)
+            // A discharge test owns the mode and setpoint too, and stops the load at the cutoff voltage
+            if (mode == MODE_DISCHARGE)
+            {
+                discharge_running = true;
+                if (!discharge_test_step(&measurements, &active_mode, &active_setpoint))
                 {
-                    duty_cycle = 0.0;
+                    ESP_LOGI(TAG, "Discharge test finished, stopping the load");
+                    load_state_command(LOAD_COMMAND_STOP);
                 }
+            }
+            else if (discharge_running)
+            {
+                discharge_test_stop();
+                discharge_running = false;
+            }
 
-                // Update the PWM duty cycle
-                pwm_update_duty(duty_cycle, PWM_CHANNEL_LOAD);
-
-                ESP_LOGI(TAG, "Setpoint: %.2f A, Measured: %.2f A, Duty Cycle: %.2f%%", setpoint, measurements.current, duty_cycle);
-
-                break;
-            case MODE_CV: // Constant Voltage Mode
-                          // Control logic here
-
-                // Calculate the error
-                error = setpoint - measurements.bus_voltage;
-
-                // Update the integral term
-                integral_error += error * dt;
-
-                // Anti-windup: Clamp the integral term to prevent excessive accumulation
-                if (integral_error > 10.0) // Adjust this limit as needed
+            // An I-V sweep steps the CC or CV reference itself, and stops the load once the curve is complete
+            if (mode == MODE_SWEEP)
+            {
+                if (!sweep_running)
                 {
-                    integral_error = 10.0;
+                    iv_sweep_restart();
+                    sweep_running = true;
                 }
-                else if (integral_error < -10.0)
+                if (!iv_sweep_step(&measurements, &active_mode, &active_setpoint))
                 {
-                    integral_error = -10.0;
+                    ESP_LOGI(TAG, "I-V sweep finished, stopping the load");
+                    load_state_command(LOAD_COMMAND_STOP);
                 }
+            }
+            else if (sweep_running)
+            {
+                iv_sweep_stop();
+                sweep_running = false;
+            }
 
-                // Calculate the control output (duty cycle)
-                duty_cycle = -Kp_CV * error - Ki_CV * integral_error;
+            // Constant resistance regulates the current, with the reference following the bus voltage
+            float reference = active_setpoint;
+            if (active_mode == MODE_CR)
+            {
+                reference = constant_resistance_reference(active_setpoint, measurements.bus_voltage);
+            }
 
-                // Clamp the duty cycle to valid range (0% to 100%)
-                if (duty_cycle > 100.0)
+            // Dynamic mode regulates the current, with the reference from the waveform generator. The waveform
+            // restarts when the mode is entered, the load is started or a new waveform is written.
+            if (active_mode == MODE_DYNAMIC)
+            {
+                bool restart = !dynamic_running || (settings.dynamic_updates != dynamic_updates);
+                bool trigger = settings.dynamic_triggers != dynamic_triggers;
+                dynamic_running = true;
+                dynamic_updates = settings.dynamic_updates;
+                dynamic_triggers = settings.dynamic_triggers;
+                if (restart)
                 {
-                    duty_cycle = 100.0;
+                    dynamic_load_init(&dynamic_load, &settings.dynamic);
+#if FAST_CONTROL_ENABLED
+                    fast_control_set_dynamic(&settings.dynamic);
+#endif
                 }
-                else if (duty_cycle < 0.0)
+                else if (trigger)
                 {
-                    duty_cycle = 0.0;
+                    dynamic_load_trigger(&dynamic_load);
+#if FAST_CONTROL_ENABLED
+                    fast_control_trigger_dynamic();
+#endif
                 }
+                reference = (float)dynamic_load_step(&dynamic_load, (uint32_t)dt_us) * 1e-6f;
+            }
+            else
+            {
+                dynamic_running = false;
+            }
 
-                // Update the PWM duty cycle
-                pwm_update_duty(duty_cycle, PWM_CHANNEL_LOAD);
-
-                ESP_LOGI(TAG, "Setpoint: %.2f V, Measured: %.2f V, Duty Cycle: %.2f%%", setpoint, measurements.bus_voltage, duty_cycle);
-
-                break;
-            case MODE_CP: // Constant Power Mode
-                          // Control logic here
-
-                // Calculate the error
-                error = setpoint - measurements.power;
-
-                // Update the integral term
-                integral_error += error * dt;
-
-                // Anti-windup: Clamp the integral term to prevent excessive accumulation
-                if (integral_error > 10.0) // Adjust this limit as needed
+            // Waveform mode plays the uploaded table against the sample timestamps, regulating the current or
+            // the power depending on the table. Playback restarts when the mode is entered or the load is started.
+            const RegulatorDescriptor *descriptor = &regulator_descriptors[active_mode];
+            if (active_mode == MODE_WAVEFORM)
+            {
+                if (waveform_unit() == WAVEFORM_POWER)
                 {
-                    integral_error = 10.0;
+                    descriptor = &regulator_descriptors[MODE_CP];
                 }
-                else if (integral_error < -10.0)
+                if (!waveform_running)
                 {
-                    integral_error = -10.0;
+                    waveform_restart();
+                    waveform_running = true;
                 }
+                waveform_step(measurements.timestamp_us, regulator_measurement(descriptor, &measurements), &reference);
+            }
+            else
+            {
+                waveform_running = false;
+            }
 
-                // Calculate the control output (duty cycle)
-                duty_cycle = Kp_CP * error + Ki_CP * integral_error;
+            // Back off from the SOA on the reference actually regulated, so it works the same in every mode. A
+            // higher voltage reference draws less current, so it is divided instead.
+            reference = (descriptor->direction < 0) ? reference / soa_scale : reference * soa_scale;
+#if FAST_CONTROL_ENABLED
+            fast_control_set_dynamic_scale(soa_scale);
+#endif
 
-                // Clamp the duty cycle to valid range (0% to 100%)
-                if (duty_cycle > 100.0)
-                {
-                    duty_cycle = 100.0;
-                }
-                else if (duty_cycle < 0.0)
+            // Switch the regulator over when the mode changes. The new mode starts from the duty cycle the
+            // load is running at, read back from the PWM since the fast path may have been driving it.
+            if (regulator.descriptor != descriptor)
+            {
+                duty_cycle = pwm_get_duty(PWM_CHANNEL_LOAD);
+                regulator_transfer(&regulator, descriptor, duty_cycle, reference, regulator_measurement(descriptor, &measurements));
+            }
+
+#if FAST_CONTROL_ENABLED
+            if (descriptor->measurement_offset == offsetof(MeasurementData, current))
+            {
+                // The timer interrupt regulates the current, only hand it the reference. In dynamic mode it
+                // runs its own copy of the waveform generator on the interrupt tick.
+                if (active_mode != MODE_DYNAMIC)
                 {
-                    duty_cycle = 0.0;
+                    fast_control_set_setpoint(reference);
                 }
+                fast_control_start();
+            }
+            else
+#endif
+            {
+                // Only the current loops have a fast path
+                fast_control_stop();
+
+                float measured = regulator_measurement(regulator.descriptor, &measurements);
+#if REGULATOR_FIXED_POINT
+                int16_t duty_q15 = regulator_update_q15(&regulator,
+                                                        regulator_to_q15(regulator.descriptor, reference),
+                                                        regulator_to_q15(regulator.descriptor, measured),
+                                                        dt_us);
+                duty_cycle = (float)duty_q15 * (100.0f / 32768.0f);
+#else
+                duty_cycle = regulator_update(&regulator, reference, measured, (float)dt_us * 1e-6f);
+#endif
 
                 // Update the PWM duty cycle
                 pwm_update_duty(duty_cycle, PWM_CHANNEL_LOAD);
 
-                ESP_LOGI(TAG, "Setpoint: %.2f W, Measured: %.2f W, Duty Cycle: %.2f%%", setpoint, measurements.power, duty_cycle);
-
-                break;
-            default:
-                ESP_LOGE(TAG, "Invalid mode");
-                break;
+                if (log_due)
+                {
+                    ESP_LOGI(TAG, "Setpoint: %.2f %s, Measured: %.2f %s, Duty Cycle: %.2f%%",
+                             reference, regulator.descriptor->unit, measured, regulator.descriptor->unit, duty_cycle);
+                }
             }
+
+            // Keep the controller state for the fault recorder, the duty is read back since the fast path may be driving it
+            BlackboxControl control = {
+                .mode = active_mode,
+                .setpoint = reference,
+                .duty_cycle = pwm_get_duty(PWM_CHANNEL_LOAD),
+#if REGULATOR_FIXED_POINT
+                .integral = (float)regulator.integral_q31 * (REGULATOR_OUTPUT_MAX / 2147483648.0f),
+#else
+                .integral = regulator.descriptor->ki * regulator.integral,
+#endif
+                .timestamp_us = measurements.timestamp_us,
+            };
+            blackbox_note_control(&control);
+
+            // Time from the end of the conversion to the PWM update
+            int64_t latency_us = esp_timer_get_time() - measurements.timestamp_us;
+            latency_sum_us += latency_us;
+            latency_max_us = (latency_us > latency_max_us) ? latency_us : latency_max_us;
+            updates++;
         }
         else
         {
-            vTaskDelay(pdMS_TO_TICKS(100));
+            fast_control_stop();
+            ulTaskNotifyTakeIndexed(LOAD_STATE_NOTIFY_INDEX, pdTRUE, pdMS_TO_TICKS(CONTROL_STOPPED_DELAY_MS));
             duty_cycle = 0;
-            error = 0;
-            integral_error = 0;
-            previous_tick = xTaskGetTickCount();
+            regulator_reset(&regulator);
+            dynamic_running = false;
+            waveform_running = false;
+            if (list_running)
+            {
+                list_mode_restart();
+                list_running = false;
+            }
+            if (discharge_running)
+            {
+                discharge_test_stop();
+                discharge_running = false;
+            }
+            if (sweep_running)
+            {
+                iv_sweep_stop();
+                sweep_running = false;
+            }
+            previous_timestamp_us = 0;
             pwm_update_duty(duty_cycle, PWM_CHANNEL_LOAD);
-            ESP_LOGI(TAG, "Load stopped");
+            if (log_due)
+            {
+                ESP_LOGI(TAG, "Load stopped");
+            }
+        }
+
+        // The safety task sets SOA_DERATE_BIT while most of the SOA budget is used. Back the reference off by a
+        // fraction per sample, down to SOA_DERATE_MIN, and bring it back slowly once the bit clears. The user
+        // setpoint is left alone.
+        bool soa_derate = (xEventGroupGetBits(signal_event_group) & SOA_DERATE_BIT) == SOA_DERATE_BIT;
+        if (new_sample)
+        {
+            soa_scale = soa_derate ? fmaxf(soa_scale * (1.0f - SOA_DERATE_STEP), SOA_DERATE_MIN)
+                                   : fminf(soa_scale + SOA_DERATE_RECOVERY_STEP, 1.0f);
         }
 
-        if (measurements.temperature_internal > safety_data.soft_max_temperature)
+        // Derate towards less load, which in constant resistance mode is a higher resistance
+        float derate_direction = (mode == MODE_CR) ? -1.0f : 1.0f;
+        if (soa_derate)
         {
-            setpoint -= 0.1;
+            // The SOA derate already backs off, the soft limits wait until it is over
+        }
+        else if (measurements.temperature_internal > safety_data.soft_max_temperature)
+        {
+            setpoint -= derate_direction * 0.1f;
         }
         else if (measurements.current > safety_data.soft_max_current)
         {
-            setpoint -= 0.01;
+            setpoint -= derate_direction * 0.01f;
         }
         else if (measurements.bus_voltage > safety_data.soft_max_voltage)
         {
-            ESP_LOGI(TAG, "Unsure what to do with this, so just add this later");
+            if (log_due)
+            {
+                ESP_LOGI(TAG, "Unsure what to do with this, so just add this later");
+            }
         }
 
-        if ((xEventGroupGetBits(signal_event_group) & RESET_BIT) == RESET_BIT)
+        if (load.resets != load_resets)
         {
             ESP_LOGI(TAG, "Load Reset triggered");
-            xEventGroupClearBits(signal_event_group, RESET_BIT);
-            xEventGroupClearBits(safety_event_group, OVERVOLTAGE_BIT);
-            xEventGroupClearBits(safety_event_group, OVERCURRENT_BIT);
-            xEventGroupClearBits(safety_event_group, OVERTEMPERATURE_BIT);
-            xEventGroupClearBits(safety_event_group, UNDERVOLTAGE_BIT);
-            xEventGroupClearBits(signal_event_group, START_STOP_BIT);
+            load_resets = load.resets;
             setpoint = 0;
         }
 
         // Handle safety triggers
-        if ((xEventGroupGetBits(safety_event_group)) != 0)
+        if (load.state == LOAD_FAULT)
         {
+            fast_control_stop();
             duty_cycle = 0;
             pwm_update_duty(duty_cycle, PWM_CHANNEL_LOAD);
-            ESP_LOGI(TAG, "SAFETY TRIGGERED, %lu", xEventGroupGetBits(safety_event_group));
+            if (log_due)
+            {
+                ESP_LOGI(TAG, "SAFETY TRIGGERED, %lu", load.faults);
+            }
             pwm_update_duty(50, PWM_CHANNEL_BUZZER);
         }
 
 
+        // Publish the loop statistics once per period
+        if ((now - statistics_time) >= (int64_t)STATISTICS_PERIOD_MS * 1000)
+        {
+            statistics.loops_per_second = (float)loops * 1000000.0f / (float)(now - statistics_time);
+            statistics.period_avg_us = (float)period_sum_us / (float)loops;
+            statistics.period_max_us = (float)period_max_us;
+            statistics.latency_avg_us = (updates == 0) ? 0.0f : (float)latency_sum_us / (float)updates;
+            statistics.latency_max_us = (float)latency_max_us;
+            xQueueOverwrite(control_statistics_queue, &statistics);
+            ESP_LOGI(TAG, "Control loop: %.1f loops/s, period avg %.1f us, max %.1f us, latency avg %.1f us, max %.1f us, skipped %lu",
+                     statistics.loops_per_second, statistics.period_avg_us, statistics.period_max_us,
+                     statistics.latency_avg_us, statistics.latency_max_us, statistics.samples_skipped);
+            statistics_time = now;
+            period_sum_us = 0;
+            period_max_us = 0;
+            loops = 0;
+            latency_sum_us = 0;
+            latency_max_us = 0;
+            updates = 0;
+        }
+
         // For fan control I need a PWM signal that is between 18 kHz and 30 kHz
         // The fan has an operating duty cycle range from 30% to 100%
         // This is a very rudementary way to implement a fan curve but its the first thing i though of, change if it doesnt work well.
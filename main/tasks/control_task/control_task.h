@@ -7,7 +7,7 @@
  *
  * This file contains the declaration of the control task, which is responsible
  * for implementing the control logic for constant current (CC), constant voltage (CV),
- * and constant power (CP) modes. The task interacts with other tasks via queues
+ * constant power (CP) and constant resistance (CR) modes. The task interacts with other tasks via queues
  * and event groups.
  *
  *
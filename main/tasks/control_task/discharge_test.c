@@ -0,0 +1,410 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "nvs.h"
+#include "esp_log.h"
+#include "discharge_test.h"
+#include "config.h"
+
+/**
+ * @file discharge_test.c
+ * @brief Implementation of the battery discharge test.
+ *
+ * The control task calls discharge_test_step() once per sample. The charge and
+ * energy of the test are summed from the increments of the exact integrators of
+ * the measurement task, so a reset of the integrators does not disturb a test
+ * and a resumed test simply keeps adding to the saved sums.
+ *
+ * The cutoff has hysteresis in voltage and in time. The test ends once the bus
+ * voltage has stayed below the cutoff for DISCHARGE_CUTOFF_CONFIRM_US, and the
+ * pending cutoff is only cancelled if the voltage rises above the cutoff plus
+ * the hysteresis, so noise around the cutoff neither ends the test early nor
+ * keeps restarting the confirmation time.
+ *
+ * The internal resistance comes from periodic pulses where the load drops to a
+ * fraction of the setpoint current for DISCHARGE_PULSE_US. Voltage and current
+ * are averaged over the last DISCHARGE_AVERAGE_US before the pulse and of the
+ * pulse, and the resistance is the voltage step over the current step.
+ *
+ * The progress is shared between the control task, the HTTP server and the
+ * task that saves it, and protected by a spinlock. It is saved to NVS as one
+ * blob.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+static const char *TAG = "DISCHARGE_TEST"; /**< Tag for logging messages from the discharge test. */
+
+#define DISCHARGE_NVS_NAMESPACE "discharge" /**< NVS namespace of the saved progress. */
+#define DISCHARGE_NVS_KEY "progress"        /**< NVS key of the saved progress. */
+#define DISCHARGE_SAVE_VERSION 1            /**< Layout version of the saved progress, older layouts are ignored. */
+
+/**
+ * @brief Progress of a test, saved to NVS as is.
+ */
+typedef struct
+{
+    uint32_t version;            /**< DISCHARGE_SAVE_VERSION. */
+    DischargeConfig config;      /**< Settings of the test. */
+    DischargeState state;        /**< State of the test. */
+    int64_t elapsed_us;          /**< Time spent discharging (us). */
+    int64_t charge_lsb_seconds;  /**< Charge drawn, in current LSB-seconds. */
+    int64_t energy_lsb_seconds;  /**< Energy drawn, in power LSB-seconds. */
+    float start_voltage;         /**< Bus voltage of the first sample of the test (V). */
+    float end_voltage;           /**< Bus voltage of the latest sample (V). */
+    float resistance_sum;        /**< Sum of the internal resistances of the pulses (Ω). */
+    float last_resistance;       /**< Internal resistance of the latest pulse (Ω). */
+    uint32_t resistance_samples; /**< Pulses in resistance_sum. */
+    int64_t next_pulse_us;       /**< Value of elapsed_us the next pulse starts at. */
+} DischargeProgress;
+
+/**
+ * @brief Progress and run state.
+ */
+typedef struct
+{
+    DischargeProgress progress;    /**< Progress, saved to NVS. */
+    bool started;                  /**< true once the first sample since the load started has been handled. */
+    bool save_due;                 /**< true if the state changed since the last save. */
+    int64_t previous_timestamp_us; /**< Timestamp of the previous sample (us). */
+    int64_t previous_charge;       /**< Charge integrator of the previous sample, in current LSB-seconds. */
+    int64_t previous_energy;       /**< Energy integrator of the previous sample, in power LSB-seconds. */
+    bool below_cutoff;             /**< true while a cutoff is pending. */
+    int64_t below_since_us;        /**< Timestamp the voltage went below the cutoff (us). */
+    bool in_pulse;                 /**< true during an internal resistance pulse. */
+    int64_t pulse_start_us;        /**< Value of elapsed_us the pulse started at. */
+    float base_voltage;            /**< Average voltage before the pulse (V). */
+    float base_current;            /**< Average current before the pulse (A). */
+    float voltage_sum;             /**< Sum of the voltages being averaged (V). */
+    float current_sum;             /**< Sum of the currents being averaged (A). */
+    uint32_t average_samples;      /**< Samples in the sums. */
+} DischargeTest;
+
+static DischargeTest discharge_test = {.progress = {.version = DISCHARGE_SAVE_VERSION, .config = {.mode = MODE_CC}}}; /**< The discharge test. */
+static portMUX_TYPE discharge_test_lock = portMUX_INITIALIZER_UNLOCKED; /**< Protects the discharge test. */
+
+/**
+ * @brief Replace the settings and clear the progress, the test starts over.
+ *
+ * @param config The new settings.
+ */
+void discharge_test_configure(const DischargeConfig *config)
+{
+    taskENTER_CRITICAL(&discharge_test_lock);
+    memset(&discharge_test.progress, 0, sizeof(discharge_test.progress));
+    discharge_test.progress.version = DISCHARGE_SAVE_VERSION;
+    discharge_test.progress.config = *config;
+    discharge_test.progress.state = DISCHARGE_IDLE;
+    discharge_test.started = false;
+    discharge_test.save_due = true;
+    taskEXIT_CRITICAL(&discharge_test_lock);
+
+    ESP_LOGI(TAG, "Configured, mode %d, setpoint %.3f, cutoff %.3f V", config->mode, config->setpoint, config->cutoff_voltage);
+}
+
+/**
+ * @brief Load the settings and the progress saved in NVS.
+ *
+ * A test that was running when it was saved is restored as paused. Must be
+ * called after NVS has been initialised.
+ */
+void discharge_test_restore(void)
+{
+    nvs_handle_t handle;
+    if (nvs_open(DISCHARGE_NVS_NAMESPACE, NVS_READONLY, &handle) != ESP_OK)
+    {
+        ESP_LOGI(TAG, "No saved discharge test");
+        return;
+    }
+
+    DischargeProgress progress;
+    size_t length = sizeof(progress);
+    esp_err_t err = nvs_get_blob(handle, DISCHARGE_NVS_KEY, &progress, &length);
+    nvs_close(handle);
+    if ((err != ESP_OK) || (length != sizeof(progress)) || (progress.version != DISCHARGE_SAVE_VERSION))
+    {
+        ESP_LOGW(TAG, "Saved discharge test not usable (%s)", esp_err_to_name(err));
+        return;
+    }
+
+    // The load was switched off by the reset, the test continues when it is started again
+    if (progress.state == DISCHARGE_RUNNING)
+    {
+        progress.state = DISCHARGE_PAUSED;
+    }
+
+    taskENTER_CRITICAL(&discharge_test_lock);
+    discharge_test.progress = progress;
+    discharge_test.started = false;
+    taskEXIT_CRITICAL(&discharge_test_lock);
+
+    ESP_LOGI(TAG, "Restored discharge test, state %d, %.1f s, %.4f Ah", progress.state, (float)progress.elapsed_us * 1e-6f,
+             (float)(progress.charge_lsb_seconds * INA237_CURRENT_LSB / 3600.0));
+}
+
+/**
+ * @brief Add a sample to the voltage and current average.
+ *
+ * Must be called with the lock taken.
+ *
+ * @param measurements The sample.
+ */
+static void discharge_test_average_locked(const MeasurementData *measurements)
+{
+    discharge_test.voltage_sum += measurements->bus_voltage;
+    discharge_test.current_sum += measurements->current;
+    discharge_test.average_samples++;
+}
+
+/**
+ * @brief Start the pulses and the averages over, for a new or resumed test.
+ *
+ * Must be called with the lock taken.
+ *
+ * @param measurements The first sample of the run.
+ */
+static void discharge_test_begin_locked(const MeasurementData *measurements)
+{
+    DischargeProgress *progress = &discharge_test.progress;
+    if (progress->state == DISCHARGE_IDLE)
+    {
+        // discharge_test_configure() has cleared the progress, only the start voltage is new
+        progress->start_voltage = measurements->bus_voltage;
+    }
+    progress->state = DISCHARGE_RUNNING;
+    progress->next_pulse_us = progress->elapsed_us + (int64_t)progress->config.pulse_interval_s * 1000000;
+
+    discharge_test.started = true;
+    discharge_test.save_due = true;
+    discharge_test.previous_timestamp_us = measurements->timestamp_us;
+    discharge_test.previous_charge = measurements->charge_lsb_seconds;
+    discharge_test.previous_energy = measurements->energy_lsb_seconds;
+    discharge_test.below_cutoff = false;
+    discharge_test.in_pulse = false;
+    discharge_test.voltage_sum = 0.0f;
+    discharge_test.current_sum = 0.0f;
+    discharge_test.average_samples = 0;
+}
+
+/**
+ * @brief Run the internal resistance pulses for one sample.
+ *
+ * The sample is added to the average before the pulse state changes, since it
+ * was measured at the load set on the previous sample.
+ *
+ * Must be called with the lock taken.
+ *
+ * @param measurements The sample.
+ */
+static void discharge_test_pulse_locked(const MeasurementData *measurements)
+{
+    DischargeProgress *progress = &discharge_test.progress;
+    if (progress->config.pulse_interval_s == 0)
+    {
+        return;
+    }
+
+    int64_t level_end_us = discharge_test.in_pulse ? discharge_test.pulse_start_us + DISCHARGE_PULSE_US : progress->next_pulse_us;
+    if (progress->elapsed_us >= level_end_us - DISCHARGE_AVERAGE_US)
+    {
+        discharge_test_average_locked(measurements);
+    }
+    if ((progress->elapsed_us < level_end_us) || (discharge_test.average_samples == 0))
+    {
+        return;
+    }
+
+    float voltage = discharge_test.voltage_sum / discharge_test.average_samples;
+    float current = discharge_test.current_sum / discharge_test.average_samples;
+    discharge_test.voltage_sum = 0.0f;
+    discharge_test.current_sum = 0.0f;
+    discharge_test.average_samples = 0;
+
+    if (!discharge_test.in_pulse)
+    {
+        // End of the full load level, reduce the load
+        discharge_test.base_voltage = voltage;
+        discharge_test.base_current = current;
+        discharge_test.pulse_start_us = progress->elapsed_us;
+        discharge_test.in_pulse = true;
+        return;
+    }
+
+    // End of the pulse, the voltage rose by the current step times the internal resistance
+    discharge_test.in_pulse = false;
+    progress->next_pulse_us = progress->elapsed_us + (int64_t)progress->config.pulse_interval_s * 1000000;
+    float current_step = discharge_test.base_current - current;
+    if (current_step >= DISCHARGE_MIN_STEP_A)
+    {
+        progress->last_resistance = (voltage - discharge_test.base_voltage) / current_step;
+        progress->resistance_sum += progress->last_resistance;
+        progress->resistance_samples++;
+    }
+}
+
+/**
+ * @brief Run the test for one sample.
+ *
+ * The first sample after a start begins a new test, or continues a paused one.
+ * A finished test is not started again, its report is kept until a new test is
+ * configured, and the load is stopped without drawing anything.
+ *
+ * @param measurements The sample.
+ * @param mode Output, the mode to regulate in.
+ * @param setpoint Output, the reference in the unit of the mode.
+ * @return true while discharging, false once the cutoff has been reached.
+ */
+bool discharge_test_step(const MeasurementData *measurements, ControlMode *mode, float *setpoint)
+{
+    taskENTER_CRITICAL(&discharge_test_lock);
+    DischargeProgress *progress = &discharge_test.progress;
+    const DischargeConfig *config = &progress->config;
+
+    bool began = !discharge_test.started && (progress->state != DISCHARGE_FINISHED);
+    bool cutoff = false;
+    if (began)
+    {
+        discharge_test_begin_locked(measurements);
+    }
+    else if (progress->state == DISCHARGE_RUNNING)
+    {
+        // Sum the time and the integrator increments, a reset of the integrators shows as a negative increment
+        int64_t dt_us = measurements->timestamp_us - discharge_test.previous_timestamp_us;
+        int64_t charge = measurements->charge_lsb_seconds - discharge_test.previous_charge;
+        int64_t energy = measurements->energy_lsb_seconds - discharge_test.previous_energy;
+        progress->elapsed_us += (dt_us > 0) ? dt_us : 0;
+        progress->charge_lsb_seconds += (charge > 0) ? charge : 0;
+        progress->energy_lsb_seconds += (energy > 0) ? energy : 0;
+        discharge_test.previous_timestamp_us = measurements->timestamp_us;
+        discharge_test.previous_charge = measurements->charge_lsb_seconds;
+        discharge_test.previous_energy = measurements->energy_lsb_seconds;
+        progress->end_voltage = measurements->bus_voltage;
+
+        discharge_test_pulse_locked(measurements);
+
+        // Cutoff with hysteresis
+        if (measurements->bus_voltage < config->cutoff_voltage)
+        {
+            if (!discharge_test.below_cutoff)
+            {
+                discharge_test.below_cutoff = true;
+                discharge_test.below_since_us = measurements->timestamp_us;
+            }
+            else if (measurements->timestamp_us - discharge_test.below_since_us >= DISCHARGE_CUTOFF_CONFIRM_US)
+            {
+                progress->state = DISCHARGE_FINISHED;
+                discharge_test.in_pulse = false;
+                discharge_test.save_due = true;
+                cutoff = true;
+            }
+        }
+        else if (measurements->bus_voltage > config->cutoff_voltage + config->hysteresis)
+        {
+            discharge_test.below_cutoff = false;
+        }
+    }
+
+    // During a pulse the load drops to a fraction of the setpoint current, a higher resistance in CR mode.
+    // Once the cutoff has been reached nothing is drawn until the load has stopped.
+    bool running = progress->state == DISCHARGE_RUNNING;
+    *mode = config->mode;
+    *setpoint = running ? config->setpoint : 0.0f;
+    if (running && discharge_test.in_pulse)
+    {
+        *setpoint = (config->mode == MODE_CR) ? config->setpoint / config->pulse_level : config->setpoint * config->pulse_level;
+    }
+    float elapsed_s = (float)progress->elapsed_us * 1e-6f;
+    float capacity_ah = (float)(progress->charge_lsb_seconds * INA237_CURRENT_LSB / 3600.0);
+    taskEXIT_CRITICAL(&discharge_test_lock);
+
+    if (began)
+    {
+        ESP_LOGI(TAG, "Test running at %.3f V, %.1f s and %.4f Ah so far", measurements->bus_voltage, elapsed_s, capacity_ah);
+    }
+    if (cutoff)
+    {
+        ESP_LOGI(TAG, "Cutoff reached after %.1f s, %.4f Ah", elapsed_s, capacity_ah);
+    }
+    return running;
+}
+
+/**
+ * @brief Pause a running test, called when the load stops.
+ */
+void discharge_test_stop(void)
+{
+    taskENTER_CRITICAL(&discharge_test_lock);
+    if (discharge_test.progress.state == DISCHARGE_RUNNING)
+    {
+        discharge_test.progress.state = DISCHARGE_PAUSED;
+        discharge_test.save_due = true;
+    }
+    discharge_test.started = false;
+    discharge_test.in_pulse = false;
+    taskEXIT_CRITICAL(&discharge_test_lock);
+}
+
+/**
+ * @brief Save the progress to NVS if it is due.
+ *
+ * Saves on a change of state, and every DISCHARGE_SAVE_PERIOD_MS while
+ * running. Writing flash takes milliseconds, so this is called from a low
+ * priority task and never from the control loop.
+ */
+void discharge_test_persist(void)
+{
+    static TickType_t save_tick = 0; /**< Tick of the last save. */
+
+    taskENTER_CRITICAL(&discharge_test_lock);
+    bool due = discharge_test.save_due ||
+               ((discharge_test.progress.state == DISCHARGE_RUNNING) && ((xTaskGetTickCount() - save_tick) >= pdMS_TO_TICKS(DISCHARGE_SAVE_PERIOD_MS)));
+    DischargeProgress progress = discharge_test.progress;
+    discharge_test.save_due = false;
+    taskEXIT_CRITICAL(&discharge_test_lock);
+
+    if (!due)
+    {
+        return;
+    }
+    save_tick = xTaskGetTickCount();
+
+    nvs_handle_t handle;
+    esp_err_t err = nvs_open(DISCHARGE_NVS_NAMESPACE, NVS_READWRITE, &handle);
+    if (err == ESP_OK)
+    {
+        err = nvs_set_blob(handle, DISCHARGE_NVS_KEY, &progress, sizeof(progress));
+        if (err == ESP_OK)
+        {
+            err = nvs_commit(handle);
+        }
+        nvs_close(handle);
+    }
+    if (err != ESP_OK)
+    {
+        ESP_LOGE(TAG, "Failed to save the discharge test (%s)", esp_err_to_name(err));
+    }
+}
+
+/**
+ * @brief Copy the report of the test.
+ *
+ * @param report Output, the report.
+ */
+void discharge_test_get_report(DischargeReport *report)
+{
+    taskENTER_CRITICAL(&discharge_test_lock);
+    DischargeProgress progress = discharge_test.progress;
+    taskEXIT_CRITICAL(&discharge_test_lock);
+
+    report->config = progress.config;
+    report->state = progress.state;
+    report->capacity_ah = (float)(progress.charge_lsb_seconds * INA237_CURRENT_LSB / 3600.0);
+    report->energy_wh = (float)(progress.energy_lsb_seconds * INA237_POWER_LSB / 3600.0);
+    report->duration_s = (float)progress.elapsed_us * 1e-6f;
+    report->start_voltage = progress.start_voltage;
+    report->end_voltage = progress.end_voltage;
+    report->internal_resistance = (progress.resistance_samples == 0) ? 0.0f : progress.resistance_sum / progress.resistance_samples;
+    report->last_resistance = progress.last_resistance;
+    report->resistance_samples = progress.resistance_samples;
+}
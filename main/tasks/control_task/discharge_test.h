@@ -0,0 +1,113 @@
+#ifndef DISCHARGE_TEST_H
+#define DISCHARGE_TEST_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "globals.h"
+
+/**
+ * @file discharge_test.h
+ * @brief Header file for the battery discharge test.
+ *
+ * This file contains the declarations for discharging a battery at constant
+ * current, power or resistance down to a cutoff voltage, then stopping the
+ * load and reporting the capacity, the energy, the duration and the internal
+ * resistance. The progress is saved to NVS, so a test interrupted by a fault,
+ * a stop or a reset continues where it left off when the load is started
+ * again.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Settings of a discharge test.
+ */
+typedef struct
+{
+    ControlMode mode;          /**< Discharge mode, CC, CP or CR. */
+    float setpoint;            /**< Setpoint in the unit of the mode. */
+    float cutoff_voltage;      /**< The test ends when the bus voltage stays below this (V). */
+    float hysteresis;          /**< The voltage must rise this far above the cutoff to cancel a pending cutoff (V). */
+    uint32_t pulse_interval_s; /**< Time between internal resistance pulses, 0 for none (s). */
+    float pulse_level;         /**< Load during a pulse, as a fraction of the setpoint current, 0 to 1. */
+} DischargeConfig;
+
+/**
+ * @brief State of a discharge test.
+ */
+typedef enum
+{
+    DISCHARGE_IDLE,     /**< Configured, not started. */
+    DISCHARGE_RUNNING,  /**< Discharging. */
+    DISCHARGE_PAUSED,   /**< Stopped before the cutoff, continues when the load is started. */
+    DISCHARGE_FINISHED, /**< The cutoff was reached, the report is final. */
+} DischargeState;
+
+/**
+ * @brief Report of a discharge test.
+ */
+typedef struct
+{
+    DischargeConfig config;        /**< Settings of the test. */
+    DischargeState state;          /**< State of the test. */
+    float capacity_ah;             /**< Charge drawn (Ah). */
+    float energy_wh;               /**< Energy drawn (Wh). */
+    float duration_s;              /**< Time spent discharging (s). */
+    float start_voltage;           /**< Bus voltage of the first sample of the test (V). */
+    float end_voltage;             /**< Bus voltage of the latest sample, or of the cutoff once finished (V). */
+    float internal_resistance;     /**< Mean internal resistance of the pulses, 0 if none (Ω). */
+    float last_resistance;         /**< Internal resistance of the latest pulse, 0 if none (Ω). */
+    uint32_t resistance_samples;   /**< Pulses the internal resistance was computed from. */
+} DischargeReport;
+
+/**
+ * @brief Replace the settings and clear the progress, the test starts over.
+ *
+ * @param config The new settings.
+ */
+void discharge_test_configure(const DischargeConfig *config);
+
+/**
+ * @brief Load the settings and the progress saved in NVS.
+ *
+ * A test that was running when it was saved is restored as paused. Must be
+ * called after NVS has been initialised.
+ */
+void discharge_test_restore(void);
+
+/**
+ * @brief Run the test for one sample.
+ *
+ * The first sample after a start begins a new test, or continues a paused one.
+ * A finished test is not started again, its report is kept until a new test is
+ * configured, and the load is stopped without drawing anything.
+ *
+ * @param measurements The sample.
+ * @param mode Output, the mode to regulate in.
+ * @param setpoint Output, the reference in the unit of the mode.
+ * @return true while discharging, false once the cutoff has been reached.
+ */
+bool discharge_test_step(const MeasurementData *measurements, ControlMode *mode, float *setpoint);
+
+/**
+ * @brief Pause a running test, called when the load stops.
+ */
+void discharge_test_stop(void);
+
+/**
+ * @brief Save the progress to NVS if it is due.
+ *
+ * Saves on a change of state, and every DISCHARGE_SAVE_PERIOD_MS while
+ * running. Writing flash takes milliseconds, so this is called from a low
+ * priority task and never from the control loop.
+ */
+void discharge_test_persist(void);
+
+/**
+ * @brief Copy the report of the test.
+ *
+ * @param report Output, the report.
+ */
+void discharge_test_get_report(DischargeReport *report);
+
+#endif // DISCHARGE_TEST_H
@@ -0,0 +1,123 @@
+#include "esp_attr.h"
+#include "dynamic_load.h"
+
+/**
+ * @file dynamic_load.c
+ * @brief Implementation of the dynamic mode waveform generator.
+ *
+ * The reference is kept in uA, so a slew rate in mA/ms times a step in us
+ * gives the largest change per tick in uA without a division. The step
+ * function is in IRAM, since the fast control interrupt calls it every tick.
+ *
+ * In continuous sub-mode each period starts at level 1 and ends with
+ * `level_2_us` at level 2.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Load a waveform and restart it at level 1.
+ *
+ * The period is at least 1 us and the time at level 2 at most one period.
+ *
+ * @param load The generator.
+ * @param config The waveform.
+ */
+void dynamic_load_init(DynamicLoad *load, const DynamicConfig *config)
+{
+    load->config = *config;
+    if (load->config.period_us == 0)
+    {
+        load->config.period_us = 1;
+    }
+    if (load->config.level_2_us > load->config.period_us)
+    {
+        load->config.level_2_us = load->config.period_us;
+    }
+
+    load->phase_us = 0;
+    load->level_2 = false;
+    load->reference_ua = load->config.level_1_ma * 1000;
+}
+
+/**
+ * @brief Handle a trigger.
+ *
+ * Starts a pulse in pulsed sub-mode and toggles the level in triggered
+ * sub-mode. Ignored in continuous sub-mode.
+ *
+ * @param load The generator.
+ */
+void IRAM_ATTR dynamic_load_trigger(DynamicLoad *load)
+{
+    switch (load->config.submode)
+    {
+    case DYNAMIC_PULSED:
+        load->level_2 = true;
+        load->phase_us = 0;
+        break;
+    case DYNAMIC_TRIGGERED:
+        load->level_2 = !load->level_2;
+        break;
+    default:
+        break;
+    }
+}
+
+/**
+ * @brief Advance the generator by one control tick.
+ *
+ * @param load The generator.
+ * @param dt_us Time since the previous tick (us).
+ * @return The current reference (uA).
+ */
+int32_t IRAM_ATTR dynamic_load_step(DynamicLoad *load, uint32_t dt_us)
+{
+    const DynamicConfig *config = &load->config;
+    bool level_2 = false;
+
+    // Select the level of this tick
+    switch (config->submode)
+    {
+    case DYNAMIC_CONTINUOUS:
+        load->phase_us = (load->phase_us + dt_us) % config->period_us;
+        level_2 = load->phase_us >= (config->period_us - config->level_2_us);
+        break;
+    case DYNAMIC_PULSED:
+        if (load->level_2)
+        {
+            load->phase_us += dt_us;
+            load->level_2 = load->phase_us < config->level_2_us;
+        }
+        level_2 = load->level_2;
+        break;
+    case DYNAMIC_TRIGGERED:
+        level_2 = load->level_2;
+        break;
+    default:
+        break;
+    }
+    int32_t target_ua = (level_2 ? config->level_2_ma : config->level_1_ma) * 1000;
+
+    // Move the reference towards the level, at most the slew rate times the step
+    if (config->slew_ma_per_ms == 0)
+    {
+        load->reference_ua = target_ua;
+    }
+    else
+    {
+        int64_t max_step_ua = (int64_t)config->slew_ma_per_ms * dt_us;
+        int64_t difference_ua = (int64_t)target_ua - load->reference_ua;
+        if (difference_ua > max_step_ua)
+        {
+            difference_ua = max_step_ua;
+        }
+        else if (difference_ua < -max_step_ua)
+        {
+            difference_ua = -max_step_ua;
+        }
+        load->reference_ua += (int32_t)difference_ua;
+    }
+    return load->reference_ua;
+}
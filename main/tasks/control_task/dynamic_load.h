@@ -0,0 +1,58 @@
+#ifndef DYNAMIC_LOAD_H
+#define DYNAMIC_LOAD_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "globals.h"
+
+/**
+ * @file dynamic_load.h
+ * @brief Header file for the dynamic mode waveform generator.
+ *
+ * This file contains the declarations for the generator of the current
+ * reference of dynamic mode, a two-level square wave with a limited slew rate.
+ * The generator is stepped once per control tick, from the control task or
+ * from the fast control interrupt, so it only uses integer arithmetic.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief State of the waveform generator.
+ */
+typedef struct
+{
+    DynamicConfig config;  /**< The waveform. */
+    uint32_t phase_us;     /**< Time into the current period or pulse (us). */
+    bool level_2;          /**< Triggered: level 2 selected. Pulsed: pulse in progress. */
+    int32_t reference_ua;  /**< Current reference after the slew rate limit (uA). */
+} DynamicLoad;
+
+/**
+ * @brief Load a waveform and restart it at level 1.
+ *
+ * @param load The generator.
+ * @param config The waveform.
+ */
+void dynamic_load_init(DynamicLoad *load, const DynamicConfig *config);
+
+/**
+ * @brief Handle a trigger.
+ *
+ * Starts a pulse in pulsed sub-mode and toggles the level in triggered
+ * sub-mode. Ignored in continuous sub-mode.
+ *
+ * @param load The generator.
+ */
+void dynamic_load_trigger(DynamicLoad *load);
+
+/**
+ * @brief Advance the generator by one control tick.
+ *
+ * @param load The generator.
+ * @param dt_us Time since the previous tick (us).
+ * @return The current reference (uA).
+ */
+int32_t dynamic_load_step(DynamicLoad *load, uint32_t dt_us);
+
+#endif // DYNAMIC_LOAD_H
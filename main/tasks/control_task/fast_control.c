@@ -0,0 +1,336 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "driver/gptimer.h"
+#include "driver/ledc.h"
+#include "esp_attr.h"
+#include "esp_cpu.h"
+#include "esp_log.h"
+#include "sdkconfig.h"
+#include "fast_control.h"
+#include "dynamic_load.h"
+#include "hw_protection.h"
+#include "config.h"
+
+/**
+ * @file fast_control.c
+ * @brief Implementation of the fast constant current control path.
+ *
+ * A gptimer alarm runs the PI kernel every `FAST_CONTROL_PERIOD_US`. The
+ * kernel and everything it calls are in IRAM and use integer arithmetic only,
+ * since the FPU cannot be used from an interrupt:
+ *
+ * - The setpoint and the measurement are in INA237 current LSBs.
+ * - The gains are in PWM counts per LSB, scaled by 2^FAST_CONTROL_GAIN_SHIFT.
+ * - The integrator is kept in the same scale and clamped to the PWM range.
+ *
+ * The INA237 cannot be read from the interrupt, so the kernel regulates on the
+ * latest current handed over by the measurement task (zero-order hold). With
+ * `INA237_ADC_CONFIG_FAST` a new reading arrives about every 300 us. If no
+ * reading arrives for `FAST_CONTROL_STALE_TICKS` interrupts the duty cycle is
+ * held, like the control task does on an I2C error.
+ *
+ * The load PWM is written with ledc_set_duty() and ledc_update_duty(), which
+ * are placed in IRAM by CONFIG_LEDC_CTRL_FUNC_IN_IRAM.
+ *
+ * In dynamic mode the interrupt also steps the waveform generator, so the
+ * current reference changes on the interrupt tick rather than on a sample.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+static const char *TAG = "FAST_CONTROL"; /**< Tag for logging messages from the fast control path. */
+
+#define FAST_CONTROL_GAIN_SHIFT 24                                                        /**< Fixed point scale of the gains and integrator. */
+#define FAST_CONTROL_DUTY_MAX ((1 << PWM_TIMER_RESOLUTION) - 1)                           /**< Largest PWM duty value. */
+
+/**
+ * @brief State shared between the timer interrupt and the tasks.
+ */
+typedef struct
+{
+    volatile bool active;            /**< true while the kernel regulates. */
+    volatile int32_t setpoint;       /**< Setpoint in current LSBs. */
+    volatile int32_t measured;       /**< Latest current reading in current LSBs. */
+    volatile uint32_t samples;       /**< Incremented by the measurement task after every reading. */
+    uint32_t samples_seen;           /**< Value of samples at the previous interrupt. */
+    uint32_t ticks_since_sample;     /**< Interrupts since the last new reading. */
+    int32_t kp;                      /**< Proportional gain, PWM counts per LSB << FAST_CONTROL_GAIN_SHIFT. */
+    int32_t ki;                      /**< Integral gain per interrupt, PWM counts per LSB << FAST_CONTROL_GAIN_SHIFT. */
+    int64_t integral;                /**< Integrator, PWM counts << FAST_CONTROL_GAIN_SHIFT. */
+    uint32_t last_cycles;            /**< CPU cycle count at the previous interrupt, 0 after a start. */
+    volatile bool dynamic_enabled;   /**< true if the setpoint comes from the dynamic mode generator. */
+    DynamicLoad dynamic;             /**< Dynamic mode waveform generator. */
+    volatile uint32_t dynamic_triggers; /**< Incremented by the control task for every dynamic mode trigger. */
+    uint32_t dynamic_triggers_seen;  /**< Value of dynamic_triggers handled by the generator. */
+    int32_t lsb_per_ua;              /**< Current LSBs per uA << 32, converts the generator output to a setpoint. */
+    volatile int32_t dynamic_scale;  /**< Fraction of the generator output used as the setpoint, Q16, below 1 while the SOA derates. */
+    FastControlStatistics statistics; /**< Timing statistics. */
+} FastControl;
+
+static FastControl fast_control = {0};      /**< The fast control state. */
+static gptimer_handle_t fast_control_timer; /**< Timer driving the kernel. */
+static portMUX_TYPE fast_control_lock = portMUX_INITIALIZER_UNLOCKED; /**< Protects the statistics copy and the dynamic mode generator. */
+
+/**
+ * @brief Record the time since the previous interrupt in the jitter histogram.
+ */
+static inline void IRAM_ATTR fast_control_record_period(void)
+{
+    uint32_t now = esp_cpu_get_cycle_count();
+    if (fast_control.last_cycles != 0)
+    {
+        uint32_t period_us = (now - fast_control.last_cycles) / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+        int32_t bin = (int32_t)period_us - FAST_CONTROL_PERIOD_US + FAST_CONTROL_JITTER_BINS / 2;
+        bin = (bin < 0) ? 0 : ((bin >= FAST_CONTROL_JITTER_BINS) ? FAST_CONTROL_JITTER_BINS - 1 : bin);
+        fast_control.statistics.jitter_histogram[bin]++;
+
+        if (period_us < fast_control.statistics.period_min_us)
+        {
+            fast_control.statistics.period_min_us = period_us;
+        }
+        if (period_us > fast_control.statistics.period_max_us)
+        {
+            fast_control.statistics.period_max_us = period_us;
+        }
+    }
+    fast_control.last_cycles = now;
+}
+
+/**
+ * @brief Timer alarm callback, runs the PI kernel.
+ *
+ * @return false, no task is woken.
+ */
+static bool IRAM_ATTR fast_control_on_alarm(gptimer_handle_t timer, const gptimer_alarm_event_data_t *edata, void *user_ctx)
+{
+    portENTER_CRITICAL_ISR(&fast_control_lock);
+    fast_control_record_period();
+    fast_control.statistics.ticks++;
+
+    // After a hardware trip the PWM stays at the zero written by the protection interrupt
+    if (!fast_control.active || hw_protection_tripped())
+    {
+        portEXIT_CRITICAL_ISR(&fast_control_lock);
+        return false;
+    }
+
+    // Step the dynamic mode waveform every interrupt, also while the duty cycle is held, so it keeps its timing
+    if (fast_control.dynamic_enabled)
+    {
+        uint32_t triggers = fast_control.dynamic_triggers;
+        if (triggers != fast_control.dynamic_triggers_seen)
+        {
+            fast_control.dynamic_triggers_seen = triggers;
+            dynamic_load_trigger(&fast_control.dynamic);
+        }
+        int64_t reference_ua = ((int64_t)dynamic_load_step(&fast_control.dynamic, FAST_CONTROL_PERIOD_US) * fast_control.dynamic_scale) >> 16;
+        fast_control.setpoint = (int32_t)((reference_ua * fast_control.lsb_per_ua) >> 32);
+    }
+
+    // Hold the duty cycle if the measurement task stopped delivering readings
+    uint32_t samples = fast_control.samples;
+    if (samples != fast_control.samples_seen)
+    {
+        fast_control.samples_seen = samples;
+        fast_control.ticks_since_sample = 0;
+    }
+    else if (++fast_control.ticks_since_sample > FAST_CONTROL_STALE_TICKS)
+    {
+        fast_control.statistics.stale_ticks++;
+        portEXIT_CRITICAL_ISR(&fast_control_lock);
+        return false;
+    }
+    portEXIT_CRITICAL_ISR(&fast_control_lock);
+
+    int32_t error = fast_control.setpoint - fast_control.measured;
+
+    // Integrate and clamp the integrator to the PWM range
+    fast_control.integral += (int64_t)fast_control.ki * error;
+    if (fast_control.integral > ((int64_t)FAST_CONTROL_DUTY_MAX << FAST_CONTROL_GAIN_SHIFT))
+    {
+        fast_control.integral = (int64_t)FAST_CONTROL_DUTY_MAX << FAST_CONTROL_GAIN_SHIFT;
+    }
+    else if (fast_control.integral < 0)
+    {
+        fast_control.integral = 0;
+    }
+
+    // Calculate and clamp the duty cycle
+    int64_t output = ((int64_t)fast_control.kp * error + fast_control.integral) >> FAST_CONTROL_GAIN_SHIFT;
+    uint32_t duty = (output < 0) ? 0 : ((output > FAST_CONTROL_DUTY_MAX) ? FAST_CONTROL_DUTY_MAX : (uint32_t)output);
+
+    ledc_set_duty(PWM_SPEED_MODE, PWM_CHANNEL_LOAD, duty);
+    ledc_update_duty(PWM_SPEED_MODE, PWM_CHANNEL_LOAD);
+    return false;
+}
+
+/**
+ * @brief Create the fast control timer.
+ *
+ * Must be called from the task that owns the load PWM, the interrupt is
+ * allocated on its core.
+ *
+ * @details The gains are converted from % duty per A to PWM counts per current LSB here, in task context.
+ */
+void fast_control_init(void)
+{
+    const double counts_per_lsb = (FAST_CONTROL_DUTY_MAX / 100.0) * INA237_CURRENT_LSB;
+    fast_control.kp = (int32_t)(FAST_CONTROL_KP * counts_per_lsb * (1 << FAST_CONTROL_GAIN_SHIFT));
+    fast_control.ki = (int32_t)(FAST_CONTROL_KI * counts_per_lsb * (FAST_CONTROL_PERIOD_US / 1000000.0) * (1 << FAST_CONTROL_GAIN_SHIFT));
+    fast_control.lsb_per_ua = (int32_t)(0.000001 / INA237_CURRENT_LSB * 4294967296.0);
+    fast_control.dynamic_scale = 1 << 16;
+
+    gptimer_config_t timer_config = {
+        .clk_src = GPTIMER_CLK_SRC_DEFAULT,
+        .direction = GPTIMER_COUNT_UP,
+        .resolution_hz = 1000000,
+    };
+    ESP_ERROR_CHECK(gptimer_new_timer(&timer_config, &fast_control_timer));
+
+    gptimer_event_callbacks_t callbacks = {
+        .on_alarm = fast_control_on_alarm,
+    };
+    ESP_ERROR_CHECK(gptimer_register_event_callbacks(fast_control_timer, &callbacks, NULL));
+    ESP_ERROR_CHECK(gptimer_enable(fast_control_timer));
+
+    gptimer_alarm_config_t alarm_config = {
+        .alarm_count = FAST_CONTROL_PERIOD_US,
+        .reload_count = 0,
+        .flags.auto_reload_on_alarm = true,
+    };
+    ESP_ERROR_CHECK(gptimer_set_alarm_action(fast_control_timer, &alarm_config));
+    ESP_LOGI(TAG, "Fast control path ready, %d us period, Kp = %ld, Ki = %ld (Q%d)",
+             FAST_CONTROL_PERIOD_US, fast_control.kp, fast_control.ki, FAST_CONTROL_GAIN_SHIFT);
+}
+
+/**
+ * @brief Start regulating the load current from the timer interrupt.
+ *
+ * The integrator starts from the current PWM duty, so the hand-over from the
+ * control task does not cause a step. The jitter histogram restarts.
+ */
+void fast_control_start(void)
+{
+    if (fast_control.active)
+    {
+        return;
+    }
+
+    taskENTER_CRITICAL(&fast_control_lock);
+    fast_control.integral = (int64_t)ledc_get_duty(PWM_SPEED_MODE, PWM_CHANNEL_LOAD) << FAST_CONTROL_GAIN_SHIFT;
+    fast_control.samples_seen = fast_control.samples;
+    fast_control.ticks_since_sample = 0;
+    fast_control.last_cycles = 0;
+    fast_control.statistics.period_min_us = UINT32_MAX;
+    fast_control.statistics.period_max_us = 0;
+    memset(fast_control.statistics.jitter_histogram, 0, sizeof(fast_control.statistics.jitter_histogram));
+    fast_control.active = true;
+    taskEXIT_CRITICAL(&fast_control_lock);
+
+    ESP_ERROR_CHECK(gptimer_start(fast_control_timer));
+    ESP_LOGI(TAG, "Fast control started");
+}
+
+/**
+ * @brief Stop the timer interrupt, the duty cycle is left where it was.
+ */
+void fast_control_stop(void)
+{
+    if (!fast_control.active)
+    {
+        return;
+    }
+
+    ESP_ERROR_CHECK(gptimer_stop(fast_control_timer));
+    fast_control.active = false;
+    ESP_LOGI(TAG, "Fast control stopped");
+}
+
+/**
+ * @brief Check if the fast path is regulating.
+ *
+ * @return true between fast_control_start() and fast_control_stop().
+ */
+bool fast_control_active(void)
+{
+    return fast_control.active;
+}
+
+/**
+ * @brief Set the current setpoint of the fast path.
+ *
+ * Stops the dynamic mode generator.
+ *
+ * @param current The setpoint (A).
+ */
+void fast_control_set_setpoint(float current)
+{
+    fast_control.dynamic_enabled = false;
+    fast_control.setpoint = (int32_t)(current / INA237_CURRENT_LSB);
+}
+
+/**
+ * @brief Take the setpoint of the fast path from the dynamic mode generator.
+ *
+ * The waveform restarts at level 1.
+ *
+ * @param config The waveform.
+ */
+void fast_control_set_dynamic(const DynamicConfig *config)
+{
+    taskENTER_CRITICAL(&fast_control_lock);
+    dynamic_load_init(&fast_control.dynamic, config);
+    fast_control.dynamic_triggers_seen = fast_control.dynamic_triggers;
+    int64_t reference_ua = ((int64_t)fast_control.dynamic.reference_ua * fast_control.dynamic_scale) >> 16;
+    fast_control.setpoint = (int32_t)((reference_ua * fast_control.lsb_per_ua) >> 32);
+    fast_control.dynamic_enabled = true;
+    taskEXIT_CRITICAL(&fast_control_lock);
+}
+
+/**
+ * @brief Trigger the dynamic mode generator of the fast path.
+ */
+void fast_control_trigger_dynamic(void)
+{
+    fast_control.dynamic_triggers++;
+}
+
+/**
+ * @brief Scale the output of the dynamic mode generator of the fast path.
+ *
+ * The control task scales the other setpoints itself, the generator of the
+ * fast path runs on the interrupt tick and is scaled here.
+ *
+ * @param scale Fraction of the generator output used as the setpoint, 0 to 1.
+ */
+void fast_control_set_dynamic_scale(float scale)
+{
+    fast_control.dynamic_scale = (int32_t)(scale * 65536.0f);
+}
+
+/**
+ * @brief Hand a new INA237 current reading to the fast path.
+ *
+ * @param raw_current The CURRENT register, in INA237_CURRENT_LSB.
+ *
+ * @details The reading is stored before the sample count, both are single words, so the interrupt never needs a lock to read them.
+ */
+void fast_control_feed(int16_t raw_current)
+{
+    fast_control.measured = raw_current;
+    fast_control.samples++;
+}
+
+/**
+ * @brief Copy the timing statistics of the fast path.
+ *
+ * @param statistics Output, the statistics.
+ */
+void fast_control_get_statistics(FastControlStatistics *statistics)
+{
+    taskENTER_CRITICAL(&fast_control_lock);
+    *statistics = fast_control.statistics;
+    taskEXIT_CRITICAL(&fast_control_lock);
+}
@@ -0,0 +1,103 @@
+#ifndef FAST_CONTROL_H
+#define FAST_CONTROL_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "globals.h"
+#include "config.h"
+
+/**
+ * @file fast_control.h
+ * @brief Header file for the fast constant current control path.
+ *
+ * This file contains the declarations for a constant current regulator that
+ * runs from a hardware timer interrupt at a fixed rate, independent of the
+ * FreeRTOS tick and the control task.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Timing statistics of the fast control interrupt.
+ */
+typedef struct
+{
+    uint32_t ticks;                                /**< Interrupts since start-up. */
+    uint32_t stale_ticks;                          /**< Interrupts that held the duty cycle because no new sample arrived in time. */
+    uint32_t period_min_us;                        /**< Shortest time between two interrupts since the last start (us). */
+    uint32_t period_max_us;                        /**< Longest time between two interrupts since the last start (us). */
+    uint32_t jitter_histogram[FAST_CONTROL_JITTER_BINS]; /**< Interrupt periods in 1 us bins, the centre bin is FAST_CONTROL_PERIOD_US. */
+} FastControlStatistics;
+
+/**
+ * @brief Create the fast control timer.
+ *
+ * Must be called from the task that owns the load PWM, the interrupt is
+ * allocated on its core.
+ */
+void fast_control_init(void);
+
+/**
+ * @brief Start regulating the load current from the timer interrupt.
+ *
+ * Does nothing if the fast path is already running.
+ */
+void fast_control_start(void);
+
+/**
+ * @brief Stop the timer interrupt, the duty cycle is left where it was.
+ *
+ * Does nothing if the fast path is not running.
+ */
+void fast_control_stop(void);
+
+/**
+ * @brief Check if the fast path is regulating.
+ *
+ * @return true between fast_control_start() and fast_control_stop().
+ */
+bool fast_control_active(void);
+
+/**
+ * @brief Set the current setpoint of the fast path.
+ *
+ * @param current The setpoint (A).
+ */
+void fast_control_set_setpoint(float current);
+
+/**
+ * @brief Take the setpoint of the fast path from the dynamic mode generator.
+ *
+ * The waveform restarts at level 1, fast_control_set_setpoint() stops it.
+ *
+ * @param config The waveform.
+ */
+void fast_control_set_dynamic(const DynamicConfig *config);
+
+/**
+ * @brief Trigger the dynamic mode generator of the fast path.
+ */
+void fast_control_trigger_dynamic(void);
+
+/**
+ * @brief Scale the output of the dynamic mode generator of the fast path.
+ *
+ * @param scale Fraction of the generator output used as the setpoint, 0 to 1.
+ */
+void fast_control_set_dynamic_scale(float scale);
+
+/**
+ * @brief Hand a new INA237 current reading to the fast path.
+ *
+ * @param raw_current The CURRENT register, in INA237_CURRENT_LSB.
+ */
+void fast_control_feed(int16_t raw_current);
+
+/**
+ * @brief Copy the timing statistics of the fast path.
+ *
+ * @param statistics Output, the statistics.
+ */
+void fast_control_get_statistics(FastControlStatistics *statistics);
+
+#endif // FAST_CONTROL_H
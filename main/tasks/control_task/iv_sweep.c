@@ -0,0 +1,285 @@
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "iv_sweep.h"
+
+/**
+ * @file iv_sweep.c
+ * @brief Implementation of the I-V sweep engine.
+ *
+ * The control task calls iv_sweep_step() once per sample. The first point is
+ * taken at 0 A and gives the open-circuit voltage. A CC sweep then steps the
+ * current up to the configured maximum, a CV sweep steps the voltage down from
+ * the open-circuit voltage to 0 V. Either ends early once a point is below
+ * SWEEP_SHORT_CIRCUIT_FRACTION of the open-circuit voltage, since the source
+ * is then shorted and further points would all be the same.
+ *
+ * A point has settled once the regulated value, the current of a CC point or
+ * the voltage of a CV point, is within the tolerance of its reference, and the
+ * voltage and the current have stayed within the tolerance of where they were
+ * for SWEEP_SETTLE_WINDOW_US. Both are fractions of full scale. A signal that
+ * only moves slowly is therefore not taken for a settled one, it has to be at
+ * the reference and stay there. The settling sample and the ones after it are
+ * averaged. A point that does not settle within the timeout of the settings,
+ * SWEEP_SETTLE_TIMEOUT_US by default, is recorded anyway and flagged, so a
+ * slow loop cannot stall the sweep.
+ *
+ * The curve is shared between the control task and the HTTP server and
+ * protected by a spinlock.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+static const char *TAG = "IV_SWEEP"; /**< Tag for logging messages from the I-V sweep engine. */
+
+/**
+ * @brief Curve and sweep state.
+ */
+typedef struct
+{
+    SweepConfig config;            /**< Settings for the next sweep. */
+    SweepReport report;            /**< The curve of the running or last sweep. */
+    bool started;                  /**< true once the first sample of the sweep has been handled. */
+    uint32_t index;                /**< Point being measured. */
+    int64_t start_us;              /**< Timestamp of the first sample of the sweep (us). */
+    int64_t point_start_us;        /**< Timestamp the reference of the point was applied on (us). */
+    float open_circuit_voltage;    /**< Voltage of the first point (V). */
+    bool window_valid;             /**< true once a steady window has been started for this point. */
+    int64_t window_start_us;       /**< Timestamp of the first sample of the steady window (us). */
+    float window_voltage;          /**< Voltage of the first sample of the steady window (V). */
+    float window_current;          /**< Current of the first sample of the steady window (A). */
+    bool averaging;                /**< true once the point has settled or timed out. */
+    bool settled;                  /**< true if the point settled before the timeout. */
+    float voltage_sum;             /**< Sum of the averaged voltages (V). */
+    float current_sum;             /**< Sum of the averaged currents (A). */
+    float power_sum;               /**< Sum of the averaged powers (W). */
+    uint32_t average_samples;      /**< Samples in the sums. */
+} IvSweep;
+
+static IvSweep iv_sweep = {
+    .config = {.reference = MODE_CC, .points = 50, .max_current = 1.0f, .settle_tolerance = 0.01f,
+               .settle_timeout_us = SWEEP_SETTLE_TIMEOUT_US},
+}; /**< The I-V sweep engine. */
+static portMUX_TYPE iv_sweep_lock = portMUX_INITIALIZER_UNLOCKED; /**< Protects the I-V sweep engine. */
+
+/**
+ * @brief Replace the settings, used from the next sweep on.
+ *
+ * @param config The new settings.
+ */
+void iv_sweep_configure(const SweepConfig *config)
+{
+    taskENTER_CRITICAL(&iv_sweep_lock);
+    iv_sweep.config = *config;
+    taskEXIT_CRITICAL(&iv_sweep_lock);
+
+    ESP_LOGI(TAG, "Configured %s sweep, %lu points, tolerance %.3f, timeout %lu us",
+             (config->reference == MODE_CV) ? "CV" : "CC", config->points, config->settle_tolerance,
+             config->settle_timeout_us);
+}
+
+/**
+ * @brief Start a new sweep on the next sample.
+ */
+void iv_sweep_restart(void)
+{
+    taskENTER_CRITICAL(&iv_sweep_lock);
+    iv_sweep.started = false;
+    taskEXIT_CRITICAL(&iv_sweep_lock);
+}
+
+/**
+ * @brief Start measuring the next point.
+ *
+ * Must be called with the lock taken.
+ *
+ * @param timestamp_us Timestamp of the sample the reference of the point is applied on (us).
+ */
+static void iv_sweep_next_point_locked(int64_t timestamp_us)
+{
+    iv_sweep.point_start_us = timestamp_us;
+    iv_sweep.window_valid = false;
+    iv_sweep.averaging = false;
+    iv_sweep.settled = false;
+    iv_sweep.voltage_sum = 0.0f;
+    iv_sweep.current_sum = 0.0f;
+    iv_sweep.power_sum = 0.0f;
+    iv_sweep.average_samples = 0;
+}
+
+/**
+ * @brief Get the reference of the point being measured.
+ *
+ * Must be called with the lock taken.
+ *
+ * @param mode Output, the mode to regulate in.
+ * @param setpoint Output, the reference in the unit of the mode.
+ */
+static void iv_sweep_reference_locked(ControlMode *mode, float *setpoint)
+{
+    const SweepConfig *config = &iv_sweep.report.config;
+    float fraction = (float)iv_sweep.index / (float)(config->points - 1);
+
+    // The open-circuit point, and anything after the sweep, draws nothing
+    *mode = MODE_CC;
+    *setpoint = 0.0f;
+    if ((iv_sweep.report.state != SWEEP_RUNNING) || (iv_sweep.index == 0))
+    {
+        return;
+    }
+
+    if (config->reference == MODE_CV)
+    {
+        *mode = MODE_CV;
+        *setpoint = iv_sweep.open_circuit_voltage * (1.0f - fraction);
+    }
+    else
+    {
+        *setpoint = config->max_current * fraction;
+    }
+}
+
+/**
+ * @brief Run the sweep for one sample.
+ *
+ * @param measurements The sample.
+ * @param mode Output, the mode to regulate in.
+ * @param setpoint Output, the reference in the unit of the mode.
+ * @return true while sweeping, false once the curve is complete.
+ */
+bool iv_sweep_step(const MeasurementData *measurements, ControlMode *mode, float *setpoint)
+{
+    taskENTER_CRITICAL(&iv_sweep_lock);
+    SweepReport *report = &iv_sweep.report;
+    const SweepConfig *config = &report->config;
+    bool finished = false;
+
+    if (!iv_sweep.started)
+    {
+        iv_sweep.started = true;
+        report->config = iv_sweep.config;
+        report->state = SWEEP_RUNNING;
+        report->count = 0;
+        report->mpp = 0;
+        report->duration_us = 0;
+        iv_sweep.index = 0;
+        iv_sweep.start_us = measurements->timestamp_us;
+        iv_sweep_next_point_locked(measurements->timestamp_us);
+    }
+
+    if (report->state == SWEEP_RUNNING)
+    {
+        if (!iv_sweep.averaging)
+        {
+            // Full scale is the open-circuit voltage once it is known, and the swept current range
+            float voltage_scale = (iv_sweep.index == 0) ? MAX_VOLTAGE : iv_sweep.open_circuit_voltage;
+            float current_scale = (config->reference == MODE_CV) ? MAX_CURRENT : config->max_current;
+            float voltage_tolerance = config->settle_tolerance * voltage_scale;
+            float current_tolerance = config->settle_tolerance * current_scale;
+
+            // The regulated value has to be at the reference of the point, not only moving slowly
+            ControlMode point_mode;
+            float reference;
+            iv_sweep_reference_locked(&point_mode, &reference);
+            bool tracking = (point_mode == MODE_CV) ? (fabsf(measurements->bus_voltage - reference) <= voltage_tolerance)
+                                                    : (fabsf(measurements->current - reference) <= current_tolerance);
+
+            // And it has to stay there, the window starts over on every sample that is off the reference or has
+            // moved away from the start of the window
+            bool steady = iv_sweep.window_valid &&
+                          (fabsf(measurements->bus_voltage - iv_sweep.window_voltage) <= voltage_tolerance) &&
+                          (fabsf(measurements->current - iv_sweep.window_current) <= current_tolerance);
+            if (!tracking || !steady)
+            {
+                iv_sweep.window_valid = tracking;
+                iv_sweep.window_start_us = measurements->timestamp_us;
+                iv_sweep.window_voltage = measurements->bus_voltage;
+                iv_sweep.window_current = measurements->current;
+            }
+            iv_sweep.settled = tracking && steady && (measurements->timestamp_us - iv_sweep.window_start_us >= SWEEP_SETTLE_WINDOW_US);
+            iv_sweep.averaging = iv_sweep.settled || (measurements->timestamp_us - iv_sweep.point_start_us >= config->settle_timeout_us);
+        }
+
+        if (iv_sweep.averaging)
+        {
+            iv_sweep.voltage_sum += measurements->bus_voltage;
+            iv_sweep.current_sum += measurements->current;
+            iv_sweep.power_sum += measurements->power;
+            iv_sweep.average_samples++;
+        }
+
+        if (iv_sweep.average_samples >= SWEEP_AVERAGE_SAMPLES)
+        {
+            SweepPoint *point = &report->points[report->count];
+            point->voltage = iv_sweep.voltage_sum / iv_sweep.average_samples;
+            point->current = iv_sweep.current_sum / iv_sweep.average_samples;
+            point->power = iv_sweep.power_sum / iv_sweep.average_samples;
+            point->settled = iv_sweep.settled;
+            if (point->power > report->points[report->mpp].power)
+            {
+                report->mpp = report->count;
+            }
+            report->count++;
+
+            if (iv_sweep.index == 0)
+            {
+                iv_sweep.open_circuit_voltage = point->voltage;
+            }
+
+            bool shorted = (iv_sweep.index > 0) && (point->voltage < SWEEP_SHORT_CIRCUIT_FRACTION * iv_sweep.open_circuit_voltage);
+            if (shorted || (iv_sweep.index + 1 >= config->points))
+            {
+                report->state = SWEEP_FINISHED;
+                report->duration_us = measurements->timestamp_us - iv_sweep.start_us;
+                finished = true;
+            }
+            else
+            {
+                iv_sweep.index++;
+                iv_sweep_next_point_locked(measurements->timestamp_us);
+            }
+        }
+    }
+
+    iv_sweep_reference_locked(mode, setpoint);
+    bool running = report->state == SWEEP_RUNNING;
+    uint32_t count = report->count;
+    int64_t duration_us = report->duration_us;
+    SweepPoint mpp = report->points[report->mpp];
+    taskEXIT_CRITICAL(&iv_sweep_lock);
+
+    if (finished)
+    {
+        ESP_LOGI(TAG, "Sweep of %lu points in %lld us, maximum power %.3f W at %.3f V, %.3f A", count, duration_us,
+                 mpp.power, mpp.voltage, mpp.current);
+    }
+    return running;
+}
+
+/**
+ * @brief Abort a running sweep, called when the load stops.
+ */
+void iv_sweep_stop(void)
+{
+    taskENTER_CRITICAL(&iv_sweep_lock);
+    if (iv_sweep.report.state == SWEEP_RUNNING)
+    {
+        iv_sweep.report.state = SWEEP_ABORTED;
+    }
+    iv_sweep.started = false;
+    taskEXIT_CRITICAL(&iv_sweep_lock);
+}
+
+/**
+ * @brief Copy the result of the sweep.
+ *
+ * @param report Output, the result.
+ */
+void iv_sweep_get_report(SweepReport *report)
+{
+    taskENTER_CRITICAL(&iv_sweep_lock);
+    *report = iv_sweep.report;
+    taskEXIT_CRITICAL(&iv_sweep_lock);
+}
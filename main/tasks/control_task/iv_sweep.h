@@ -0,0 +1,104 @@
+#ifndef IV_SWEEP_H
+#define IV_SWEEP_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "globals.h"
+#include "config.h"
+
+/**
+ * @file iv_sweep.h
+ * @brief Header file for the I-V sweep engine.
+ *
+ * This file contains the declarations for sweeping the load from open circuit
+ * to short circuit in a number of points, with a current (CC) or a voltage (CV)
+ * reference. Each point waits for the load to settle on its reference and
+ * averages a few samples, so a whole curve takes seconds and the source, such
+ * as a solar panel, barely changes during it. The curve is kept with its
+ * maximum power point until the next sweep.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Settings of an I-V sweep.
+ */
+typedef struct
+{
+    ControlMode reference;  /**< Reference swept, MODE_CC from 0 A up or MODE_CV from open circuit down. */
+    uint32_t points;        /**< Number of points, including the open-circuit point. */
+    float max_current;      /**< Current of the last point of a CC sweep (A). */
+    float settle_tolerance; /**< Largest distance from the reference, and drift over SWEEP_SETTLE_WINDOW_US, of a settled point, as a fraction of full scale. */
+    uint32_t settle_timeout_us; /**< Longest wait for a point to settle, it is recorded as unsettled after (us). */
+} SweepConfig;
+
+/**
+ * @brief State of an I-V sweep.
+ */
+typedef enum
+{
+    SWEEP_IDLE,     /**< No sweep has run. */
+    SWEEP_RUNNING,  /**< Sweeping. */
+    SWEEP_FINISHED, /**< The curve is complete. */
+    SWEEP_ABORTED,  /**< The load stopped before the curve was complete. */
+} SweepState;
+
+/**
+ * @brief One point of an I-V curve.
+ */
+typedef struct
+{
+    float voltage; /**< Averaged bus voltage (V). */
+    float current; /**< Averaged current (A). */
+    float power;   /**< Averaged power (W). */
+    bool settled;  /**< false if the point was recorded after the settle timeout without settling. */
+} SweepPoint;
+
+/**
+ * @brief Result of an I-V sweep.
+ */
+typedef struct
+{
+    SweepConfig config;                   /**< Settings of the sweep. */
+    SweepState state;                     /**< State of the sweep. */
+    uint32_t count;                       /**< Points recorded. */
+    SweepPoint points[SWEEP_MAX_POINTS];  /**< The curve, from open circuit. */
+    uint32_t mpp;                         /**< Index of the maximum power point. */
+    int64_t duration_us;                  /**< Time from the first to the last sample of the sweep (us). */
+} SweepReport;
+
+/**
+ * @brief Replace the settings, used from the next sweep on.
+ *
+ * @param config The new settings.
+ */
+void iv_sweep_configure(const SweepConfig *config);
+
+/**
+ * @brief Start a new sweep on the next sample.
+ */
+void iv_sweep_restart(void);
+
+/**
+ * @brief Run the sweep for one sample.
+ *
+ * @param measurements The sample.
+ * @param mode Output, the mode to regulate in.
+ * @param setpoint Output, the reference in the unit of the mode.
+ * @return true while sweeping, false once the curve is complete.
+ */
+bool iv_sweep_step(const MeasurementData *measurements, ControlMode *mode, float *setpoint);
+
+/**
+ * @brief Abort a running sweep, called when the load stops.
+ */
+void iv_sweep_stop(void);
+
+/**
+ * @brief Copy the result of the sweep.
+ *
+ * @param report Output, the result.
+ */
+void iv_sweep_get_report(SweepReport *report);
+
+#endif // IV_SWEEP_H
@@ -0,0 +1,174 @@
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_log.h"
+#include "list_mode.h"
+
+/**
+ * @file list_mode.c
+ * @brief Implementation of the list mode sequence engine.
+ *
+ * The control task calls list_mode_step() once per sample with the conversion
+ * timestamp. Step boundaries are scheduled from the start of the run by adding
+ * the dwell times, not from the sample a step was applied on, so the sample
+ * period only adds jitter to a boundary and never drift. The sample a step was
+ * applied on and the time it was scheduled for are both kept, so the delay can
+ * be checked.
+ *
+ * The number of steps started in the run is stamped into every sample by the
+ * measurement task, so a transition shows up in the sample stream as a change
+ * of list_step, with the timestamp of the first sample taken under the new
+ * step. The count keeps going up across passes, so every transition is unique.
+ *
+ * The list is written by the HTTP server and read by the control task under a
+ * spinlock. The stamp is a single atomic word, so the measurement task reads it
+ * without the lock.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+static const char *TAG = "LIST_MODE"; /**< Tag for logging messages from the list mode engine. */
+
+/**
+ * @brief List and run state.
+ */
+typedef struct
+{
+    ListProgram program;          /**< The loaded list. */
+    ListStatus status;            /**< State of the run. */
+    int64_t step_end_us;          /**< Time the current step is scheduled to end (us). */
+    atomic_uint_least32_t stamp;  /**< Value stamped in the samples, steps started or 0. */
+} ListMode;
+
+static ListMode list_mode = {0};                                  /**< The list mode engine. */
+static portMUX_TYPE list_mode_lock = portMUX_INITIALIZER_UNLOCKED; /**< Protects the list mode engine. */
+
+/**
+ * @brief Clear the run, the next step call starts at the first step.
+ *
+ * Must be called with the lock taken.
+ */
+static void list_mode_clear_locked(void)
+{
+    list_mode.status.running = false;
+    list_mode.status.finished = false;
+    list_mode.status.step = 0;
+    list_mode.status.pass = 0;
+    list_mode.status.steps_started = 0;
+    atomic_store_explicit(&list_mode.stamp, 0, memory_order_relaxed);
+}
+
+/**
+ * @brief Replace the loaded list, a run in progress restarts at the first step.
+ *
+ * @param program The new list.
+ */
+void list_mode_load(const ListProgram *program)
+{
+    taskENTER_CRITICAL(&list_mode_lock);
+    list_mode.program = *program;
+    list_mode.status.loaded = program->count > 0;
+    list_mode.status.count = program->count;
+    list_mode.status.repeat = program->repeat;
+    list_mode_clear_locked();
+    taskEXIT_CRITICAL(&list_mode_lock);
+
+    ESP_LOGI(TAG, "Loaded %lu steps, repeat %lu", program->count, program->repeat);
+}
+
+/**
+ * @brief End a run, the next step call starts a new one at the first step.
+ *
+ * The samples are not stamped until then.
+ */
+void list_mode_restart(void)
+{
+    taskENTER_CRITICAL(&list_mode_lock);
+    list_mode_clear_locked();
+    taskEXIT_CRITICAL(&list_mode_lock);
+}
+
+/**
+ * @brief Advance the run to the time of a sample.
+ *
+ * @param timestamp_us Conversion timestamp of the sample (us).
+ * @param mode Output, the mode of the current step.
+ * @param setpoint Output, the setpoint of the current step.
+ * @return true while running, false if no list is loaded or the run has finished.
+ */
+bool list_mode_step(int64_t timestamp_us, ControlMode *mode, float *setpoint)
+{
+    taskENTER_CRITICAL(&list_mode_lock);
+    const ListProgram *program = &list_mode.program;
+    ListStatus *status = &list_mode.status;
+    if (program->count == 0)
+    {
+        taskEXIT_CRITICAL(&list_mode_lock);
+        return false;
+    }
+
+    // The first sample of a run applies the first step
+    if (!status->running)
+    {
+        status->running = true;
+        status->steps_started = 1;
+        status->step_started_us = timestamp_us;
+        status->step_scheduled_us = timestamp_us;
+        list_mode.step_end_us = timestamp_us + program->steps[0].dwell_us;
+        atomic_store_explicit(&list_mode.stamp, status->steps_started, memory_order_relaxed);
+    }
+
+    // Move on by as many steps as have ended. LIST_MIN_DWELL_US keeps every step long enough to be applied on at least one sample.
+    while (!status->finished && (timestamp_us >= list_mode.step_end_us))
+    {
+        if (status->step + 1 < program->count)
+        {
+            status->step++;
+        }
+        else if ((program->repeat == 0) || (status->pass + 1 < program->repeat))
+        {
+            status->step = 0;
+            status->pass++;
+        }
+        else
+        {
+            status->finished = true;
+            break;
+        }
+
+        status->step_scheduled_us = list_mode.step_end_us;
+        status->step_started_us = timestamp_us;
+        status->steps_started++;
+        list_mode.step_end_us += program->steps[status->step].dwell_us;
+        atomic_store_explicit(&list_mode.stamp, status->steps_started, memory_order_relaxed);
+    }
+
+    *mode = program->steps[status->step].mode;
+    *setpoint = program->steps[status->step].setpoint;
+    bool running = !status->finished;
+    taskEXIT_CRITICAL(&list_mode_lock);
+    return running;
+}
+
+/**
+ * @brief Get the value to stamp in the samples.
+ *
+ * @return Steps started in the current run, 0 outside a run.
+ */
+uint32_t list_mode_stamp(void)
+{
+    return atomic_load_explicit(&list_mode.stamp, memory_order_relaxed);
+}
+
+/**
+ * @brief Copy the state of the run.
+ *
+ * @param status Output, the state.
+ */
+void list_mode_get_status(ListStatus *status)
+{
+    taskENTER_CRITICAL(&list_mode_lock);
+    *status = list_mode.status;
+    taskEXIT_CRITICAL(&list_mode_lock);
+}
@@ -0,0 +1,96 @@
+#ifndef LIST_MODE_H
+#define LIST_MODE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "globals.h"
+#include "config.h"
+
+/**
+ * @file list_mode.h
+ * @brief Header file for the list mode sequence engine.
+ *
+ * This file contains the declarations for running a list of (mode, setpoint,
+ * dwell time) steps on the device. During a run the engine owns the mode and
+ * the setpoint, and advances on the sample timestamps, so the step timing does
+ * not depend on the network.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief One step of a list.
+ */
+typedef struct
+{
+    ControlMode mode;  /**< Control mode of the step, CC, CV, CP or CR. */
+    float setpoint;    /**< Setpoint in the unit of the mode. */
+    uint32_t dwell_us; /**< Time the step lasts (us). */
+} ListStep;
+
+/**
+ * @brief A list of steps.
+ */
+typedef struct
+{
+    ListStep steps[LIST_MAX_STEPS]; /**< The steps, run in order. */
+    uint32_t count;                 /**< Number of steps. */
+    uint32_t repeat;                /**< Times the list is run, 0 repeats until stopped. */
+} ListProgram;
+
+/**
+ * @brief State of a list mode run.
+ */
+typedef struct
+{
+    bool loaded;               /**< true if a list is loaded. */
+    uint32_t count;            /**< Number of steps in the list. */
+    uint32_t repeat;           /**< Times the list is run, 0 repeats until stopped. */
+    bool running;              /**< true during a run. */
+    bool finished;             /**< true once the last step of the last pass has ended. */
+    uint32_t step;             /**< Index of the current step. */
+    uint32_t pass;             /**< Pass through the list, from 0. */
+    uint32_t steps_started;    /**< Steps started in this run, the value stamped in the samples. */
+    int64_t step_started_us;   /**< Timestamp of the sample the current step was applied on (us). */
+    int64_t step_scheduled_us; /**< Time the current step was scheduled to start (us). */
+} ListStatus;
+
+/**
+ * @brief Replace the loaded list, a run in progress restarts at the first step.
+ *
+ * @param program The new list.
+ */
+void list_mode_load(const ListProgram *program);
+
+/**
+ * @brief End a run, the next step call starts a new one at the first step.
+ *
+ * The samples are not stamped until then.
+ */
+void list_mode_restart(void);
+
+/**
+ * @brief Advance the run to the time of a sample.
+ *
+ * @param timestamp_us Conversion timestamp of the sample (us).
+ * @param mode Output, the mode of the current step.
+ * @param setpoint Output, the setpoint of the current step.
+ * @return true while running, false if no list is loaded or the run has finished.
+ */
+bool list_mode_step(int64_t timestamp_us, ControlMode *mode, float *setpoint);
+
+/**
+ * @brief Get the value to stamp in the samples.
+ *
+ * @return Steps started in the current run, 0 outside a run.
+ */
+uint32_t list_mode_stamp(void);
+
+/**
+ * @brief Copy the state of the run.
+ *
+ * @param status Output, the state.
+ */
+void list_mode_get_status(ListStatus *status);
+
+#endif // LIST_MODE_H
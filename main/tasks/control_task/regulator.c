@@ -0,0 +1,207 @@
+#include "regulator.h"
+#include "config.h"
+
+/**
+ * @file regulator.c
+ * @brief Implementation of the PI regulator engine.
+ *
+ * The float variant integrates the error in the units of the mode, the fixed
+ * point variant keeps the integral term as a Q31 fraction of full output. All
+ * float literals are single precision, so nothing is promoted to double.
+ *
+ * Anti-windup is done by back-calculation. When the output saturates, the
+ * difference between the saturated and the unsaturated output is fed back
+ * into the integrator with gain kb, so the integrator tracks the duty cycle the
+ * load actually gets instead of winding up. The float integrator clamp to
+ * ±100 % duty is kept as a last bound. The correction per update is capped at the full difference,
+ * so a long dt cannot overshoot it.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Regulator descriptor of every control mode, indexed by ControlMode.
+ *
+ * Gains are in % duty cycle per unit of the mode. Constant voltage regulates in
+ * the opposite direction, since more duty cycle pulls the bus voltage down.
+ * Constant resistance, dynamic and waveform mode are current loops with the
+ * constant current gains. Their reference is calculated every sample, from the
+ * bus voltage, the waveform generator or the uploaded table. A waveform table
+ * of powers is played with the constant power descriptor instead.
+ *
+ * Shared with the host tests, so they run against the gains the firmware uses.
+ */
+const RegulatorDescriptor regulator_descriptors[MODE_COUNT] = {
+    [MODE_CC] = REGULATOR_DESCRIPTOR(8.0f, 50.0f, 1.0f, MAX_CURRENT, current, "A"),
+    [MODE_CV] = REGULATOR_DESCRIPTOR(1.0f, 0.1f, -1.0f, MAX_VOLTAGE, bus_voltage, "V"),
+    [MODE_CP] = REGULATOR_DESCRIPTOR(1.0f, 0.1f, 1.0f, MAX_VOLTAGE * MAX_CURRENT, power, "W"),
+    [MODE_CR] = REGULATOR_DESCRIPTOR(8.0f, 50.0f, 1.0f, MAX_CURRENT, current, "A"),
+    [MODE_DYNAMIC] = REGULATOR_DESCRIPTOR(8.0f, 50.0f, 1.0f, MAX_CURRENT, current, "A"),
+    [MODE_WAVEFORM] = REGULATOR_DESCRIPTOR(8.0f, 50.0f, 1.0f, MAX_CURRENT, current, "A"),
+};
+
+/**
+ * @brief Select the mode of a regulator and clear its integrator.
+ *
+ * @param regulator The regulator.
+ * @param descriptor The mode to regulate.
+ */
+void regulator_init(Regulator *regulator, const RegulatorDescriptor *descriptor)
+{
+    regulator->descriptor = descriptor;
+    regulator_reset(regulator);
+}
+
+/**
+ * @brief Clear the integrator.
+ *
+ * @param regulator The regulator.
+ */
+void regulator_reset(Regulator *regulator)
+{
+    regulator->integral = 0.0f;
+    regulator->integral_q31 = 0;
+}
+
+/**
+ * @brief Switch a running regulator to another mode without a bump.
+ *
+ * The integrator of the new mode is set so that its first output equals the
+ * duty cycle the load is running at.
+ *
+ * @param regulator The regulator.
+ * @param descriptor The new mode.
+ * @param duty_cycle The duty cycle currently applied (0 to 100 %).
+ * @param setpoint The setpoint of the new mode (unit).
+ * @param measured The measurement of the new mode (unit).
+ */
+void regulator_transfer(Regulator *regulator, const RegulatorDescriptor *descriptor, float duty_cycle, float setpoint, float measured)
+{
+    regulator->descriptor = descriptor;
+
+    // Float variant: solve duty = kp * error + ki * integral for the integral, within the integrator limit
+    float error = descriptor->direction * (setpoint - measured);
+    float integral = (duty_cycle - descriptor->kp * error) / descriptor->ki;
+    if (integral > descriptor->integral_limit)
+    {
+        integral = descriptor->integral_limit;
+    }
+    else if (integral < -descriptor->integral_limit)
+    {
+        integral = -descriptor->integral_limit;
+    }
+    regulator->integral = integral;
+
+    // Fixed point variant: the integral term is the duty minus the proportional term, in Q31
+    int32_t error_q15 = (int32_t)regulator_to_q15(descriptor, setpoint) - (int32_t)regulator_to_q15(descriptor, measured);
+    error_q15 = (descriptor->direction < 0) ? -error_q15 : error_q15;
+    error_q15 = (error_q15 > INT16_MAX) ? INT16_MAX : ((error_q15 < INT16_MIN) ? INT16_MIN : error_q15);
+    int64_t integral_q31 = (int64_t)(duty_cycle * (2147483647.0f / REGULATOR_OUTPUT_MAX)) - (int64_t)descriptor->kp_q16 * error_q15;
+    integral_q31 = (integral_q31 > INT32_MAX) ? INT32_MAX : ((integral_q31 < -INT32_MAX) ? -INT32_MAX : integral_q31);
+    regulator->integral_q31 = (int32_t)integral_q31;
+}
+
+/**
+ * @brief Run one float update.
+ *
+ * @param regulator The regulator.
+ * @param setpoint The setpoint (unit).
+ * @param measured The measurement (unit).
+ * @param dt Time since the previous update (s).
+ * @return The duty cycle (0 to 100 %).
+ */
+float regulator_update(Regulator *regulator, float setpoint, float measured, float dt)
+{
+    const RegulatorDescriptor *descriptor = regulator->descriptor;
+
+    // Calculate the error, turned around for modes where more duty cycle lowers the measurement
+    float error = descriptor->direction * (setpoint - measured);
+
+    // Calculate the duty cycle and clamp it to the valid range
+    float output = descriptor->kp * error + descriptor->ki * regulator->integral;
+    float output_saturated = output;
+    if (output_saturated > REGULATOR_OUTPUT_MAX)
+    {
+        output_saturated = REGULATOR_OUTPUT_MAX;
+    }
+    else if (output_saturated < 0.0f)
+    {
+        output_saturated = 0.0f;
+    }
+
+    // Integrate the error, with the back-calculation term pulling the integrator towards the saturated output
+    float tracking = descriptor->kb * dt;
+    tracking = (tracking > 1.0f) ? 1.0f : tracking;
+    regulator->integral += error * dt + tracking * (output_saturated - output) / descriptor->ki;
+
+    // Clamp the integral term to prevent excessive accumulation
+    if (regulator->integral > descriptor->integral_limit)
+    {
+        regulator->integral = descriptor->integral_limit;
+    }
+    else if (regulator->integral < -descriptor->integral_limit)
+    {
+        regulator->integral = -descriptor->integral_limit;
+    }
+    return output_saturated;
+}
+
+/**
+ * @brief Convert a value of the regulator's mode to Q15 of full scale.
+ *
+ * @param descriptor The mode.
+ * @param value The value (unit).
+ * @return The value in Q15, saturated.
+ */
+int16_t regulator_to_q15(const RegulatorDescriptor *descriptor, float value)
+{
+    float scaled = value * (32768.0f / descriptor->full_scale);
+    if (scaled > 32767.0f)
+    {
+        return INT16_MAX;
+    }
+    if (scaled < -32768.0f)
+    {
+        return INT16_MIN;
+    }
+    return (int16_t)scaled;
+}
+
+/**
+ * @brief Run one fixed point update.
+ *
+ * @param regulator The regulator.
+ * @param setpoint The setpoint, Q15 of full scale.
+ * @param measured The measurement, Q15 of full scale.
+ * @param dt_us Time since the previous update (us).
+ * @return The duty cycle, Q15 of 100 % (0 to 32767).
+ */
+int16_t regulator_update_q15(Regulator *regulator, int16_t setpoint, int16_t measured, int32_t dt_us)
+{
+    const RegulatorDescriptor *descriptor = regulator->descriptor;
+
+    // Calculate the error in Q15, saturated to the Q15 range
+    int32_t error = (int32_t)setpoint - (int32_t)measured;
+    error = (descriptor->direction < 0) ? -error : error;
+    error = (error > INT16_MAX) ? INT16_MAX : ((error < INT16_MIN) ? INT16_MIN : error);
+
+    // Proportional term: Q16 gain * Q15 error = Q31, plus the Q31 integral term
+    int64_t output = (int64_t)descriptor->kp_q16 * error + regulator->integral_q31;
+    int64_t output_saturated = (output > INT32_MAX) ? INT32_MAX : ((output < 0) ? 0 : output);
+
+    // Integral term: Q32 gain per us * Q15 error * us = Q47, shifted to Q31
+    int64_t integral = (int64_t)regulator->integral_q31 + (((int64_t)descriptor->ki_us_q32 * error * dt_us) >> 16);
+
+    // Back-calculation: Q31 difference * tracking factor, capped at 1.0. The factor is taken down to Q24 first,
+    // the difference can reach 2^33 and a Q32 factor of 1.0 would overflow the 64 bit product.
+    int64_t tracking = (int64_t)descriptor->kb_us_q32 * dt_us;
+    tracking = (tracking > ((int64_t)1 << 32)) ? ((int64_t)1 << 32) : tracking;
+    integral += ((output_saturated - output) * (tracking >> 8)) >> 24;
+
+    // Clamp the integral term to ±100 %
+    integral = (integral > INT32_MAX) ? INT32_MAX : ((integral < -INT32_MAX) ? -INT32_MAX : integral);
+    regulator->integral_q31 = (int32_t)integral;
+
+    return (int16_t)(output_saturated >> 16);
+}
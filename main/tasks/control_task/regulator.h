@@ -0,0 +1,172 @@
+#ifndef REGULATOR_H
+#define REGULATOR_H
+#include <stdint.h>
+#include <stddef.h>
+#include "globals.h"
+
+/**
+ * @file regulator.h
+ * @brief Header file for the PI regulator engine.
+ *
+ * This file contains the declarations for one PI regulator shared by all
+ * control modes. Each mode is described by a constant descriptor holding its
+ * gains, integrator limit, direction and the measurement it regulates, so a
+ * new mode only needs a new descriptor.
+ *
+ * The regulator comes in two variants that use the same descriptors:
+ * - float, in the units of the mode, with the output in % duty cycle.
+ * - fixed point, with the error and output in Q15 of full scale and the
+ *   integrator in Q31, using integer instructions only.
+ *
+ * Both variants use back-calculation anti-windup and support bumpless transfer
+ * between modes.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+#define REGULATOR_OUTPUT_MAX 100.0f /**< Largest output of the float variant (% duty cycle). */
+
+/** Convert a constant to Q16. */
+#define REGULATOR_Q16(x) ((int32_t)((x) * 65536.0))
+
+/** Convert a constant to Q32. */
+#define REGULATOR_Q32(x) ((int32_t)((x) * 4294967296.0))
+
+/**
+ * @brief Build a regulator descriptor from gains in % duty per unit.
+ *
+ * The fixed point gains are calculated by the compiler from the float gains,
+ * normalised to the full scale of the mode. The back-calculation tracking time
+ * constant is the integral time Kp / Ki. The float integrator is bounded so the
+ * integral term stays within ±100 % duty cycle, which is what lets a mode
+ * switch take over any duty cycle.
+ *
+ * @param kp_ Proportional gain (% duty per unit).
+ * @param ki_ Integral gain (% duty per unit·s).
+ * @param direction_ 1 if more duty cycle raises the measurement, -1 if it lowers it.
+ * @param full_scale_ Measurement that maps to Q15 full scale (unit).
+ * @param field_ MeasurementData field the mode regulates.
+ * @param unit_ Unit of the mode, for logging.
+ */
+#define REGULATOR_DESCRIPTOR(kp_, ki_, direction_, full_scale_, field_, unit_)               \
+    {                                                                                        \
+        .kp = (kp_),                                                                         \
+        .ki = (ki_),                                                                         \
+        .integral_limit = REGULATOR_OUTPUT_MAX / (ki_),                                      \
+        .direction = (direction_),                                                           \
+        .full_scale = (full_scale_),                                                         \
+        .kp_q16 = REGULATOR_Q16((kp_) * (full_scale_) / 100.0),                              \
+        .ki_us_q32 = REGULATOR_Q32((ki_) * (full_scale_) / 100.0 / 1000000.0),               \
+        .kb = (ki_) / (kp_),                                                                 \
+        .kb_us_q32 = REGULATOR_Q32((ki_) / (kp_) / 1000000.0),                               \
+        .measurement_offset = offsetof(MeasurementData, field_),                             \
+        .unit = (unit_),                                                                     \
+    }
+
+/**
+ * @brief Constant description of one control mode.
+ */
+typedef struct
+{
+    float kp;                  /**< Proportional gain (% duty per unit). */
+    float ki;                  /**< Integral gain (% duty per unit·s). */
+    float integral_limit;      /**< Integrator clamp of the float variant, ±100 % duty (unit·s). */
+    float direction;           /**< 1 if more duty cycle raises the measurement, -1 if it lowers it. */
+    float full_scale;          /**< Measurement that maps to Q15 full scale (unit). */
+    int32_t kp_q16;            /**< Proportional gain, output full scale per error full scale, Q16. */
+    int32_t ki_us_q32;         /**< Integral gain, output full scale per error full scale per us, Q32. */
+    float kb;                  /**< Back-calculation gain, 1 / tracking time constant (1/s). */
+    int32_t kb_us_q32;         /**< Back-calculation gain per us, Q32. */
+    size_t measurement_offset; /**< Offset of the regulated float in MeasurementData. */
+    const char *unit;          /**< Unit of the mode, for logging. */
+} RegulatorDescriptor;
+
+/**
+ * @brief State of a regulator.
+ */
+typedef struct
+{
+    const RegulatorDescriptor *descriptor; /**< Mode being regulated. */
+    float integral;                        /**< Integrated error of the float variant (unit·s). */
+    int32_t integral_q31;                  /**< Integral term of the fixed point variant, Q31 of output full scale. */
+} Regulator;
+
+/**
+ * @brief Regulator descriptor of every control mode, indexed by ControlMode.
+ */
+extern const RegulatorDescriptor regulator_descriptors[MODE_COUNT];
+
+/**
+ * @brief Select the mode of a regulator and clear its integrator.
+ *
+ * @param regulator The regulator.
+ * @param descriptor The mode to regulate.
+ */
+void regulator_init(Regulator *regulator, const RegulatorDescriptor *descriptor);
+
+/**
+ * @brief Clear the integrator.
+ *
+ * @param regulator The regulator.
+ */
+void regulator_reset(Regulator *regulator);
+
+/**
+ * @brief Switch a running regulator to another mode without a bump.
+ *
+ * The integrator of the new mode is set so that its first output equals the
+ * duty cycle the load is running at.
+ *
+ * @param regulator The regulator.
+ * @param descriptor The new mode.
+ * @param duty_cycle The duty cycle currently applied (0 to 100 %).
+ * @param setpoint The setpoint of the new mode (unit).
+ * @param measured The measurement of the new mode (unit).
+ */
+void regulator_transfer(Regulator *regulator, const RegulatorDescriptor *descriptor, float duty_cycle, float setpoint, float measured);
+
+/**
+ * @brief Get the value the regulator's mode regulates from a sample.
+ *
+ * @param descriptor The mode.
+ * @param measurements The sample.
+ * @return The measured value (unit).
+ */
+static inline float regulator_measurement(const RegulatorDescriptor *descriptor, const MeasurementData *measurements)
+{
+    return *(const float *)((const char *)measurements + descriptor->measurement_offset);
+}
+
+/**
+ * @brief Run one float update.
+ *
+ * @param regulator The regulator.
+ * @param setpoint The setpoint (unit).
+ * @param measured The measurement (unit).
+ * @param dt Time since the previous update (s).
+ * @return The duty cycle (0 to 100 %).
+ */
+float regulator_update(Regulator *regulator, float setpoint, float measured, float dt);
+
+/**
+ * @brief Convert a value of the regulator's mode to Q15 of full scale.
+ *
+ * @param descriptor The mode.
+ * @param value The value (unit).
+ * @return The value in Q15, saturated.
+ */
+int16_t regulator_to_q15(const RegulatorDescriptor *descriptor, float value);
+
+/**
+ * @brief Run one fixed point update.
+ *
+ * @param regulator The regulator.
+ * @param setpoint The setpoint, Q15 of full scale.
+ * @param measured The measurement, Q15 of full scale.
+ * @param dt_us Time since the previous update (us).
+ * @return The duty cycle, Q15 of 100 % (0 to 32767).
+ */
+int16_t regulator_update_q15(Regulator *regulator, int16_t setpoint, int16_t measured, int32_t dt_us);
+
+#endif // REGULATOR_H
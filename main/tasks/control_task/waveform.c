@@ -0,0 +1,219 @@
+#include <string.h>
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_heap_caps.h"
+#include "esp_memory_utils.h"
+#include "esp_log.h"
+#include "waveform.h"
+#include "config.h"
+
+/**
+ * @file waveform.c
+ * @brief Implementation of the waveform playback engine.
+ *
+ * The table is uploaded by the HTTP server and played by the control task,
+ * once per sample. The position in the table is taken from the conversion
+ * timestamp of the sample rather than from a count of samples, so a late or
+ * skipped sample does not stretch the profile.
+ *
+ * Tables go to PSRAM when the board has it and fall back to internal RAM,
+ * with a smaller size limit, when it does not.
+ *
+ * The table pointer and the playback state are shared between the two tasks
+ * and protected by a spinlock. A new table is swapped in under the lock and
+ * the old one is freed after it is released, so the control task never waits
+ * for a free or for an upload.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+static const char *TAG = "WAVEFORM"; /**< Tag for logging messages from the waveform engine. */
+
+/**
+ * @brief Table and playback state.
+ */
+typedef struct
+{
+    WaveformTable table;       /**< The loaded table, points is NULL if none. */
+    bool playing;              /**< true while the table is being played. */
+    bool finished;             /**< true once a table without looping has reached its last point. */
+    int64_t start_us;          /**< Timestamp of the first sample of the playback (us). */
+    int64_t elapsed_us;        /**< Time since the playback started (us). */
+    bool reference_valid;      /**< true if reference holds the reference of the previous sample. */
+    float reference;           /**< Reference returned for the previous sample. */
+    double error_squared_sum;  /**< Sum of the squared errors since the playback started. */
+    uint32_t samples;          /**< Samples in error_squared_sum. */
+} Waveform;
+
+static Waveform waveform = {0};                                  /**< The waveform engine. */
+static portMUX_TYPE waveform_lock = portMUX_INITIALIZER_UNLOCKED; /**< Protects the waveform engine. */
+
+/**
+ * @brief Allocate the points of a table, in PSRAM if there is any.
+ *
+ * @param capacity Output, the number of points allocated.
+ * @return The points, or NULL if no memory is free.
+ */
+float *waveform_alloc(uint32_t *capacity)
+{
+    float *points = heap_caps_malloc(WAVEFORM_MAX_POINTS_PSRAM * sizeof(float), MALLOC_CAP_SPIRAM);
+    *capacity = WAVEFORM_MAX_POINTS_PSRAM;
+    if (points == NULL)
+    {
+        points = heap_caps_malloc(WAVEFORM_MAX_POINTS_INTERNAL * sizeof(float), MALLOC_CAP_INTERNAL | MALLOC_CAP_8BIT);
+        *capacity = (points == NULL) ? 0 : WAVEFORM_MAX_POINTS_INTERNAL;
+    }
+    return points;
+}
+
+/**
+ * @brief Clear the playback state, the next sample starts at the first point.
+ *
+ * Must be called with the lock taken.
+ */
+static void waveform_restart_locked(void)
+{
+    waveform.playing = false;
+    waveform.finished = false;
+    waveform.elapsed_us = 0;
+    waveform.reference_valid = false;
+    waveform.error_squared_sum = 0;
+    waveform.samples = 0;
+}
+
+/**
+ * @brief Replace the loaded table.
+ *
+ * The engine takes over the points and frees the previous ones. Playback
+ * restarts at the first point.
+ *
+ * @param table The new table.
+ */
+void waveform_load(const WaveformTable *table)
+{
+    taskENTER_CRITICAL(&waveform_lock);
+    float *previous = waveform.table.points;
+    waveform.table = *table;
+    waveform_restart_locked();
+    taskEXIT_CRITICAL(&waveform_lock);
+
+    heap_caps_free(previous);
+    ESP_LOGI(TAG, "Loaded %lu points, %lu us interval, %s%s, in %s", table->count, table->interval_us,
+             (table->unit == WAVEFORM_POWER) ? "power" : "current", table->loop ? ", looping" : "",
+             esp_ptr_external_ram(table->points) ? "PSRAM" : "internal RAM");
+}
+
+/**
+ * @brief Get the quantity of the loaded table.
+ *
+ * @return The unit of the points, WAVEFORM_CURRENT if no table is loaded.
+ */
+WaveformUnit waveform_unit(void)
+{
+    taskENTER_CRITICAL(&waveform_lock);
+    WaveformUnit unit = (waveform.table.points == NULL) ? WAVEFORM_CURRENT : waveform.table.unit;
+    taskEXIT_CRITICAL(&waveform_lock);
+    return unit;
+}
+
+/**
+ * @brief Restart playback at the first point on the next sample.
+ */
+void waveform_restart(void)
+{
+    taskENTER_CRITICAL(&waveform_lock);
+    waveform_restart_locked();
+    taskEXIT_CRITICAL(&waveform_lock);
+}
+
+/**
+ * @brief Play the table for one sample.
+ *
+ * Records the error of the measurement against the reference returned for the
+ * previous sample, then returns the reference at the time of this sample.
+ *
+ * @param timestamp_us Conversion timestamp of the sample (us).
+ * @param measured Current or power of the sample, in the unit of the table.
+ * @param reference Output, the reference, 0 if no table is loaded.
+ * @return true while playing, false if no table is loaded or a table without looping has finished.
+ */
+bool waveform_step(int64_t timestamp_us, float measured, float *reference)
+{
+    taskENTER_CRITICAL(&waveform_lock);
+    const WaveformTable *table = &waveform.table;
+    if ((table->points == NULL) || (table->count == 0))
+    {
+        taskEXIT_CRITICAL(&waveform_lock);
+        *reference = 0.0f;
+        return false;
+    }
+
+    // The previous reference was applied until this sample, compare it with what was achieved
+    if (waveform.reference_valid)
+    {
+        float error = measured - waveform.reference;
+        waveform.error_squared_sum += error * error;
+        waveform.samples++;
+    }
+
+    if (!waveform.playing)
+    {
+        waveform.playing = true;
+        waveform.start_us = timestamp_us;
+    }
+    waveform.elapsed_us = timestamp_us - waveform.start_us;
+
+    // Find the segment of this sample. A looping table also interpolates from the last point back to the first.
+    int64_t length_us = (int64_t)(table->loop ? table->count : table->count - 1) * table->interval_us;
+    int64_t position_us = waveform.elapsed_us;
+    if (table->loop && (length_us > 0))
+    {
+        position_us %= length_us;
+    }
+
+    if (position_us >= length_us)
+    {
+        // A table without looping holds its last point once it has been played
+        waveform.finished = true;
+        waveform.reference = table->points[table->count - 1];
+    }
+    else
+    {
+        uint32_t index = (uint32_t)(position_us / table->interval_us);
+        uint32_t next = (index + 1 < table->count) ? index + 1 : 0;
+        float fraction = (float)(position_us - (int64_t)index * table->interval_us) / (float)table->interval_us;
+        waveform.reference = table->points[index] + (table->points[next] - table->points[index]) * fraction;
+    }
+    waveform.reference_valid = true;
+
+    *reference = waveform.reference;
+    bool playing = !waveform.finished;
+    taskEXIT_CRITICAL(&waveform_lock);
+    return playing;
+}
+
+/**
+ * @brief Copy the playback report.
+ *
+ * @param report Output, the report.
+ */
+void waveform_get_report(WaveformReport *report)
+{
+    taskENTER_CRITICAL(&waveform_lock);
+    report->loaded = waveform.table.points != NULL;
+    report->count = waveform.table.count;
+    report->interval_us = waveform.table.interval_us;
+    report->loop = waveform.table.loop;
+    report->unit = waveform.table.unit;
+    report->in_psram = report->loaded && esp_ptr_external_ram(waveform.table.points);
+    report->playing = waveform.playing && !waveform.finished;
+    report->finished = waveform.finished;
+    report->elapsed_s = (float)waveform.elapsed_us * 1e-6f;
+    report->samples = waveform.samples;
+    double error_squared_sum = waveform.error_squared_sum;
+    taskEXIT_CRITICAL(&waveform_lock);
+
+    report->rms_error = (report->samples == 0) ? 0.0f : (float)sqrt(error_squared_sum / report->samples);
+}
@@ -0,0 +1,109 @@
+#ifndef WAVEFORM_H
+#define WAVEFORM_H
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @file waveform.h
+ * @brief Header file for the waveform playback engine.
+ *
+ * This file contains the declarations for playing back an uploaded table of
+ * current or power points, such as a recorded consumption profile. The table
+ * is replayed against the sample timestamps with linear interpolation between
+ * the points, optionally looping, and the achieved profile is compared with
+ * the requested one as an RMS error.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Quantity a waveform table holds.
+ */
+typedef enum
+{
+    WAVEFORM_CURRENT, /**< Points are currents (A). */
+    WAVEFORM_POWER,   /**< Points are powers (W). */
+} WaveformUnit;
+
+/**
+ * @brief A waveform table.
+ */
+typedef struct
+{
+    float *points;        /**< The points, allocated with waveform_alloc(). */
+    uint32_t count;       /**< Number of points. */
+    uint32_t interval_us; /**< Time between two points (us). */
+    bool loop;            /**< true to restart at the first point after the last one. */
+    WaveformUnit unit;    /**< Quantity of the points. */
+} WaveformTable;
+
+/**
+ * @brief Playback report.
+ */
+typedef struct
+{
+    bool loaded;          /**< true if a table is loaded. */
+    uint32_t count;       /**< Number of points. */
+    uint32_t interval_us; /**< Time between two points (us). */
+    bool loop;            /**< true if the table loops. */
+    WaveformUnit unit;    /**< Quantity of the points. */
+    bool in_psram;        /**< true if the table is in PSRAM. */
+    bool playing;         /**< true while the table is being played. */
+    bool finished;        /**< true once a table without looping has reached its last point. */
+    float elapsed_s;      /**< Time since the playback started (s). */
+    uint32_t samples;     /**< Samples compared with the requested profile. */
+    float rms_error;      /**< RMS of achieved minus requested, in the unit of the table. */
+} WaveformReport;
+
+/**
+ * @brief Allocate the points of a table, in PSRAM if there is any.
+ *
+ * @param capacity Output, the number of points allocated.
+ * @return The points, or NULL if no memory is free.
+ */
+float *waveform_alloc(uint32_t *capacity);
+
+/**
+ * @brief Replace the loaded table.
+ *
+ * The engine takes over the points and frees the previous ones. Playback
+ * restarts at the first point.
+ *
+ * @param table The new table.
+ */
+void waveform_load(const WaveformTable *table);
+
+/**
+ * @brief Get the quantity of the loaded table.
+ *
+ * @return The unit of the points, WAVEFORM_CURRENT if no table is loaded.
+ */
+WaveformUnit waveform_unit(void);
+
+/**
+ * @brief Restart playback at the first point on the next sample.
+ */
+void waveform_restart(void);
+
+/**
+ * @brief Play the table for one sample.
+ *
+ * Records the error of the measurement against the reference returned for the
+ * previous sample, then returns the reference at the time of this sample.
+ *
+ * @param timestamp_us Conversion timestamp of the sample (us).
+ * @param measured Current or power of the sample, in the unit of the table.
+ * @param reference Output, the reference, 0 if no table is loaded.
+ * @return true while playing, false if no table is loaded or a table without looping has finished.
+ */
+bool waveform_step(int64_t timestamp_us, float measured, float *reference);
+
+/**
+ * @brief Copy the playback report.
+ *
+ * @param report Output, the report.
+ */
+void waveform_get_report(WaveformReport *report);
+
+#endif // WAVEFORM_H
@@ -6,6 +6,9 @@
 #include "hmi_task.h"
 #include "measurement_task.h"
 #include "globals.h"
+#include "live_state.h"
+#include "discharge_test.h"
+#include "blackbox.h"
 #include "config.h"
 // #include "communication_task.h" // Uncomment this line after creating the communication task
 
@@ -38,28 +41,37 @@ void hmi_task(void *pvParameters)
     float setpoint = 0.0; /**< Current setpoint value. */
     float previous_setpoint = 0.0; /**< Previous setpoint value for comparison. */
     ControlMode mode = MODE_CC; /**< Current control mode (default is Constant Current). */
+    LiveSettings settings; /**< Snapshot of the live settings. */
+    uint32_t setpoint_updates = 0; /**< Setpoint update count of the last setpoint seen. */
     
 
     while (1)
     {
+        // This task has the lowest priority, so it saves the discharge test and the fault records, which wait for flash writes
+        discharge_test_persist();
+        blackbox_service();
+
+        live_state_get(&settings);
+
         // Check if the setpoint has changed
         if (setpoint != previous_setpoint)
         {
             previous_setpoint = setpoint;
 
-            // Update the setpoint queue and signal other tasks
-            xQueueOverwrite(setpoint_queue, &setpoint);
-            xEventGroupSetBits(signal_event_group, CONTROL_SETPOINT_BIT);
+            // Publish the setpoint to the other tasks
+            live_state_set_setpoint(setpoint);
+            live_state_get(&settings);
+            setpoint_updates = settings.setpoint_updates;
             vTaskDelay(pdMS_TO_TICKS(1));
         }
         // Check if another task has updated the setpoint
-        else if (xEventGroupGetBits(signal_event_group) & HMI_SETPOINT_BIT)
+        else if (settings.setpoint_updates != setpoint_updates)
         {
             ESP_LOGI(TAG, "Received setpoint data");
 
-            // Clear the HMI setpoint bit and update the local setpoint
-            xEventGroupClearBits(signal_event_group, HMI_SETPOINT_BIT);
-            xQueuePeek(setpoint_queue, &setpoint, pdMS_TO_TICKS(1));
+            // Update the local setpoint
+            setpoint_updates = settings.setpoint_updates;
+            setpoint = settings.setpoint;
             previous_setpoint = setpoint;
 
             // Short delay to allow other tasks to process the signal
@@ -0,0 +1,102 @@
+#include "ina237.h"
+#include "i2c.h"
+#include "config.h"
+
+/**
+ * @file ina237.c
+ * @brief Implementation of reading and decoding INA237 samples.
+ *
+ * The conversion ready alerts are counted per wake-up of the measurement task,
+ * to report conversions that were never read and samples read without a new
+ * conversion.
+ *
+ * All result registers are read in one block read starting at VSHUNT. A read
+ * that fails on every attempt of the I2C layer does not touch the previous
+ * values, the sample is only flagged, so the consumers keep running on the
+ * last good conversion and the next conversion gets a fresh attempt.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Decode an INA237 result frame.
+ *
+ * The frame holds VSHUNT, VBUS, DIETEMP, CURRENT (16 bit each) and POWER
+ * (24 bit), MSB first, as read by one block read starting at VSHUNT.
+ *
+ * @param frame The raw frame of `INA237_FRAME_LENGTH` bytes.
+ * @param raw Struct the raw register values are written to.
+ * @param measurements Struct the converted values are written to.
+ */
+void ina237_decode_frame(const uint8_t *frame, Ina237Raw *raw, MeasurementData *measurements)
+{
+    raw->shunt = (int16_t)((frame[0] << 8) | frame[1]);
+    raw->voltage = (int16_t)((frame[2] << 8) | frame[3]);
+    raw->die_temp = (int16_t)((frame[4] << 8) | frame[5]);
+    raw->current = (int16_t)((frame[6] << 8) | frame[7]);
+    raw->power = ((uint32_t)frame[8] << 16) | ((uint32_t)frame[9] << 8) | frame[10];
+
+    measurements->shunt_voltage = (float)raw->shunt * INA237_VSHUNT_LSB;
+    measurements->bus_voltage = (float)raw->voltage * INA237_VBUS_LSB;
+    measurements->temperature_die = (float)(raw->die_temp >> 4) * INA237_DIETEMP_LSB; // Temperature is in bits 15-4
+    measurements->current = (float)raw->current * INA237_CURRENT_LSB;
+    measurements->power = (float)raw->power * INA237_POWER_LSB;
+}
+
+/**
+ * @brief Count the conversions signalled since the previous wake-up.
+ *
+ * Every conversion ready alert adds one to the task notification count, and
+ * each wake-up takes the whole count. No alert before the timeout means the
+ * sample repeats the previous conversion, more than one means the conversions
+ * before the latest one were never read. An edge the ISR never saw does not
+ * show up in either counter.
+ *
+ * @param pending_conversions Conversion ready notifications taken on this wake-up, 0 if the wait timed out.
+ * @param statistics Statistics the missed conversions and duplicate samples are counted in.
+ * @return true if a new conversion was signalled, so the sample carries the time of the alert.
+ */
+bool ina237_count_conversions(uint32_t pending_conversions, MeasurementStatistics *statistics)
+{
+    if (pending_conversions == 0)
+    {
+        // No alert arrived, the task reads anyway so the data never goes stale, but counts it
+        statistics->duplicate_samples++;
+        return false;
+    }
+
+    // More than one conversion completed since the last read
+    statistics->missed_conversions += pending_conversions - 1;
+    return true;
+}
+
+/**
+ * @brief Read one sample from the INA237 and set its quality.
+ *
+ * A good read is decoded and flagged `MEASUREMENT_OK`, or `MEASUREMENT_DUPLICATE`
+ * when no new conversion was signalled. A failed read keeps the previous values
+ * and is flagged `MEASUREMENT_I2C_ERROR`.
+ *
+ * @param dev_handle Handle of the INA237.
+ * @param new_conversion true if a conversion was signalled since the previous read.
+ * @param raw Raw registers of the latest good read, left unchanged on a failed read.
+ * @param measurements The sample, the electrical values are left unchanged on a failed read.
+ * @return The quality written to the sample.
+ */
+MeasurementQuality ina237_read_sample(i2c_master_dev_handle_t dev_handle, bool new_conversion, Ina237Raw *raw, MeasurementData *measurements)
+{
+    uint8_t frame[INA237_FRAME_LENGTH];
+
+    // Read all INA237 result registers in one transaction
+    if (i2c_read_block(dev_handle, INA237_VSHUNT_REG, frame, sizeof(frame)) == ESP_OK)
+    {
+        ina237_decode_frame(frame, raw, measurements);
+        measurements->quality = new_conversion ? MEASUREMENT_OK : MEASUREMENT_DUPLICATE;
+    }
+    else
+    {
+        measurements->quality = MEASUREMENT_I2C_ERROR;
+    }
+    return measurements->quality;
+}
@@ -0,0 +1,62 @@
+#ifndef INA237_H
+#define INA237_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/i2c_master.h"
+#include "globals.h"
+
+/**
+ * @file ina237.h
+ * @brief Header file for reading and decoding INA237 samples.
+ *
+ * This file contains the declarations for counting the conversion ready
+ * alerts, and for reading the INA237 result frame and converting it into a
+ * measurement, kept apart from the measurement task so the counting and the
+ * error handling can be tested on the host.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Raw INA237 result registers.
+ */
+typedef struct
+{
+    int16_t shunt;    /**< VSHUNT register. */
+    int16_t voltage;  /**< VBUS register. */
+    int16_t die_temp; /**< DIETEMP register. */
+    int16_t current;  /**< CURRENT register. */
+    uint32_t power;   /**< POWER register (24 bit). */
+} Ina237Raw;
+
+/**
+ * @brief Decode an INA237 result frame.
+ *
+ * @param frame The raw frame of `INA237_FRAME_LENGTH` bytes.
+ * @param raw Struct the raw register values are written to.
+ * @param measurements Struct the converted values are written to.
+ */
+void ina237_decode_frame(const uint8_t *frame, Ina237Raw *raw, MeasurementData *measurements);
+
+/**
+ * @brief Count the conversions signalled since the previous wake-up.
+ *
+ * @param pending_conversions Conversion ready notifications taken on this wake-up, 0 if the wait timed out.
+ * @param statistics Statistics the missed conversions and duplicate samples are counted in.
+ * @return true if a new conversion was signalled, so the sample carries the time of the alert.
+ */
+bool ina237_count_conversions(uint32_t pending_conversions, MeasurementStatistics *statistics);
+
+/**
+ * @brief Read one sample from the INA237 and set its quality.
+ *
+ * @param dev_handle Handle of the INA237.
+ * @param new_conversion true if a conversion was signalled since the previous read.
+ * @param raw Raw registers of the latest good read, left unchanged on a failed read.
+ * @param measurements The sample, the electrical values are left unchanged on a failed read.
+ * @return The quality written to the sample.
+ */
+MeasurementQuality ina237_read_sample(i2c_master_dev_handle_t dev_handle, bool new_conversion, Ina237Raw *raw, MeasurementData *measurements);
+
+#endif // INA237_H
@@ -3,14 +3,26 @@
 #include "freertos/task.h"
 #include "freertos/queue.h"
 #include "freertos/event_groups.h"
-#include "esp_adc/adc_oneshot.h"
+#include "esp_adc/adc_continuous.h"
 #include "esp_log.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_cpu.h"
+#include "sdkconfig.h"
+#include "driver/gpio.h"
 #include "adc.h"
 #include "i2c.h"
+#include "ntc.h"
+#include "ina237.h"
+#include "sample_ring.h"
+#include "fast_control.h"
+#include "list_mode.h"
+#include "hw_protection.h"
+#include "supervisor.h"
+#include "load_state.h"
 #include "measurement_task.h"
 #include "globals.h"
 #include "config.h"
-#include "math.h"
 
 /**
  * @file measurement_task.c
@@ -20,9 +32,20 @@
  * for reading sensor data (voltage, current, temperature) and processing it into
  * usable values. The task communicates with other tasks via FreeRTOS queues.
  *
- * The task uses the INA237 sensor for voltage and current measurements and an ADC
- * channel for temperature readings. The processed data is stored in the
- * `measurement_queue` for use by other tasks.
+ * The task uses the INA237 sensor for voltage and current measurements and four NTC
+ * channels on ADC1 for temperature readings. The NTCs are scanned continuously by
+ * DMA, so the task only averages the finished frames. The processed data is stored in the
+ * `measurement_ring` for use by other tasks.
+ *
+ * Sampling is paced by the INA237 itself: the ALERT pin is configured as
+ * conversion ready and a GPIO interrupt wakes the task through a task
+ * notification, so every conversion is read exactly once. With
+ * INA237_HW_PROTECTION the ALERT pin belongs to the limit comparators instead,
+ * and an esp_timer at the conversion period wakes the task.
+ *
+ * Each sensor has its own period and phase, counted in samples, so the slow
+ * temperature channels do not run on every conversion. The achieved rate and
+ * CPU time of every sensor is reported with the statistics.
  *
  * @note The INA237 configuration is based on the datasheet calculations.
  *
@@ -33,10 +56,198 @@
 static const char *TAG = "MEASUREMENT_TASK"; /**< Tag for logging messages from the measurement task. */
 
 // Handles for ADC and I2C peripherals
-adc_oneshot_unit_handle_t adc_handle_1; /**< Handle for the ADC unit. */
-adc_oneshot_unit_handle_t adc_handle_2; /**< Handle for the ADC unit. */
-i2c_master_bus_handle_t i2c_handle;     /**< Handle for the I2C bus. */
-i2c_master_dev_handle_t ina_handle;     /**< Handle for the INA237 device. */
+adc_continuous_handle_t adc_handle_1; /**< Handle for the continuous ADC1 scan of the NTC channels. */
+i2c_master_bus_handle_t i2c_handle;   /**< Handle for the I2C bus. */
+i2c_master_dev_handle_t ina_handle;   /**< Handle for the INA237 device. */
+
+/**
+ * @brief Position of each NTC in the continuous ADC scan.
+ */
+typedef enum
+{
+    NTC_INTERNAL,   /**< Internal NTC on the heatsink. */
+    NTC_EXTERNAL_1, /**< External NTC probe 1. */
+    NTC_EXTERNAL_2, /**< External NTC probe 2. */
+    NTC_EXTERNAL_3, /**< External NTC probe 3. */
+    NTC_COUNT       /**< Number of NTC channels. */
+} NtcChannel;
+
+/** ADC1 channel of each NTC, in scan order. */
+static const adc_channel_t ntc_channels[NTC_COUNT] = {
+    NTC_ADC_CHANNEL_INTERNAL,
+    NTC_ADC_CHANNEL_EXTERNAL_1,
+    NTC_ADC_CHANNEL_EXTERNAL_2,
+    NTC_ADC_CHANNEL_EXTERNAL_3,
+};
+static uint8_t ntc_frame[NTC_ADC_FRAME_SIZE]; /**< Buffer the DMA frames are read into. */
+
+/**
+ * @brief Schedule entry of one sensor.
+ */
+typedef struct
+{
+    uint32_t period; /**< Run every period samples. */
+    uint32_t phase;  /**< Sample within the period the sensor runs on. */
+    uint32_t runs;   /**< Runs since the last statistics update. */
+    uint32_t cycles; /**< CPU cycles spent since the last statistics update. */
+} SensorSchedule;
+
+/** Schedule of every sensor, indexed by MeasurementSensor. */
+static SensorSchedule sensor_schedule[SENSOR_COUNT] = {
+    [SENSOR_INA237] = {.period = SCHEDULE_INA237_PERIOD, .phase = SCHEDULE_INA237_PHASE},
+    [SENSOR_NTC_INTERNAL] = {.period = SCHEDULE_NTC_INTERNAL_PERIOD, .phase = SCHEDULE_NTC_INTERNAL_PHASE},
+    [SENSOR_NTC_EXTERNAL] = {.period = SCHEDULE_NTC_EXTERNAL_PERIOD, .phase = SCHEDULE_NTC_EXTERNAL_PHASE},
+};
+
+static NtcTable ntc_table_internal; /**< Temperature table for the internal NTC. */
+static NtcTable ntc_table_external; /**< Temperature table for the external NTC probes. */
+
+static TaskHandle_t measurement_task_handle = NULL; /**< Handle of the measurement task, notified on every conversion. */
+static volatile uint32_t alert_count = 0;           /**< Number of conversion ready alerts seen by the ISR. */
+static int64_t alert_time_us = 0;                   /**< esp_timer time of the latest conversion ready alert (us). Protected by alert_lock. */
+static portMUX_TYPE alert_lock = portMUX_INITIALIZER_UNLOCKED; /**< Protects alert_time_us, a 64 bit value is not read or written in one access. */
+static uint32_t ina237_scl_speed = 0;               /**< SCL speed the INA237 was validated at (Hz). */
+
+/**
+ * @brief Exact integrator for raw sensor values over microsecond time steps.
+ *
+ * The integral is kept as whole LSB-seconds plus a remainder in LSB-microseconds,
+ * both 64 bit integers, so nothing is lost to rounding no matter how long a test runs.
+ */
+typedef struct
+{
+    int64_t lsb_seconds;      /**< Whole LSB-seconds. */
+    int64_t lsb_microseconds; /**< Remainder in LSB-microseconds, always below one LSB-second in magnitude. */
+} FixedIntegrator;
+
+/** Bus profiles tried for the INA237, fastest first. */
+static const uint32_t ina237_bus_speeds[] = {I2C_SPEED_FAST_PLUS, I2C_SPEED_FAST, I2C_SPEED_STANDARD};
+
+#if !INA237_ALERT_SIMULATED && !INA237_HW_PROTECTION
+/**
+ * @brief Interrupt handler for the INA237 ALERT pin.
+ *
+ * The ALERT pin is configured as conversion ready, so every falling edge means
+ * a new set of results is available. The handler only counts the alert and
+ * notifies the measurement task; all I2C traffic happens in task context.
+ *
+ * @param arg Unused.
+ */
+static void IRAM_ATTR ina237_alert_isr(void *arg)
+{
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    portENTER_CRITICAL_ISR(&alert_lock);
+    alert_time_us = esp_timer_get_time();
+    portEXIT_CRITICAL_ISR(&alert_lock);
+    alert_count++;
+    vTaskNotifyGiveFromISR(measurement_task_handle, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+#else
+/**
+ * @brief Simulated ALERT source.
+ *
+ * Stands in for the INA237 ALERT pin when the pin is not wired up, so the
+ * notification path and the missed/duplicate counters can be exercised on a
+ * bench without the sensor, and paces the task when the pin is used for the
+ * hardware protection. Runs from the esp_timer task.
+ *
+ * @param arg Unused.
+ */
+static void ina237_alert_simulated(void *arg)
+{
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&alert_lock);
+    alert_time_us = now;
+    taskEXIT_CRITICAL(&alert_lock);
+    alert_count++;
+    xTaskNotifyGive(measurement_task_handle);
+}
+#endif
+
+/**
+ * @brief Sets up the conversion ready interrupt.
+ *
+ * Configures the ALERT GPIO as an input with a falling edge interrupt, or
+ * starts the simulated ALERT source when `INA237_ALERT_SIMULATED` is set. With
+ * `INA237_HW_PROTECTION` the simulated source runs at the conversion period and
+ * the ALERT GPIO goes to the hardware protection.
+ */
+static void ina237_alert_init()
+{
+#if INA237_ALERT_SIMULATED || INA237_HW_PROTECTION
+#if INA237_ALERT_SIMULATED
+    const uint32_t period_us = INA237_ALERT_SIMULATED_PERIOD_US;
+#else
+    const uint32_t period_us = INA237_CONVERSION_PERIOD_US;
+#endif
+    const esp_timer_create_args_t timer_args = {
+        .callback = ina237_alert_simulated,
+        .arg = NULL,
+        .dispatch_method = ESP_TIMER_TASK,
+        .name = "ina237_alert_sim"};
+    esp_timer_handle_t timer_handle;
+    ESP_ERROR_CHECK(esp_timer_create(&timer_args, &timer_handle));
+    ESP_ERROR_CHECK(esp_timer_start_periodic(timer_handle, period_us));
+    ESP_LOGI(TAG, "Simulated ALERT source started (%lu us)", period_us);
+#endif
+#if INA237_HW_PROTECTION
+    hw_protection_init();
+#elif !INA237_ALERT_SIMULATED
+    gpio_config_t alert_config = {
+        .pin_bit_mask = 1ULL << INA237_ALERT_PIN,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_NEGEDGE};
+    ESP_ERROR_CHECK(gpio_config(&alert_config));
+
+    // The ISR service may already be installed by another module.
+    esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if (err != ESP_ERR_INVALID_STATE)
+    {
+        ESP_ERROR_CHECK(err);
+    }
+    ESP_ERROR_CHECK(gpio_isr_handler_add(INA237_ALERT_PIN, ina237_alert_isr, NULL));
+    ESP_LOGI(TAG, "INA237 ALERT interrupt enabled on GPIO %d", INA237_ALERT_PIN);
+#endif
+}
+
+/**
+ * @brief Adds the INA237 to the bus at the fastest speed that passes validation.
+ *
+ * Starting at `INA237_I2C_SPEED`, the device is added and its manufacturer ID
+ * is read back `INA237_PROBE_READS` times. If any read fails or returns the
+ * wrong value the device is removed and the next slower profile is tried.
+ *
+ * @return The SCL speed the device was added with (Hz).
+ */
+static uint32_t ina237_add_device()
+{
+    for (size_t i = 0; i < sizeof(ina237_bus_speeds) / sizeof(ina237_bus_speeds[0]); i++)
+    {
+        uint32_t speed = ina237_bus_speeds[i];
+        if (speed > INA237_I2C_SPEED)
+        {
+            continue;
+        }
+
+        i2c_add_device(i2c_handle, &ina_handle, (uint16_t)INA237_ADDRESS, speed);
+        esp_err_t err = i2c_validate_register(ina_handle, INA237_MANUFACTURER_ID_REG, INA237_MANUFACTURER_ID, INA237_PROBE_READS);
+        if (err == ESP_OK)
+        {
+            ESP_LOGI(TAG, "INA237 validated at %lu Hz", speed);
+            return speed;
+        }
+        ESP_LOGW(TAG, "INA237 failed validation at %lu Hz (%s), trying a slower speed", speed, esp_err_to_name(err));
+        i2c_remove_device(ina_handle);
+    }
+
+    // Nothing passed, keep the device on the bus at standard speed and carry on
+    ESP_LOGE(TAG, "INA237 failed validation at every speed, using %d Hz", I2C_SPEED_STANDARD);
+    i2c_add_device(i2c_handle, &ina_handle, (uint16_t)INA237_ADDRESS, I2C_SPEED_STANDARD);
+    return I2C_SPEED_STANDARD;
+}
 
 /**
  * @brief Initializes the measurement peripherals.
@@ -46,147 +257,277 @@ i2c_master_dev_handle_t ina_handle;     /**< Handle for the INA237 device. */
  */
 void measurement_intitialize()
 {
-    // Initialise the ADC unit
-    adc_unit_init(&adc_handle_1, ADC_UNIT_1, ADC_ULP_MODE_DISABLE);
-    // adc_unit_init(&adc_handle_2, ADC_UNIT_2, ADC_ULP_MODE_DISABLE);
-
-    // Initialise the ADC channel
-    adc_channel_init(adc_handle_1, ADC_CHANNEL_3, ADC_ATTEN_DB_12, ADC_BITWIDTH_12); // ADC_CHANNEL_3 ADC1 is GPIO 4, for internal NTC
-
-    // adc_channel_init(adc_handle_1, ADC_CHANNEL_0, ADC_ATTEN_DB_12, ADC_BITWIDTH_12); // ADC_CHANNEL_0 ADC1 is GPIO 1, for external NTC
+    // Scan all NTC channels on ADC1 in the background through DMA
+    adc_continuous_unit_init(&adc_handle_1, ntc_channels, NTC_COUNT, ADC_ATTEN_DB_12,
+                             NTC_ADC_SAMPLE_FREQ_HZ, NTC_ADC_FRAME_SIZE, NTC_ADC_BUFFER_SIZE);
 
-    // adc_channel_init(adc_handle_1, ADC_CHANNEL_1, ADC_ATTEN_DB_12, ADC_BITWIDTH_12); // ADC_CHANNEL_1 ADC1 is GPIO 2, for external NTC
-
-    // adc_channel_init(adc_handle_2, ADC_CHANNEL_6, ADC_ATTEN_DB_12, ADC_BITWIDTH_12); // ADC_CHANNEL_6 ADC2 is GPIO 17, for external NTC
+    // Build the NTC temperature tables once, so no log() is needed per sample
+    ntc_table_init(&ntc_table_internal, B_NTC_INTERNAL);
+    ntc_table_init(&ntc_table_external, B_NTC_EXTERNAL);
 
     // Handle for the I2C device
     i2c_init(&i2c_handle, I2C_SDA_PIN, I2C_SCL_PIN);
 
-    // Add the I2C device to the bus
-    i2c_add_device(i2c_handle, &ina_handle, (uint16_t)0b1000000, 100000);
+    // Add the I2C device to the bus at the fastest validated speed
+    ina237_scl_speed = ina237_add_device();
 
     // Configure the INA237 registers
-    i2c_write(ina_handle, 0x00, 0b0000000000000000); // CONFIG register
-    i2c_write(ina_handle, 0x01, 0b1011000000000000); // ADC configuration
-    i2c_write(ina_handle, 0x02, 0b0000100111000100); // Shunt calibration (Rshunt = 0.01 ohm, Current_LSB = 10/2^15) From page 29: https://www.ti.com/lit/ds/symlink/ina237.pdf
+    i2c_write(ina_handle, INA237_CONFIG_REG, 0b0000000000000000);     // CONFIG register
+#if FAST_CONTROL_ENABLED
+    i2c_write(ina_handle, INA237_ADC_CONFIG_REG, INA237_ADC_CONFIG_FAST); // Fast ADC configuration for the fast control path
+#else
+    i2c_write(ina_handle, INA237_ADC_CONFIG_REG, INA237_ADC_CONFIG);  // ADC configuration
+#endif
+    i2c_write(ina_handle, INA237_SHUNT_CAL_REG, INA237_SHUNT_CAL);    // Shunt calibration (Rshunt = 0.01 ohm, Current_LSB = 10/2^15) From page 29: https://www.ti.com/lit/ds/symlink/ina237.pdf
+#if INA237_HW_PROTECTION
+    i2c_write(ina_handle, INA237_DIAG_ALRT_REG, INA237_DIAG_ALRT_LIMITS); // Latch the limit alerts on the ALERT pin
+#else
+    i2c_write(ina_handle, INA237_DIAG_ALRT_REG, INA237_DIAG_ALRT_CNVR); // Route conversion ready to the ALERT pin
+#endif
+
+    // Wake the measurement task on every completed conversion
+    ina237_alert_init();
 
     ESP_LOGI(TAG, "Measurement peripherals initialized");
 }
 
 /**
- * @brief Calculate the NTC resistance from the raw ADC value.
+ * @brief Add one rectangle to a fixed-point integrator.
  *
- * This function calculates the NTC resistance based on the raw ADC value, the
- * voltage divider resistor value, and the maximum ADC value.
+ * @param integrator The integrator to update.
+ * @param raw The raw sensor value held over the time step.
+ * @param dt_us The time step in microseconds.
+ */
+static void fixed_integrator_add(FixedIntegrator *integrator, int64_t raw, int64_t dt_us)
+{
+    integrator->lsb_microseconds += raw * dt_us;
+
+    // Carry whole LSB-seconds over so the remainder never grows
+    if ((integrator->lsb_microseconds >= 1000000) || (integrator->lsb_microseconds <= -1000000))
+    {
+        integrator->lsb_seconds += integrator->lsb_microseconds / 1000000;
+        integrator->lsb_microseconds %= 1000000;
+    }
+}
+
+/**
+ * @brief Convert a fixed-point integrator to hours of the physical unit.
  *
- * @param raw_adc_value The raw ADC value read from the NTC sensor.
- * @param R1 The resistance of the voltage divider resistor (R1 = 10k ohm).
- * @param adc_max_value The maximum ADC value (4095 for 12-bit ADC).
- * @return The calculated NTC resistance.
+ * @param integrator The integrator to convert.
+ * @param lsb The size of one LSB in the physical unit (A or W).
+ * @return The integral in unit-hours (Ah or Wh).
  */
-float ntc_resistance_calculate(uint16_t raw_adc_value, float R1, int adc_max_value)
+static float fixed_integrator_hours(const FixedIntegrator *integrator, double lsb)
 {
-    float R = (((float)raw_adc_value / (float)adc_max_value) * R1) / (1 - ((float)raw_adc_value / (float)adc_max_value));
-    return R;
+    double lsb_seconds = (double)integrator->lsb_seconds + (double)integrator->lsb_microseconds / 1000000.0;
+    return (float)(lsb_seconds * lsb / 3600.0);
 }
 
 /**
- * @brief Calculate the temperature from the NTC resistance.
+ * @brief Check if a sensor is due on a sample.
  *
- * This function calculates the temperature based on the NTC resistance, the
- * reference resistance, the reference temperature, and the B value.
+ * @param sensor The sensor to check.
+ * @param sample Number of the sample about to be published.
+ * @return true if the sensor runs on this sample.
+ */
+static inline bool sensor_due(MeasurementSensor sensor, uint32_t sample)
+{
+    return (sample % sensor_schedule[sensor].period) == sensor_schedule[sensor].phase;
+}
+
+/**
+ * @brief Account one run of a sensor.
  *
- * @param B The B value of the NTC thermistor.
- * @param R The NTC resistance.
- * @return The calculated temperature.
+ * @param sensor The sensor that ran.
+ * @param start_cycles CPU cycle count when the run started.
  */
-float R_to_T(float B, float R)
+static inline void sensor_account(MeasurementSensor sensor, uint32_t start_cycles)
 {
-    float T_kelvin = 1 / ((1 / T0_NTC) + (1 / B) * log(R / R0_NTC));
-    float T_celcius = T_kelvin - 273.15; // Convert Kelvin to Celsius
-    return T_celcius;
+    sensor_schedule[sensor].cycles += esp_cpu_get_cycle_count() - start_cycles;
+    sensor_schedule[sensor].runs++;
+}
+
+/**
+ * @brief Convert the schedule counters into statistics and restart them.
+ *
+ * @param statistics The statistics to fill.
+ * @param period_us Length of the statistics period (us).
+ */
+static void sensor_statistics_update(MeasurementStatistics *statistics, int64_t period_us)
+{
+    for (int i = 0; i < SENSOR_COUNT; i++)
+    {
+        SensorSchedule *entry = &sensor_schedule[i];
+        statistics->sensors[i].rate_hz = (float)entry->runs * 1000000.0f / (float)period_us;
+        statistics->sensors[i].cpu_us = (entry->runs == 0) ? 0.0f : (float)entry->cycles / (float)entry->runs / CONFIG_ESP_DEFAULT_CPU_FREQ_MHZ;
+        entry->runs = 0;
+        entry->cycles = 0;
+    }
 }
 
 /**
  * @brief Measurement task for reading and processing sensor data.
  *
  * This task reads raw data from the INA237 sensor (voltage and current) and the
- * ADC channel (temperature), processes the data into meaningful values, and updates
- * the `measurement_queue`. The task maintains a 1 kHz sampling rate.
+ * NTC channels (temperature, averaged from the continuous ADC scan), processes the data
+ * into meaningful values, and updates
+ * the `measurement_ring`. The task runs once per INA237 conversion (~1 kHz),
+ * woken by the conversion ready alert.
  *
  * @param parameter Pointer to task parameters (can be NULL).
  */
 void measurement_task(void *paramter)
 {
+    measurement_task_handle = xTaskGetCurrentTaskHandle();
     measurement_intitialize();
-    MeasurementData measurements; /**< Struct to hold the processed measurement data. */
+    supervisor_register(SUPERVISED_MEASUREMENT, MEASUREMENT_DEADLINE_US);
+    MeasurementData measurements = {0}; /**< Struct to hold the processed measurement data. */
 
-    // Calculate Ah
-    TickType_t previous_tick = xTaskGetTickCount(); /**< Previous tick value for time calculations. */
-    TickType_t current_tick;                        /**< Current tick value for time calculations. */
-    float dt = 0;                                   /**< Time step in seconds. */
-    float dAh = 0;                                  /**< For calculating dAh. */
-    float dWh = 0;                                  /**< For caclulating dWh. */
+    MeasurementStatistics statistics = {0};           /**< Counters published to the statistics queue. */
+    TickType_t statistics_tick = xTaskGetTickCount(); /**< Tick of the last statistics update. */
+    int64_t statistics_time = esp_timer_get_time();   /**< Time of the last statistics update (us). */
+    uint32_t statistics_samples = 0;                  /**< Sample count at the last statistics update. */
+    I2CStatistics i2c_statistics;                     /**< Error counters of the I2C transfer layer. */
+    uint32_t pending_conversions = 0;                 /**< Conversions signalled since the last wake-up. */
 
-    float R_ntc_internal = 0;
-    float R_ntc_external_1 = 0;
-    float R_ntc_external_2 = 0;
-    float R_ntc_external_3 = 0;
+    // Calculate Ah and Wh
+    Ina237Raw raw = {0};                          /**< Raw INA237 registers of the latest good read. */
+    FixedIntegrator charge = {0};                 /**< Integrated current in current LSB-seconds. */
+    FixedIntegrator energy = {0};                 /**< Integrated power in power LSB-seconds. */
+    int64_t previous_time = esp_timer_get_time(); /**< Timestamp of the previous sample (us). */
+    int64_t dt_us = 0;                            /**< Time step in microseconds. */
+    LoadStatus load;                              /**< Snapshot of the load state. */
+    uint32_t load_resets = 0;                     /**< Reset count Ah and Wh were last zeroed for. */
+
+    uint16_t raw_temp[NTC_COUNT] = {0}; /**< Averaged raw ADC value of each NTC. */
 
     while (1)
     {
-        // Read raw sensors
-        float raw_voltage = i2c_read(ina_handle, INA237_VBUS_REG);
-        float raw_current = i2c_read(ina_handle, INA237_CURRENT_REG);
-        uint16_t raw_temp_internal = adc_read(adc_handle_1, ADC_CHANNEL_0);
-        // uint16_t raw_temp_external_1 = adc_read(adc_handle_1, ADC_CHANNEL_1);
-        // uint16_t raw_temp_external_2 = adc_read(adc_handle_1, ADC_CHANNEL_3);
-        // uint16_t raw_temp_external_3 = adc_read(adc_handle_2, ADC_CHANNEL_6);
-
-        R_ntc_internal = ntc_resistance_calculate(raw_temp_internal, R1_NTC_VDIV, 4095);
-        // R_ntc_external_1 = ntc_resistance_calculate(raw_temp_external_1, R1_NTC_VDIV, 4095);
-        // R_ntc_external_2 = ntc_resistance_calculate(raw_temp_external_2, R1_NTC_VDIV, 4095);
-        // R_ntc_external_3 = ntc_resistance_calculate(raw_temp_external_3, R1_NTC_VDIV, 4095);
-
-        measurements.temperature_internal = 20; // R_to_T(B_NTC_INTERNAL, R_ntc_internal);
-        // measurements.temperature_external_1 = R_to_T(B_NTC_EXTERNAL, R_ntc_external_1);
-        // measurements.temperature_external_2 = R_to_T(B_NTC_EXTERNAL, R_ntc_external_2);
-        // measurements.temperature_external_3 = R_to_T(B_NTC_EXTERNAL, R_ntc_external_3);
-
-        // Convert raw values into usable values:
-        // Convert the raw voltage data to actualt voltage value
-        // Conversion factor: 3.125mV/LSB
-        measurements.bus_voltage = (float)raw_voltage * 3.125 / 1000.0; // Convert to volts (V)
-
-        // Convert the raw current data to actual current value
-        measurements.current = (float)raw_current * (8.0 / 32768.0);
-
-        // Calculate power
-        measurements.power = measurements.bus_voltage * measurements.current;
-
-        // Calculate Ah and Wh
-        current_tick = xTaskGetTickCount();
-        dt = (float)(current_tick - previous_tick) / (float)configTICK_RATE_HZ;
-
-        if (xEventGroupGetBits(signal_event_group) & START_STOP_BIT)
+        // Wait for the INA237 to signal a completed conversion
+        pending_conversions = ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(INA237_ALERT_TIMEOUT_MS));
+        if (ina237_count_conversions(pending_conversions, &statistics))
+        {
+            // Timestamp the sample with the time the conversion completed
+            taskENTER_CRITICAL(&alert_lock);
+            measurements.timestamp_us = alert_time_us;
+            taskEXIT_CRITICAL(&alert_lock);
+        }
+        else
+        {
+            // No alert arrived, read anyway so the data never goes stale
+            measurements.timestamp_us = esp_timer_get_time();
+        }
+
+        uint32_t sample = statistics.samples; /**< Number of this sample, drives the sensor schedule. */
+        uint32_t start_cycles;                /**< CPU cycle count at the start of a sensor run. */
+
+        if (sensor_due(SENSOR_INA237, sample))
         {
-            dAh = measurements.current * dt / 3600;
-            measurements.Ah += dAh;
+            start_cycles = esp_cpu_get_cycle_count();
 
-            dWh = measurements.power * dt / 3600;
-            measurements.Wh += dWh;
+            // Read and convert shunt and bus voltage, die temperature, current and power. A failed read keeps
+            // the previous values and flags the sample, the next conversion gets a fresh attempt.
+            if (ina237_read_sample(ina_handle, pending_conversions != 0, &raw, &measurements) != MEASUREMENT_I2C_ERROR)
+            {
+                fast_control_feed(raw.current);
+            }
+#if INA237_HW_PROTECTION
+            hw_protection_service(ina_handle);
+#endif
+            sensor_account(SENSOR_INA237, start_cycles);
+        }
+
+        if (sensor_due(SENSOR_NTC_INTERNAL, sample))
+        {
+            start_cycles = esp_cpu_get_cycle_count();
+
+            // Average the NTC frames the DMA has completed since the last run. All channels are
+            // averaged here, the external probes only convert the latest averages at their own rate.
+            adc_continuous_read_average(adc_handle_1, ntc_frame, sizeof(ntc_frame), ntc_channels, NTC_COUNT, raw_temp);
 
-            previous_tick = current_tick;
+            // Table lookup with interpolation, replaces ntc_resistance_calculate() and R_to_T()
+            measurements.temperature_internal = ntc_table_lookup(&ntc_table_internal, raw_temp[NTC_INTERNAL]);
+            sensor_account(SENSOR_NTC_INTERNAL, start_cycles);
+        }
+
+        if (sensor_due(SENSOR_NTC_EXTERNAL, sample))
+        {
+            start_cycles = esp_cpu_get_cycle_count();
+            measurements.temperature_external_1 = ntc_table_lookup(&ntc_table_external, raw_temp[NTC_EXTERNAL_1]);
+            measurements.temperature_external_2 = ntc_table_lookup(&ntc_table_external, raw_temp[NTC_EXTERNAL_2]);
+            measurements.temperature_external_3 = ntc_table_lookup(&ntc_table_external, raw_temp[NTC_EXTERNAL_3]);
+            sensor_account(SENSOR_NTC_EXTERNAL, start_cycles);
+        }
+
+        // Calculate Ah and Wh. The previous timestamp is advanced on every sample, so a start
+        // only integrates from the sample before it and not over the whole idle gap.
+        dt_us = measurements.timestamp_us - previous_time;
+        previous_time = measurements.timestamp_us;
+
+        // The state is read after the conversion, so a sample converted after a reset was published always
+        // carries zeroed counters. The safety task relies on this to complete the reset.
+        load_state_get(&load);
+        if ((load.state == LOAD_RUNNING) && (dt_us > 0))
+        {
+            fixed_integrator_add(&charge, raw.current, dt_us);
+            fixed_integrator_add(&energy, raw.power, dt_us);
+        }
+
+        if (load.resets != load_resets)
+        {
+            charge = (FixedIntegrator){0};
+            energy = (FixedIntegrator){0};
+            load_resets = load.resets;
+        }
+
+        measurements.charge_lsb_seconds = charge.lsb_seconds;
+        measurements.energy_lsb_seconds = energy.lsb_seconds;
+        measurements.Ah = fixed_integrator_hours(&charge, INA237_CURRENT_LSB);
+        measurements.Wh = fixed_integrator_hours(&energy, INA237_POWER_LSB);
+        measurements.list_step = list_mode_stamp();
+        sample_ring_publish(&measurement_ring, &measurements);
+
+        // Check the new sample, then run the control loop on it
+        if (safety_task_handle != NULL)
+        {
+            xTaskNotifyGive(safety_task_handle);
+        }
+        if (control_task_handle != NULL)
+        {
+            xTaskNotifyGive(control_task_handle);
         }
-        xQueueOverwrite(measurement_queue, &measurements);
+        statistics.samples++;
+        supervisor_heartbeat(SUPERVISED_MEASUREMENT, MEASUREMENT_DEADLINE_US);
 
-        if (xEventGroupGetBits(signal_event_group) & RESET_BIT)
+        // Publish the statistics once per period
+        if ((xTaskGetTickCount() - statistics_tick) >= pdMS_TO_TICKS(STATISTICS_PERIOD_MS))
         {
-            measurements.Wh = 0;
-            measurements.Ah = 0;
+            int64_t now = esp_timer_get_time();
+            statistics_tick = xTaskGetTickCount();
+            statistics.conversions = alert_count;
+            i2c_get_statistics(&i2c_statistics);
+            statistics.i2c_retries = i2c_statistics.retries;
+            statistics.i2c_recoveries = i2c_statistics.recoveries;
+            statistics.i2c_failures = i2c_statistics.failures;
+            statistics.scl_speed_hz = ina237_scl_speed;
+            statistics.samples_per_second = (float)(statistics.samples - statistics_samples) * 1000000.0f / (float)(now - statistics_time);
+            sensor_statistics_update(&statistics, now - statistics_time);
+            statistics_samples = statistics.samples;
+            statistics_time = now;
+            xQueueOverwrite(measurement_statistics_queue, &statistics);
+            ESP_LOGI(TAG, "%.1f samples/s at %lu Hz SCL. Conversions: %lu, samples: %lu, missed: %lu, duplicates: %lu",
+                     statistics.samples_per_second, statistics.scl_speed_hz,
+                     statistics.conversions, statistics.samples, statistics.missed_conversions, statistics.duplicate_samples);
+            ESP_LOGI(TAG, "INA237 %.1f Hz %.1f us, internal NTC %.1f Hz %.1f us, external NTC %.1f Hz %.1f us",
+                     statistics.sensors[SENSOR_INA237].rate_hz, statistics.sensors[SENSOR_INA237].cpu_us,
+                     statistics.sensors[SENSOR_NTC_INTERNAL].rate_hz, statistics.sensors[SENSOR_NTC_INTERNAL].cpu_us,
+                     statistics.sensors[SENSOR_NTC_EXTERNAL].rate_hz, statistics.sensors[SENSOR_NTC_EXTERNAL].cpu_us);
+            if (statistics.i2c_failures != 0)
+            {
+                ESP_LOGW(TAG, "I2C retries: %lu, recoveries: %lu, failed samples: %lu",
+                         statistics.i2c_retries, statistics.i2c_recoveries, statistics.i2c_failures);
+            }
         }
         // ESP_LOGI(TAG, "raw_current from INA= %f", raw_current);
-        //  Maintain 1 kHz sampling rate
-        vTaskDelay(pdMS_TO_TICKS(1));
     }
 }
@@ -21,7 +21,7 @@
  *
  * This task reads raw data from the ADC and I2C sensors, processes it into
  * meaningful values (voltage, current, power, temperature), and updates the
- * `measurement_queue` for other tasks to use.
+ * `measurement_ring` for other tasks to use.
  *
  * @param pvParameters Pointer to task parameters (can be NULL).
  */
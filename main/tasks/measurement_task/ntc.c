@@ -0,0 +1,122 @@
+#include "ntc.h"
+#include "esp_log.h"
+#include "config.h"
+#include "math.h"
+
+/**
+ * @file ntc.c
+ * @brief Implementation of the NTC temperature conversion.
+ *
+ * The exact conversion needs a divide and a double precision log() per reading,
+ * which is a software routine on the ESP32-S3. Instead, a table of temperatures
+ * is built once per B value at start-up, and each reading is converted with one
+ * table lookup and an integer linear interpolation between two entries.
+ *
+ * With 32 ADC codes per segment the interpolation error stays well below the
+ * tolerance of the thermistors over the range the load operates in. The table
+ * is clamped to `NTC_TABLE_MIN_T` and `NTC_TABLE_MAX_T` so open or shorted probes
+ * give a defined reading instead of infinity.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+static const char *TAG = "NTC"; /**< Tag for logging messages from the NTC module. */
+
+/**
+ * @brief Calculate the NTC resistance from the raw ADC value.
+ *
+ * This function calculates the NTC resistance based on the raw ADC value, the
+ * voltage divider resistor value, and the maximum ADC value.
+ *
+ * @param raw_adc_value The raw ADC value read from the NTC sensor.
+ * @param R1 The resistance of the voltage divider resistor (R1 = 10k ohm).
+ * @param adc_max_value The maximum ADC value (4095 for 12-bit ADC).
+ * @return The calculated NTC resistance.
+ */
+float ntc_resistance_calculate(uint16_t raw_adc_value, float R1, int adc_max_value)
+{
+    float R = (((float)raw_adc_value / (float)adc_max_value) * R1) / (1 - ((float)raw_adc_value / (float)adc_max_value));
+    return R;
+}
+
+/**
+ * @brief Calculate the temperature from the NTC resistance.
+ *
+ * This function calculates the temperature based on the NTC resistance, the
+ * reference resistance, the reference temperature, and the B value.
+ *
+ * @param B The B value of the NTC thermistor.
+ * @param R The NTC resistance.
+ * @return The calculated temperature.
+ */
+float R_to_T(float B, float R)
+{
+    float T_kelvin = 1 / ((1 / T0_NTC) + (1 / B) * log(R / R0_NTC));
+    float T_celcius = T_kelvin - 273.15; // Convert Kelvin to Celsius
+    return T_celcius;
+}
+
+/**
+ * @brief Build the temperature table for a B value.
+ *
+ * Every entry is calculated with the exact equation. The codes 0 and
+ * `NTC_ADC_MAX` correspond to a resistance of zero and infinity, so the
+ * calculation is done one code inside the range and the result clamped.
+ *
+ * @param table The table to fill.
+ * @param B The B value of the NTC thermistor.
+ */
+void ntc_table_init(NtcTable *table, float B)
+{
+    for (int i = 0; i < NTC_TABLE_SIZE; i++)
+    {
+        int code = i << NTC_TABLE_SHIFT;
+        if (code < 1)
+        {
+            code = 1;
+        }
+        else if (code > NTC_ADC_MAX - 1)
+        {
+            code = NTC_ADC_MAX - 1;
+        }
+
+        float T = R_to_T(B, ntc_resistance_calculate(code, R1_NTC_VDIV, NTC_ADC_MAX));
+        if (T < NTC_TABLE_MIN_T)
+        {
+            T = NTC_TABLE_MIN_T;
+        }
+        else if (T > NTC_TABLE_MAX_T)
+        {
+            T = NTC_TABLE_MAX_T;
+        }
+        table->centi_celsius[i] = (int16_t)lroundf(T * 100.0f);
+    }
+    ESP_LOGI(TAG, "NTC table built for B = %.0f (%d entries)", B, NTC_TABLE_SIZE);
+}
+
+/**
+ * @brief Look up the temperature for a raw ADC value.
+ *
+ * The upper bits of the ADC code select the segment and the lower
+ * `NTC_TABLE_SHIFT` bits interpolate between its two end points.
+ *
+ * @param table A table built by ntc_table_init().
+ * @param raw_adc_value The raw ADC value read from the NTC sensor.
+ * @return The temperature in °C.
+ */
+float ntc_table_lookup(const NtcTable *table, uint16_t raw_adc_value)
+{
+    if (raw_adc_value > NTC_ADC_MAX)
+    {
+        raw_adc_value = NTC_ADC_MAX;
+    }
+
+    int index = raw_adc_value >> NTC_TABLE_SHIFT;
+    int fraction = raw_adc_value & ((1 << NTC_TABLE_SHIFT) - 1);
+    int32_t low = table->centi_celsius[index];
+    int32_t high = table->centi_celsius[index + 1];
+
+    int32_t centi_celsius = low + (((high - low) * fraction) >> NTC_TABLE_SHIFT);
+    return (float)centi_celsius * 0.01f;
+}
@@ -0,0 +1,67 @@
+#ifndef NTC_H
+#define NTC_H
+#include <stdint.h>
+#include "config.h"
+
+/**
+ * @file ntc.h
+ * @brief Header file for the NTC temperature conversion.
+ *
+ * This file contains the declarations for converting raw ADC values from the
+ * NTC voltage dividers into temperatures, both through the exact Beta equation
+ * and through a precomputed table with linear interpolation.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+#define NTC_TABLE_SIZE ((NTC_ADC_MAX + 1) / (1 << NTC_TABLE_SHIFT) + 1) /**< Entries in a temperature table, one per segment boundary. */
+
+/**
+ * @brief Temperature table for one NTC B value.
+ *
+ * Holds the temperature in hundredths of a degree at every `1 << NTC_TABLE_SHIFT`
+ * ADC codes. Values in between are found by linear interpolation.
+ */
+typedef struct
+{
+    int16_t centi_celsius[NTC_TABLE_SIZE]; /**< Temperature at each table entry (0.01 °C). */
+} NtcTable;
+
+/**
+ * @brief Calculate the NTC resistance from the raw ADC value.
+ *
+ * @param raw_adc_value The raw ADC value read from the NTC sensor.
+ * @param R1 The resistance of the voltage divider resistor (R1 = 10k ohm).
+ * @param adc_max_value The maximum ADC value (4095 for 12-bit ADC).
+ * @return The calculated NTC resistance.
+ */
+float ntc_resistance_calculate(uint16_t raw_adc_value, float R1, int adc_max_value);
+
+/**
+ * @brief Calculate the temperature from the NTC resistance.
+ *
+ * @param B The B value of the NTC thermistor.
+ * @param R The NTC resistance.
+ * @return The calculated temperature.
+ */
+float R_to_T(float B, float R);
+
+/**
+ * @brief Build the temperature table for a B value.
+ *
+ * @param table The table to fill.
+ * @param B The B value of the NTC thermistor.
+ */
+void ntc_table_init(NtcTable *table, float B);
+
+/**
+ * @brief Look up the temperature for a raw ADC value.
+ *
+ * @param table A table built by ntc_table_init().
+ * @param raw_adc_value The raw ADC value read from the NTC sensor.
+ * @return The temperature in °C.
+ */
+float ntc_table_lookup(const NtcTable *table, uint16_t raw_adc_value);
+
+#endif // NTC_H
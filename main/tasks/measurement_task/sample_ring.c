@@ -0,0 +1,191 @@
+#include <string.h>
+#include "sample_ring.h"
+
+/**
+ * @file sample_ring.c
+ * @brief Implementation of the measurement sample ring.
+ *
+ * Every slot carries the sequence number of the sample it holds. The writer
+ * clears the number, copies the sample and then stores the new number, all with
+ * release ordering. A reader checks the number before and after copying the
+ * sample, so a copy that raced with the writer is detected and thrown away
+ * instead of being returned torn. No locks or kernel calls are used on either
+ * side, so a slow reader can never stall the measurement task.
+ *
+ * Sequence numbers start at 1 and skip 0 when they wrap, 0 marks a slot that is
+ * empty or being written.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Sequence number that follows another, skipping 0.
+ *
+ * @param sequence The current sequence number.
+ * @return The next sequence number.
+ */
+static inline uint32_t sample_sequence_next(uint32_t sequence)
+{
+    sequence++;
+    return (sequence == 0) ? 1 : sequence;
+}
+
+/**
+ * @brief Publish a sample.
+ *
+ * Only one task may publish to a ring.
+ *
+ * @param ring The ring to publish to.
+ * @param sample The sample, its sequence field is set by this function.
+ */
+void sample_ring_publish(SampleRing *ring, MeasurementData *sample)
+{
+    uint32_t sequence = sample_sequence_next(atomic_load_explicit(&ring->head, memory_order_relaxed));
+    SampleSlot *slot = &ring->slots[sequence % SAMPLE_RING_LENGTH];
+
+    sample->sequence = sequence;
+    atomic_store_explicit(&slot->sequence, 0, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    memcpy(&slot->data, sample, sizeof(MeasurementData));
+    atomic_store_explicit(&slot->sequence, sequence, memory_order_release);
+    atomic_store_explicit(&ring->head, sequence, memory_order_release);
+}
+
+/**
+ * @brief Read a sample by sequence number.
+ *
+ * @param ring The ring to read from.
+ * @param sequence Sequence number of the sample.
+ * @param sample Output, the sample.
+ * @return true if the sample was read, false if it is not published yet or already overwritten.
+ */
+bool sample_ring_read(const SampleRing *ring, uint32_t sequence, MeasurementData *sample)
+{
+    const SampleSlot *slot = &ring->slots[sequence % SAMPLE_RING_LENGTH];
+
+    if ((sequence == 0) || (atomic_load_explicit(&slot->sequence, memory_order_acquire) != sequence))
+    {
+        return false;
+    }
+    memcpy(sample, &slot->data, sizeof(MeasurementData));
+    atomic_thread_fence(memory_order_acquire);
+
+    // The writer clears the sequence number before touching the data, so an unchanged number means an intact copy
+    return atomic_load_explicit(&slot->sequence, memory_order_relaxed) == sequence;
+}
+
+/**
+ * @brief Read the newest sample.
+ *
+ * A read can only fail if the writer lapped the reader in between, so the
+ * newest sample is looked up again until one is read intact.
+ *
+ * @param ring The ring to read from.
+ * @param sample Output, the newest sample.
+ * @return true if a sample was read, false if nothing has been published yet.
+ */
+bool sample_ring_latest(const SampleRing *ring, MeasurementData *sample)
+{
+    uint32_t head;
+    do
+    {
+        head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        if (head == 0)
+        {
+            return false;
+        }
+    } while (!sample_ring_read(ring, head, sample));
+    return true;
+}
+
+/**
+ * @brief Copy the newest samples, oldest first.
+ *
+ * The window ends at the newest sample when the call starts. If the writer
+ * overwrites the oldest samples during the copy, the window is shortened to the
+ * consecutive samples that were read intact.
+ *
+ * @param ring The ring to read from.
+ * @param samples Output array of at least count samples.
+ * @param count Number of samples wanted, at most SAMPLE_RING_LENGTH - 1.
+ * @return Number of consecutive samples copied.
+ */
+size_t sample_ring_window(const SampleRing *ring, MeasurementData *samples, size_t count)
+{
+    uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+    size_t copied = 0;
+
+    if (count > SAMPLE_RING_LENGTH - 1)
+    {
+        count = SAMPLE_RING_LENGTH - 1;
+    }
+
+    // Walk backwards from the newest sample, so a lapping writer only cuts the old end of the window
+    for (size_t i = 0; i < count; i++)
+    {
+        if (!sample_ring_read(ring, head - i, &samples[count - 1 - i]))
+        {
+            break;
+        }
+        copied++;
+    }
+
+    if (copied < count)
+    {
+        memmove(samples, &samples[count - copied], copied * sizeof(MeasurementData));
+    }
+    return copied;
+}
+
+/**
+ * @brief Start a reader at the next sample to be published.
+ *
+ * @param reader The reader to initialise.
+ * @param ring The ring it reads from.
+ */
+void sample_reader_init(SampleReader *reader, const SampleRing *ring)
+{
+    reader->next = sample_sequence_next(atomic_load_explicit(&ring->head, memory_order_acquire));
+    reader->missed = 0;
+}
+
+/**
+ * @brief Read the next sample in order.
+ *
+ * If the reader fell more than a ring length behind, it skips to the oldest
+ * sample still available and counts the skipped samples in `missed`.
+ *
+ * @param reader The reader.
+ * @param ring The ring it reads from.
+ * @param sample Output, the next sample.
+ * @return true if a sample was read, false if the reader is up to date.
+ */
+bool sample_reader_next(SampleReader *reader, const SampleRing *ring, MeasurementData *sample)
+{
+    while (1)
+    {
+        uint32_t head = atomic_load_explicit(&ring->head, memory_order_acquire);
+        int32_t behind = (int32_t)(head - reader->next);
+
+        if ((head == 0) || (behind < 0))
+        {
+            return false;
+        }
+
+        // Skip to half a ring behind the writer, so the next reads are not lapped straight away
+        if (behind >= SAMPLE_RING_LENGTH - 1)
+        {
+            uint32_t oldest = head - SAMPLE_RING_LENGTH / 2;
+            oldest = (oldest == 0) ? 1 : oldest;
+            reader->missed += oldest - reader->next;
+            reader->next = oldest;
+        }
+
+        if (sample_ring_read(ring, reader->next, sample))
+        {
+            reader->next = sample_sequence_next(reader->next);
+            return true;
+        }
+    }
+}
@@ -0,0 +1,111 @@
+#ifndef SAMPLE_RING_H
+#define SAMPLE_RING_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdatomic.h>
+#include "globals.h"
+#include "config.h"
+
+/**
+ * @file sample_ring.h
+ * @brief Header file for the measurement sample ring.
+ *
+ * This file contains the declarations for a lock-free ring of timestamped
+ * measurement samples. The measurement task is the only writer, any number of
+ * tasks can read from it without kernel calls.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief One slot of the sample ring.
+ */
+typedef struct
+{
+    atomic_uint_least32_t sequence; /**< Sequence number of the sample in the slot, 0 while it is being written. */
+    MeasurementData data;           /**< The sample. */
+} SampleSlot;
+
+/**
+ * @brief Single producer, multiple consumer ring of measurement samples.
+ */
+typedef struct
+{
+    SampleSlot slots[SAMPLE_RING_LENGTH]; /**< Sample storage, sample n is in slot n % SAMPLE_RING_LENGTH. */
+    atomic_uint_least32_t head;           /**< Sequence number of the newest published sample, 0 if none. */
+} SampleRing;
+
+/**
+ * @brief Position of one consumer in the sample ring.
+ */
+typedef struct
+{
+    uint32_t next;   /**< Sequence number of the next sample to read. */
+    uint32_t missed; /**< Samples overwritten before this reader got to them. */
+} SampleReader;
+
+extern SampleRing measurement_ring; /**< Ring of processed measurement samples. Declared in main.c */
+
+/**
+ * @brief Publish a sample.
+ *
+ * Only one task may publish to a ring.
+ *
+ * @param ring The ring to publish to.
+ * @param sample The sample, its sequence field is set by this function.
+ */
+void sample_ring_publish(SampleRing *ring, MeasurementData *sample);
+
+/**
+ * @brief Read a sample by sequence number.
+ *
+ * @param ring The ring to read from.
+ * @param sequence Sequence number of the sample.
+ * @param sample Output, the sample.
+ * @return true if the sample was read, false if it is not published yet or already overwritten.
+ */
+bool sample_ring_read(const SampleRing *ring, uint32_t sequence, MeasurementData *sample);
+
+/**
+ * @brief Read the newest sample.
+ *
+ * @param ring The ring to read from.
+ * @param sample Output, the newest sample.
+ * @return true if a sample was read, false if nothing has been published yet.
+ */
+bool sample_ring_latest(const SampleRing *ring, MeasurementData *sample);
+
+/**
+ * @brief Copy the newest samples, oldest first.
+ *
+ * @param ring The ring to read from.
+ * @param samples Output array of at least count samples.
+ * @param count Number of samples wanted, at most SAMPLE_RING_LENGTH - 1.
+ * @return Number of consecutive samples copied.
+ */
+size_t sample_ring_window(const SampleRing *ring, MeasurementData *samples, size_t count);
+
+/**
+ * @brief Start a reader at the next sample to be published.
+ *
+ * @param reader The reader to initialise.
+ * @param ring The ring it reads from.
+ */
+void sample_reader_init(SampleReader *reader, const SampleRing *ring);
+
+/**
+ * @brief Read the next sample in order.
+ *
+ * If the reader fell more than a ring length behind, it skips to the oldest
+ * sample still available and counts the skipped samples in `missed`.
+ *
+ * @param reader The reader.
+ * @param ring The ring it reads from.
+ * @param sample Output, the next sample.
+ * @return true if a sample was read, false if the reader is up to date.
+ */
+bool sample_reader_next(SampleReader *reader, const SampleRing *ring, MeasurementData *sample);
+
+#endif // SAMPLE_RING_H
@@ -0,0 +1,219 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_partition.h"
+#include "spi_flash_mmap.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "blackbox.h"
+#include "sample_ring.h"
+
+/**
+ * @file blackbox.c
+ * @brief Implementation of the fault recorder.
+ *
+ * The partition is split into slots of whole flash sectors, one record each,
+ * used round-robin. Record n goes to slot n % slots, so the newest records are
+ * found again after a reset by the highest record number.
+ *
+ * The controller state and the noted trip are shared between the control task,
+ * the safety task and the HMI task, and protected by a spinlock. The record is
+ * only built and written by the HMI task.
+ *
+ * Erasing and writing the flash disables the cache and stalls the tasks for a
+ * few tens of milliseconds. This only happens after a trip, when the relays
+ * are already open, and the protection interrupt runs from IRAM.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+static const char *TAG = "BLACKBOX"; /**< Tag for logging messages from the fault recorder. */
+
+#define BLACKBOX_SLOT_SIZE (((sizeof(BlackboxRecord) + SPI_FLASH_SEC_SIZE - 1) / SPI_FLASH_SEC_SIZE) * SPI_FLASH_SEC_SIZE) /**< Flash taken by one record, whole sectors. */
+
+/**
+ * @brief A trip waiting for its post-trigger samples.
+ */
+typedef struct
+{
+    bool pending;              /**< true from the trigger until the record is written. */
+    uint32_t cause;            /**< safety_event_group bits. */
+    uint32_t trigger_sequence; /**< Sequence number of the trigger sample. */
+    int64_t trigger_us;        /**< Timestamp of the trigger sample (us). */
+    int64_t noted_us;          /**< Time the trip was noted, for the post-trigger timeout (us). */
+    BlackboxControl control;   /**< Controller state when the trip was noted. */
+} BlackboxTrigger;
+
+static const esp_partition_t *blackbox_partition = NULL;          /**< The blackbox partition, NULL if there is none. */
+static uint32_t blackbox_slots = 0;                               /**< Records the partition holds. */
+static uint32_t blackbox_newest = 0;                              /**< Number of the newest record, 0 if none. */
+static BlackboxControl blackbox_control = {0};                    /**< Latest controller state. */
+static BlackboxTrigger blackbox_trigger_state = {0};              /**< The trip being recorded. */
+static portMUX_TYPE blackbox_lock = portMUX_INITIALIZER_UNLOCKED; /**< Protects the controller state and the trip. */
+
+/**
+ * @brief Find the partition and the number of the newest record.
+ *
+ * Called once at startup. Without the partition trips are not recorded.
+ */
+void blackbox_init(void)
+{
+    blackbox_partition = esp_partition_find_first(ESP_PARTITION_TYPE_DATA, BLACKBOX_PARTITION_SUBTYPE, BLACKBOX_PARTITION_LABEL);
+    if (blackbox_partition == NULL)
+    {
+        ESP_LOGW(TAG, "No \"%s\" partition, faults are not recorded", BLACKBOX_PARTITION_LABEL);
+        return;
+    }
+    blackbox_slots = blackbox_partition->size / BLACKBOX_SLOT_SIZE;
+
+    // Only the start of each record is needed to find the newest
+    for (uint32_t slot = 0; slot < blackbox_slots; slot++)
+    {
+        uint32_t header[2];
+        if ((esp_partition_read(blackbox_partition, slot * BLACKBOX_SLOT_SIZE, header, sizeof(header)) == ESP_OK) &&
+            (header[0] == BLACKBOX_MAGIC) && (header[1] > blackbox_newest))
+        {
+            blackbox_newest = header[1];
+        }
+    }
+    ESP_LOGI(TAG, "%lu record slots, newest record %lu", blackbox_slots, blackbox_newest);
+}
+
+/**
+ * @brief Note the state of the controller, called by the control task on every update.
+ *
+ * @param control The controller state.
+ */
+void blackbox_note_control(const BlackboxControl *control)
+{
+    taskENTER_CRITICAL(&blackbox_lock);
+    blackbox_control = *control;
+    taskEXIT_CRITICAL(&blackbox_lock);
+}
+
+/**
+ * @brief Note a trip on a sample, called by the safety task after the relays are open.
+ *
+ * Ignored while an earlier trip is still being recorded.
+ *
+ * @param cause The safety_event_group bits.
+ * @param sample The sample the trip was seen on.
+ */
+void blackbox_trigger(uint32_t cause, const MeasurementData *sample)
+{
+    if (blackbox_partition == NULL)
+    {
+        return;
+    }
+
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&blackbox_lock);
+    if (!blackbox_trigger_state.pending)
+    {
+        blackbox_trigger_state.pending = true;
+        blackbox_trigger_state.cause = cause;
+        blackbox_trigger_state.trigger_sequence = sample->sequence;
+        blackbox_trigger_state.trigger_us = sample->timestamp_us;
+        blackbox_trigger_state.noted_us = now;
+        blackbox_trigger_state.control = blackbox_control;
+    }
+    taskEXIT_CRITICAL(&blackbox_lock);
+}
+
+/**
+ * @brief Copy the samples of a noted trip and write them to flash once they are in.
+ *
+ * Called by the lowest priority task, since writing waits for the flash.
+ */
+void blackbox_service(void)
+{
+    taskENTER_CRITICAL(&blackbox_lock);
+    BlackboxTrigger trigger = blackbox_trigger_state;
+    taskEXIT_CRITICAL(&blackbox_lock);
+
+    if (!trigger.pending)
+    {
+        return;
+    }
+
+    // Wait for the post-trigger samples, or record what there is if the samples have stopped
+    MeasurementData sample;
+    bool complete = sample_ring_latest(&measurement_ring, &sample) &&
+                    (sample.sequence - trigger.trigger_sequence >= BLACKBOX_POST_SAMPLES - 1);
+    if (!complete && (esp_timer_get_time() - trigger.noted_us < BLACKBOX_POST_TIMEOUT_US))
+    {
+        return;
+    }
+
+    static BlackboxRecord record; // Too large for the task stack
+    memset(&record, 0, sizeof(record));
+    record.magic = BLACKBOX_MAGIC;
+    record.number = blackbox_newest + 1;
+    record.cause = trigger.cause;
+    record.trigger_sequence = trigger.trigger_sequence;
+    record.trigger_us = trigger.trigger_us;
+    record.control = trigger.control;
+
+    // Samples the ring has already overwritten, or that never came, are left out
+    uint32_t first = (trigger.trigger_sequence > BLACKBOX_PRE_SAMPLES) ? trigger.trigger_sequence - BLACKBOX_PRE_SAMPLES : 1;
+    for (uint32_t sequence = first; sequence < trigger.trigger_sequence + BLACKBOX_POST_SAMPLES; sequence++)
+    {
+        if (sample_ring_read(&measurement_ring, sequence, &sample))
+        {
+            BlackboxSample *recorded = &record.samples[record.count++];
+            recorded->timestamp_us = sample.timestamp_us;
+            recorded->sequence = sample.sequence;
+            recorded->bus_voltage = sample.bus_voltage;
+            recorded->current = sample.current;
+            recorded->power = sample.power;
+            recorded->temperature_internal = sample.temperature_internal;
+            recorded->quality = sample.quality;
+            record.pre_count += (sequence < trigger.trigger_sequence) ? 1 : 0;
+        }
+    }
+
+    size_t offset = (record.number % blackbox_slots) * BLACKBOX_SLOT_SIZE;
+    esp_err_t err = esp_partition_erase_range(blackbox_partition, offset, BLACKBOX_SLOT_SIZE);
+    if (err == ESP_OK)
+    {
+        err = esp_partition_write(blackbox_partition, offset, &record, sizeof(record));
+    }
+    if (err == ESP_OK)
+    {
+        blackbox_newest = record.number;
+        ESP_LOGI(TAG, "Recorded fault %lu, cause 0x%02lx, %lu samples (%lu before the trigger)", record.number,
+                 record.cause, record.count, record.pre_count);
+    }
+    else
+    {
+        ESP_LOGE(TAG, "Could not write fault record (%s)", esp_err_to_name(err));
+    }
+
+    taskENTER_CRITICAL(&blackbox_lock);
+    blackbox_trigger_state.pending = false;
+    taskEXIT_CRITICAL(&blackbox_lock);
+}
+
+/**
+ * @brief Read a record back from flash.
+ *
+ * @param age 0 for the newest record, 1 for the one before, and so on.
+ * @param record Output, the record.
+ * @return true if the record exists.
+ */
+bool blackbox_read(uint32_t age, BlackboxRecord *record)
+{
+    uint32_t newest = blackbox_newest;
+    if ((blackbox_partition == NULL) || (age >= newest) || (age >= blackbox_slots))
+    {
+        return false;
+    }
+
+    uint32_t number = newest - age;
+    if (esp_partition_read(blackbox_partition, (number % blackbox_slots) * BLACKBOX_SLOT_SIZE, record, sizeof(*record)) != ESP_OK)
+    {
+        return false;
+    }
+    return (record->magic == BLACKBOX_MAGIC) && (record->number == number);
+}
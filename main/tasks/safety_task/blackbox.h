@@ -0,0 +1,106 @@
+#ifndef BLACKBOX_H
+#define BLACKBOX_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "globals.h"
+#include "config.h"
+
+/**
+ * @file blackbox.h
+ * @brief Header file for the fault recorder.
+ *
+ * This file contains the declarations for recording what the load did around a
+ * safety trip. The sample ring always holds the last ~290 ms of samples, so
+ * nothing extra is buffered while the load runs. On a trip the safety task
+ * only notes the trigger sample and freezes the controller state, after the
+ * relays are open, so the recorder never delays them. Once the post-trigger
+ * samples are in, the HMI task copies the window out of the ring and writes it
+ * to the "blackbox" flash partition, where it survives a reset.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief State of the controller, frozen when a trip is recorded.
+ */
+typedef struct
+{
+    ControlMode mode;     /**< Mode being regulated. */
+    float setpoint;       /**< Reference of the regulator, in the unit of the mode. */
+    float duty_cycle;     /**< Load PWM duty cycle (%). */
+    float integral;       /**< Integral term of the regulator (% duty). */
+    int64_t timestamp_us; /**< Time the state was noted (us). */
+} BlackboxControl;
+
+/**
+ * @brief One sample of a record, the values needed to see what the load did.
+ */
+typedef struct
+{
+    int64_t timestamp_us;       /**< Time the conversion completed (us). */
+    uint32_t sequence;          /**< Sequence number in the sample ring. */
+    float bus_voltage;          /**< Bus voltage (V). */
+    float current;              /**< Current (A). */
+    float power;                /**< Power (W). */
+    float temperature_internal; /**< Internal temperature (°C). */
+    uint32_t quality;           /**< MeasurementQuality of the sample. */
+} BlackboxSample;
+
+/**
+ * @brief One recorded trip, as stored in flash.
+ */
+typedef struct
+{
+    uint32_t magic;                  /**< BLACKBOX_MAGIC if the slot holds a record. */
+    uint32_t number;                 /**< Number of the record, counting up over all records written. */
+    uint32_t cause;                  /**< safety_event_group bits that were set on the trigger sample. */
+    uint32_t trigger_sequence;       /**< Sequence number of the trigger sample. */
+    int64_t trigger_us;              /**< Timestamp of the trigger sample (us). */
+    BlackboxControl control;         /**< Controller state when the trip was noted. */
+    uint32_t count;                  /**< Samples recorded. */
+    uint32_t pre_count;              /**< Samples recorded before the trigger sample. */
+    BlackboxSample samples[BLACKBOX_PRE_SAMPLES + BLACKBOX_POST_SAMPLES]; /**< The samples, oldest first. */
+} BlackboxRecord;
+
+/**
+ * @brief Find the partition and the number of the newest record.
+ *
+ * Called once at startup. Without the partition trips are not recorded.
+ */
+void blackbox_init(void);
+
+/**
+ * @brief Note the state of the controller, called by the control task on every update.
+ *
+ * @param control The controller state.
+ */
+void blackbox_note_control(const BlackboxControl *control);
+
+/**
+ * @brief Note a trip on a sample, called by the safety task after the relays are open.
+ *
+ * Ignored while an earlier trip is still being recorded.
+ *
+ * @param cause The safety_event_group bits.
+ * @param sample The sample the trip was seen on.
+ */
+void blackbox_trigger(uint32_t cause, const MeasurementData *sample);
+
+/**
+ * @brief Copy the samples of a noted trip and write them to flash once they are in.
+ *
+ * Called by the lowest priority task, since writing waits for the flash.
+ */
+void blackbox_service(void);
+
+/**
+ * @brief Read a record back from flash.
+ *
+ * @param age 0 for the newest record, 1 for the one before, and so on.
+ * @param record Output, the record.
+ * @return true if the record exists.
+ */
+bool blackbox_read(uint32_t age, BlackboxRecord *record);
+
+#endif // BLACKBOX_H
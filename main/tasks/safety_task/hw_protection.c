@@ -0,0 +1,233 @@
+#include <math.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/event_groups.h"
+#include "driver/gpio.h"
+#include "driver/ledc.h"
+#include "esp_attr.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "hw_protection.h"
+#include "i2c.h"
+#include "config.h"
+
+/**
+ * @file hw_protection.c
+ * @brief Implementation of the INA237 hardware protection.
+ *
+ * The INA237 has a single ALERT pin. With INA237_HW_PROTECTION it is given to
+ * the limit comparators in latched mode instead of conversion ready, and the
+ * measurement task is paced by a timer.
+ *
+ * The interrupt handler writes the PWM with the IRAM ledc functions
+ * (CONFIG_LEDC_CTRL_FUNC_IN_IRAM) and the relays with gpio_set_level()
+ * (CONFIG_GPIO_CTRL_FUNC_IN_IRAM), so it also runs while the flash cache is
+ * disabled, for example during an NVS write. It then raises HW_TRIP_BIT for the
+ * safety task. The trip flag is checked by the fast control interrupt and the
+ * control task, so neither drives the PWM again until the load is reset.
+ *
+ * Only the measurement task talks to the INA237. Limits are queued under a
+ * spinlock and written by it, and after a trip it reads DIAG_ALRT, which gives
+ * the cause and clears the alert latch.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+static const char *TAG = "HW_PROTECTION"; /**< Tag for logging messages from the hardware protection. */
+
+/**
+ * @brief Limit registers and trip state.
+ */
+typedef struct
+{
+    int16_t shunt_over;       /**< SOVL value. */
+    int16_t shunt_under;      /**< SUVL value. */
+    uint16_t bus_over;        /**< BOVL value. */
+    uint16_t bus_under;       /**< BUVL value. */
+    bool pending;             /**< true if the values have not been written yet. */
+    volatile bool tripped;    /**< true from a trip until the rearm. */
+    volatile bool cause_read; /**< true once DIAG_ALRT has been read after the trip. */
+    volatile uint16_t cause;  /**< Limit flags of DIAG_ALRT read after the trip. */
+    volatile bool clear_due;  /**< true if the alert latch must be cleared after a rearm. */
+    int64_t trip_time_us;     /**< Time of the trip (us). */
+} HwProtection;
+
+static HwProtection hw_protection = {0};                               /**< The hardware protection. */
+static portMUX_TYPE hw_protection_lock = portMUX_INITIALIZER_UNLOCKED; /**< Protects the queued limits. */
+
+/**
+ * @brief Interrupt handler for the INA237 ALERT pin.
+ *
+ * A limit was crossed. Removes the load and opens the relays, then tells the
+ * safety task.
+ *
+ * @param arg Unused.
+ */
+static void IRAM_ATTR hw_protection_alert_isr(void *arg)
+{
+    ledc_set_duty(PWM_SPEED_MODE, PWM_CHANNEL_LOAD, 0);
+    ledc_update_duty(PWM_SPEED_MODE, PWM_CHANNEL_LOAD);
+    gpio_set_level(POWER_SWITCH_RELAY_PIN, 0);
+    gpio_set_level(DUT_RELAY_PIN, 0);
+
+    if (!hw_protection.tripped)
+    {
+        hw_protection.trip_time_us = esp_timer_get_time();
+        hw_protection.cause_read = false;
+        hw_protection.tripped = true;
+    }
+
+    BaseType_t higher_priority_task_woken = pdFALSE;
+    xEventGroupSetBitsFromISR(safety_event_group, HW_TRIP_BIT, &higher_priority_task_woken);
+    portYIELD_FROM_ISR(higher_priority_task_woken);
+}
+
+/**
+ * @brief Install the ALERT pin interrupt and queue the built-in limits.
+ *
+ * The limits are MAX_CURRENT and MAX_VOLTAGE until the user limits are set.
+ */
+void hw_protection_init(void)
+{
+    SafetyData limits = {
+        .max_current_user = MAX_CURRENT,
+        .max_voltage_user = MAX_VOLTAGE,
+        .min_voltage_user = 0,
+    };
+    hw_protection_set_limits(&limits, false);
+
+    gpio_config_t alert_config = {
+        .pin_bit_mask = 1ULL << INA237_ALERT_PIN,
+        .mode = GPIO_MODE_INPUT,
+        .pull_up_en = GPIO_PULLUP_ENABLE,
+        .pull_down_en = GPIO_PULLDOWN_DISABLE,
+        .intr_type = GPIO_INTR_NEGEDGE};
+    ESP_ERROR_CHECK(gpio_config(&alert_config));
+
+    // The ISR service may already be installed by another module.
+    esp_err_t err = gpio_install_isr_service(ESP_INTR_FLAG_IRAM);
+    if (err != ESP_ERR_INVALID_STATE)
+    {
+        ESP_ERROR_CHECK(err);
+    }
+    ESP_ERROR_CHECK(gpio_isr_handler_add(INA237_ALERT_PIN, hw_protection_alert_isr, NULL));
+    ESP_LOGI(TAG, "INA237 limit alert enabled on GPIO %d", INA237_ALERT_PIN);
+}
+
+/**
+ * @brief Queue new limits, written to the INA237 by the measurement task.
+ *
+ * The current and voltage limits are the lower of the user and the built-in
+ * limits. A reverse current of the same size as the current limit also trips.
+ *
+ * @param limits The user limits.
+ * @param undervoltage false to disable the bus undervoltage limit, as in a discharge test.
+ */
+void hw_protection_set_limits(const SafetyData *limits, bool undervoltage)
+{
+    // VSHUNT = CURRENT x SHUNT_CAL / 4096, in 5 uV steps. Over limits are rounded up so they never trip early.
+    float current = fminf(limits->max_current_user, MAX_CURRENT);
+    float shunt = ceilf(current / INA237_CURRENT_LSB * INA237_SHUNT_CAL / 4096.0f);
+    float bus_over = ceilf(fminf(limits->max_voltage_user, MAX_VOLTAGE) / INA237_VBUS_LSB);
+    float bus_under = undervoltage ? floorf(limits->min_voltage_user / INA237_VBUS_LSB) : 0.0f;
+
+    taskENTER_CRITICAL(&hw_protection_lock);
+    hw_protection.shunt_over = (int16_t)fminf(fmaxf(shunt, 0.0f), INT16_MAX);
+    hw_protection.shunt_under = -hw_protection.shunt_over;
+    hw_protection.bus_over = (uint16_t)fminf(fmaxf(bus_over, 0.0f), INT16_MAX);
+    hw_protection.bus_under = (uint16_t)fminf(fmaxf(bus_under, 0.0f), INT16_MAX);
+    hw_protection.pending = true;
+    taskEXIT_CRITICAL(&hw_protection_lock);
+}
+
+/**
+ * @brief Write queued limits and read the cause of a trip.
+ *
+ * Called by the measurement task, which owns the INA237, after every read.
+ *
+ * @param device The INA237.
+ */
+void hw_protection_service(i2c_master_dev_handle_t device)
+{
+    taskENTER_CRITICAL(&hw_protection_lock);
+    HwProtection queued = hw_protection;
+    hw_protection.pending = false;
+    taskEXIT_CRITICAL(&hw_protection_lock);
+
+    if (queued.pending)
+    {
+        esp_err_t err = i2c_write(device, INA237_SOVL_REG, (uint16_t)queued.shunt_over);
+        err |= i2c_write(device, INA237_SUVL_REG, (uint16_t)queued.shunt_under);
+        err |= i2c_write(device, INA237_BOVL_REG, queued.bus_over);
+        err |= i2c_write(device, INA237_BUVL_REG, queued.bus_under);
+        if (err != ESP_OK)
+        {
+            // Try again after the next read
+            taskENTER_CRITICAL(&hw_protection_lock);
+            hw_protection.pending = true;
+            taskEXIT_CRITICAL(&hw_protection_lock);
+        }
+        else
+        {
+            ESP_LOGI(TAG, "Limits written, SOVL %d, SUVL %d, BOVL %u, BUVL %u", queued.shunt_over, queued.shunt_under,
+                     queued.bus_over, queued.bus_under);
+        }
+    }
+
+    // Reading DIAG_ALRT clears the latch, without that the pin stays low and the next trip gives no edge
+    int16_t flags;
+    if (queued.tripped && !queued.cause_read)
+    {
+        if (i2c_read(device, INA237_DIAG_ALRT_REG, &flags) == ESP_OK)
+        {
+            hw_protection.cause = (uint16_t)flags & (INA237_DIAG_ALRT_SHNTOL | INA237_DIAG_ALRT_SHNTUL |
+                                                     INA237_DIAG_ALRT_BUSOL | INA237_DIAG_ALRT_BUSUL);
+            hw_protection.cause_read = true;
+        }
+    }
+    else if (queued.clear_due)
+    {
+        if (i2c_read(device, INA237_DIAG_ALRT_REG, &flags) == ESP_OK)
+        {
+            hw_protection.clear_due = false;
+        }
+    }
+}
+
+/**
+ * @brief Check if the comparators have tripped since the last rearm.
+ *
+ * @return true after a trip.
+ */
+bool IRAM_ATTR hw_protection_tripped(void)
+{
+    return hw_protection.tripped;
+}
+
+/**
+ * @brief Get the limit flags of the last trip.
+ *
+ * @return The DIAG_ALRT limit flags, 0 until the measurement task has read them.
+ */
+uint16_t hw_protection_cause(void)
+{
+    return hw_protection.cause_read ? hw_protection.cause : 0;
+}
+
+/**
+ * @brief Clear a trip, called when the load is reset.
+ *
+ * The measurement task clears the INA237 alert latch, so a limit that is still
+ * crossed trips again on the next conversion.
+ */
+void hw_protection_rearm(void)
+{
+    if (hw_protection.tripped)
+    {
+        ESP_LOGI(TAG, "Rearmed after a trip at %lld us", hw_protection.trip_time_us);
+    }
+    hw_protection.cause = 0;
+    hw_protection.clear_due = true;
+    hw_protection.tripped = false;
+}
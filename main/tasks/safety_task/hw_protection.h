@@ -0,0 +1,72 @@
+#ifndef HW_PROTECTION_H
+#define HW_PROTECTION_H
+#include <stdint.h>
+#include <stdbool.h>
+#include "driver/i2c_master.h"
+#include "globals.h"
+
+/**
+ * @file hw_protection.h
+ * @brief Header file for the INA237 hardware protection.
+ *
+ * This file contains the declarations for the first layer of protection. The
+ * INA237 compares every conversion against the shunt and bus voltage limit
+ * registers, and its ALERT pin interrupts the ESP32 when one is crossed. The
+ * interrupt handler zeroes the load PWM and opens the relays within
+ * microseconds, without waiting for the safety task. The software checks of
+ * the safety task remain as the second layer.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Install the ALERT pin interrupt and queue the built-in limits.
+ *
+ * The limits are MAX_CURRENT and MAX_VOLTAGE until the user limits are set.
+ */
+void hw_protection_init(void);
+
+/**
+ * @brief Queue new limits, written to the INA237 by the measurement task.
+ *
+ * The current and voltage limits are the lower of the user and the built-in
+ * limits. A reverse current of the same size as the current limit also trips.
+ *
+ * @param limits The user limits.
+ * @param undervoltage false to disable the bus undervoltage limit, as in a discharge test.
+ */
+void hw_protection_set_limits(const SafetyData *limits, bool undervoltage);
+
+/**
+ * @brief Write queued limits and read the cause of a trip.
+ *
+ * Called by the measurement task, which owns the INA237, after every read.
+ *
+ * @param device The INA237.
+ */
+void hw_protection_service(i2c_master_dev_handle_t device);
+
+/**
+ * @brief Check if the comparators have tripped since the last rearm.
+ *
+ * @return true after a trip.
+ */
+bool hw_protection_tripped(void);
+
+/**
+ * @brief Get the limit flags of the last trip.
+ *
+ * @return The DIAG_ALRT limit flags, 0 until the measurement task has read them.
+ */
+uint16_t hw_protection_cause(void);
+
+/**
+ * @brief Clear a trip, called when the load is reset.
+ *
+ * The measurement task clears the INA237 alert latch, so a limit that is still
+ * crossed trips again on the next conversion.
+ */
+void hw_protection_rearm(void);
+
+#endif // HW_PROTECTION_H
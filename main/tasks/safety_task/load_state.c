@@ -0,0 +1,139 @@
+#include <string.h>
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "freertos/queue.h"
+#include "esp_timer.h"
+#include "load_state.h"
+
+/**
+ * @file load_state.c
+ * @brief Implementation of the state machine of the load.
+ *
+ * The transitions are a table indexed by state and command, so every
+ * combination is defined and a command that does not apply in a state leaves
+ * it unchanged. The side effects of a transition, the relays, the INA237
+ * comparators and the fault bits, are applied by the safety task, the only
+ * caller of load_state_publish().
+ *
+ * Posting a command wakes the safety task, which has the highest priority of
+ * the tasks on its core, so a command is applied within one pass of the safety
+ * loop instead of on the next poll of whichever task used to watch the bit.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief State each command leads to, indexed by state and command.
+ *
+ * A fault is only left through a reset, and nothing but another reset is
+ * accepted while a reset completes.
+ */
+static const LoadState load_transitions[LOAD_STATE_COUNT][LOAD_COMMAND_COUNT] = {
+    [LOAD_IDLE] = {[LOAD_COMMAND_START] = LOAD_ARMED, [LOAD_COMMAND_STOP] = LOAD_IDLE, [LOAD_COMMAND_RESET] = LOAD_RESETTING},
+    [LOAD_ARMED] = {[LOAD_COMMAND_START] = LOAD_ARMED, [LOAD_COMMAND_STOP] = LOAD_IDLE, [LOAD_COMMAND_RESET] = LOAD_RESETTING},
+    [LOAD_RUNNING] = {[LOAD_COMMAND_START] = LOAD_RUNNING, [LOAD_COMMAND_STOP] = LOAD_IDLE, [LOAD_COMMAND_RESET] = LOAD_RESETTING},
+    [LOAD_FAULT] = {[LOAD_COMMAND_START] = LOAD_FAULT, [LOAD_COMMAND_STOP] = LOAD_FAULT, [LOAD_COMMAND_RESET] = LOAD_RESETTING},
+    [LOAD_RESETTING] = {[LOAD_COMMAND_START] = LOAD_RESETTING, [LOAD_COMMAND_STOP] = LOAD_RESETTING, [LOAD_COMMAND_RESET] = LOAD_RESETTING},
+};
+
+static const char *const load_state_names[LOAD_STATE_COUNT] = {
+    [LOAD_IDLE] = "IDLE",
+    [LOAD_ARMED] = "ARMED",
+    [LOAD_RUNNING] = "RUNNING",
+    [LOAD_FAULT] = "FAULT",
+    [LOAD_RESETTING] = "RESETTING",
+}; /**< Names of the states. */
+
+static LoadStatePublished load_state = {
+    .version = 0,
+    .status = {.state = LOAD_IDLE},
+    .writer_lock = portMUX_INITIALIZER_UNLOCKED,
+}; /**< The published load state. */
+
+/**
+ * @brief Post a command to the safety task and wake it.
+ *
+ * Does not block, so it can be called from the control task and the HTTP server.
+ *
+ * @param type The command.
+ * @return true if the command was queued, false if the queue was full.
+ */
+bool load_state_command(LoadCommandType type)
+{
+    LoadCommand command = {
+        .type = type,
+        .posted_us = esp_timer_get_time(),
+    };
+    if (xQueueSend(load_command_queue, &command, 0) != pdTRUE)
+    {
+        return false;
+    }
+    if (safety_task_handle != NULL)
+    {
+        xTaskNotifyGive(safety_task_handle);
+    }
+    return true;
+}
+
+/**
+ * @brief Read a consistent snapshot of the load state.
+ *
+ * @param status Output, the snapshot.
+ * @return The version of the snapshot, it changes on every publish.
+ */
+uint32_t load_state_get(LoadStatus *status)
+{
+    uint32_t version_before;
+    uint32_t version_after;
+    do
+    {
+        version_before = atomic_load_explicit(&load_state.version, memory_order_acquire);
+        memcpy(status, &load_state.status, sizeof(LoadStatus));
+        atomic_thread_fence(memory_order_acquire);
+        version_after = atomic_load_explicit(&load_state.version, memory_order_relaxed);
+    } while ((version_before & 1) || (version_before != version_after));
+    return version_before;
+}
+
+/**
+ * @brief Publish a new load state, only called by the safety task.
+ *
+ * @param status The new state.
+ */
+void load_state_publish(const LoadStatus *status)
+{
+    taskENTER_CRITICAL(&load_state.writer_lock);
+    atomic_fetch_add_explicit(&load_state.version, 1, memory_order_relaxed);
+    atomic_thread_fence(memory_order_release);
+    load_state.status = *status;
+    atomic_fetch_add_explicit(&load_state.version, 1, memory_order_release);
+    taskEXIT_CRITICAL(&load_state.writer_lock);
+}
+
+/**
+ * @brief Look up the state a command leads to.
+ *
+ * @param state The current state.
+ * @param type The command.
+ * @return The next state, the current state if the command is ignored in it.
+ */
+LoadState load_state_next(LoadState state, LoadCommandType type)
+{
+    if ((state >= LOAD_STATE_COUNT) || (type >= LOAD_COMMAND_COUNT))
+    {
+        return state;
+    }
+    return load_transitions[state][type];
+}
+
+/**
+ * @brief Get the name of a state, for logs and the HTTP server.
+ *
+ * @param state The state.
+ * @return The name, "UNKNOWN" for an invalid state.
+ */
+const char *load_state_name(LoadState state)
+{
+    return (state < LOAD_STATE_COUNT) ? load_state_names[state] : "UNKNOWN";
+}
@@ -0,0 +1,125 @@
+#ifndef LOAD_STATE_H
+#define LOAD_STATE_H
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdatomic.h>
+#include "freertos/FreeRTOS.h"
+#include "globals.h"
+
+/**
+ * @file load_state.h
+ * @brief Header file for the state machine of the load.
+ *
+ * This file contains the declarations for the state of the load, which is
+ * owned by the safety task. The user interfaces and the control task never
+ * change the state themselves, they post start, stop and reset commands to
+ * load_command_queue and wake the safety task, which applies them in order.
+ * The state is published with a seqlock, so the control and measurement tasks
+ * read it without blocking, and the version tells them it has changed.
+ *
+ * A start goes through LOAD_ARMED and only becomes LOAD_RUNNING once a sample
+ * converted after the start has passed the checks. A reset goes through
+ * LOAD_RESETTING until a sample converted after the reset, whose Ah and Wh have
+ * been zeroed, has been checked.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief States of the load.
+ */
+typedef enum
+{
+    LOAD_IDLE,        /**< Load off, no fault. */
+    LOAD_ARMED,       /**< Started, waiting for a sample converted after the start to pass the checks. */
+    LOAD_RUNNING,     /**< Load on, the control task regulates. */
+    LOAD_FAULT,       /**< A safety limit was crossed, relays open until a reset. */
+    LOAD_RESETTING,   /**< Faults cleared and relays closed, waiting for the measurement task to zero Ah and Wh. */
+    LOAD_STATE_COUNT  /**< Number of states. */
+} LoadState;
+
+/**
+ * @brief Commands to the load.
+ */
+typedef enum
+{
+    LOAD_COMMAND_START, /**< Switch the load on. */
+    LOAD_COMMAND_STOP,  /**< Switch the load off. */
+    LOAD_COMMAND_RESET, /**< Clear the faults, close the relays and zero Ah and Wh. */
+    LOAD_COMMAND_COUNT  /**< Number of commands. */
+} LoadCommandType;
+
+/**
+ * @brief A command waiting in load_command_queue.
+ */
+typedef struct
+{
+    LoadCommandType type; /**< The command. */
+    int64_t posted_us;    /**< Time the command was posted (us). */
+} LoadCommand;
+
+/**
+ * @brief The published state of the load.
+ */
+typedef struct
+{
+    LoadState state;             /**< State of the load. */
+    uint32_t faults;             /**< safety_event_group bits, non-zero in LOAD_FAULT. */
+    uint32_t resets;             /**< Incremented on every reset, the measurement task zeroes Ah and Wh when it changes. */
+    uint32_t command_latency_us; /**< Time from posting the last command that changed the state to publishing the change (us). */
+} LoadStatus;
+
+/**
+ * @brief Seqlock protected load state.
+ */
+typedef struct
+{
+    atomic_uint_least32_t version; /**< Odd while a write is in progress, incremented twice per write. */
+    LoadStatus status;             /**< The published state. */
+    portMUX_TYPE writer_lock;      /**< Serialises the writer with itself on the other core, readers never take it. */
+} LoadStatePublished;
+
+/**
+ * @brief Post a command to the safety task and wake it.
+ *
+ * Does not block, so it can be called from the control task and the HTTP server.
+ *
+ * @param type The command.
+ * @return true if the command was queued, false if the queue was full.
+ */
+bool load_state_command(LoadCommandType type);
+
+/**
+ * @brief Read a consistent snapshot of the load state.
+ *
+ * @param status Output, the snapshot.
+ * @return The version of the snapshot, it changes on every publish.
+ */
+uint32_t load_state_get(LoadStatus *status);
+
+/**
+ * @brief Publish a new load state, only called by the safety task.
+ *
+ * @param status The new state.
+ */
+void load_state_publish(const LoadStatus *status);
+
+/**
+ * @brief Look up the state a command leads to.
+ *
+ * @param state The current state.
+ * @param type The command.
+ * @return The next state, the current state if the command is ignored in it.
+ */
+LoadState load_state_next(LoadState state, LoadCommandType type);
+
+/**
+ * @brief Get the name of a state, for logs and the HTTP server.
+ *
+ * @param state The state.
+ * @return The name, "UNKNOWN" for an invalid state.
+ */
+const char *load_state_name(LoadState state);
+
+#endif // LOAD_STATE_H
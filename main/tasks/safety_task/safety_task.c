@@ -1,3 +1,4 @@
+#include <string.h>
 #include "freertos/FreeRTOS.h"
 #include "freertos/task.h"
 #include "freertos/queue.h"
@@ -8,6 +9,14 @@
 #include "control_task.h"
 #include "hmi_task.h"
 #include "globals.h"
+#include "sample_ring.h"
+#include "live_state.h"
+#include "hw_protection.h"
+#include "soa.h"
+#include "blackbox.h"
+#include "supervisor.h"
+#include "load_state.h"
+#include "esp_timer.h"
 #include "config.h"
 
 /**
@@ -16,9 +25,25 @@
  *
  * This file contains the implementation of the safety task, which is responsible
  * for monitoring safety conditions such as overvoltage, overcurrent, overtemperature,
- * and undervoltage. The task interacts with other tasks via FreeRTOS queues and
- * event groups to ensure safe operation of the system. If a safety condition is
- * violated, the task disables the relays to protect the system.
+ * undervoltage, overpower and the safe operating area of the load MOSFET. The
+ * task interacts with other tasks via FreeRTOS queues and event groups to ensure
+ * safe operation of the system. If a safety condition is violated, the task
+ * disables the relays to protect the system.
+ *
+ * The measurement task notifies this task on every sample, and every sample
+ * published since the last check is read in order, so the SOA accumulator sees
+ * all of them. The first sample a fault is seen on is handed to the fault
+ * recorder.
+ *
+ * The task also switches the load off if the newest good sample is older than
+ * SAFETY_SAMPLE_MAX_AGE_US, or if the measurement or control task has missed
+ * its deadline, so a stalled task never leaves the load running unchecked.
+ *
+ * The task owns the state machine of the load. It takes the start, stop and
+ * reset commands from load_command_queue after the samples have been checked,
+ * applies the side effects of each transition itself and publishes the new
+ * state once per pass, then wakes the control task so it acts on the change
+ * without waiting for its next poll.
  *
  * @note The relays are configured as normally open (NO), meaning they are closed
  *       when the GPIO pin is set high.
@@ -51,6 +76,29 @@ void safety_task(void *paramater)
     };
     
     MeasurementData measurements; /**< Struct to hold the latest measurement data. */
+    LiveSettings settings;        /**< Snapshot of the live settings. */
+    SampleReader reader;          /**< Position in the sample ring, every sample is checked. */
+    SoaState soa;                 /**< Safe operating area accumulator. */
+    bool derating = false;        /**< true while SOA_DERATE_BIT is set. */
+    bool fault_recorded = false;  /**< true once the trip has been handed to the fault recorder, until the reset. */
+    int64_t good_sample_us = 0;   /**< Timestamp of the newest sample the INA237 was read for (us). */
+    int64_t checked_us = 0;       /**< Timestamp of the newest sample checked (us). */
+    LoadStatus load = {.state = LOAD_IDLE}; /**< State of the load, owned by this task. */
+    LoadStatus published = load;            /**< State last published. */
+    LoadCommand command;                    /**< Command taken from the queue. */
+    int64_t published_us = 0;               /**< Time the state was last published (us). */
+    int64_t command_posted_us = 0;          /**< Time the oldest command not yet published was posted (us), 0 if none. */
+
+    sample_reader_init(&reader, &measurement_ring);
+    soa_init(&soa);
+    supervisor_register(SUPERVISED_SAFETY, SAFETY_DEADLINE_US);
+
+#if INA237_HW_PROTECTION
+    SafetyData programmed_limits = {0};    /**< Limits last queued for the INA237 comparators. */
+    bool programmed_undervoltage = false;  /**< Undervoltage setting last queued for the INA237 comparators. */
+    bool limits_programmed = false;        /**< true once the user limits have been queued. */
+    bool hw_trip_reported = false;         /**< true once the cause of a hardware trip has been logged. */
+#endif
 
     // Set the pins controlling relays high, meaning the relays are closed since they are NO.
     gpio_set_direction(POWER_SWITCH_RELAY_PIN, GPIO_MODE_OUTPUT);
@@ -61,11 +109,68 @@ void safety_task(void *paramater)
 
     while (1)
     {
-        // Check safety queue for updated safety limits
-        if (xQueuePeek(safety_queue, &safety_data, pdMS_TO_TICKS(10)))
+        supervisor_heartbeat(SUPERVISED_SAFETY, SAFETY_DEADLINE_US);
+
+        // Read the safety limits from the live state, they are only checked once they have been set
+        live_state_get(&settings);
+        if (settings.limits_set)
+        {
+            safety_data = settings.limits;
+
+#if INA237_HW_PROTECTION
+            // Program the INA237 comparators whenever the limits change, they act between two checks of this task
+            bool undervoltage = settings.mode != MODE_DISCHARGE;
+            if (!limits_programmed || (undervoltage != programmed_undervoltage) ||
+                (memcmp(&safety_data, &programmed_limits, sizeof(safety_data)) != 0))
+            {
+                hw_protection_set_limits(&safety_data, undervoltage);
+                programmed_limits = safety_data;
+                programmed_undervoltage = undervoltage;
+                limits_programmed = true;
+            }
+#endif
+        }
+
+        // Check every sample published since the last iteration
+        while (sample_reader_next(&reader, &measurement_ring, &measurements))
         {
-            // Check measurement queue for the latest measurement data
-            if (xQueuePeek(measurement_queue, &measurements, pdMS_TO_TICKS(10)))
+            checked_us = measurements.timestamp_us;
+
+            // A sample with an I2C error repeats old values, so the age is that of the newest good sample
+            if (measurements.quality != MEASUREMENT_I2C_ERROR)
+            {
+                good_sample_us = measurements.timestamp_us;
+            }
+
+            // The SOA is a property of the MOSFET, it is checked whether or not the user limits are set
+            SoaStatus soa_status = soa_update(&soa, measurements.bus_voltage, measurements.current, measurements.timestamp_us);
+            if (soa_status == SOA_TRIP)
+            {
+                if ((xEventGroupGetBits(safety_event_group) & OVERPOWER_BIT) == 0)
+                {
+                    ESP_LOGE(TAG, "Safe operating area exceeded: %.2f V, %.2f A", measurements.bus_voltage, measurements.current);
+                }
+                xEventGroupSetBits(safety_event_group, OVERPOWER_BIT);
+                gpio_set_level(POWER_SWITCH_RELAY_PIN, 0);
+                gpio_set_level(DUT_RELAY_PIN, 0);
+            }
+
+            // Have the control task back off before the budget is used up
+            if ((soa_status == SOA_DERATE) != derating)
+            {
+                derating = soa_status == SOA_DERATE;
+                if (derating)
+                {
+                    ESP_LOGW(TAG, "Derating to stay in the safe operating area: %.2f V, %.2f A", measurements.bus_voltage, measurements.current);
+                    xEventGroupSetBits(signal_event_group, SOA_DERATE_BIT);
+                }
+                else
+                {
+                    xEventGroupClearBits(signal_event_group, SOA_DERATE_BIT);
+                }
+            }
+
+            if (settings.limits_set)
             {
                 // Check if bus voltage exceeds user-defined or hardcoded maximum voltage
                 if ((measurements.bus_voltage > safety_data.max_voltage_user) || (measurements.bus_voltage > MAX_VOLTAGE))
@@ -89,32 +194,159 @@ void safety_task(void *paramater)
                     gpio_set_level(POWER_SWITCH_RELAY_PIN, 0);
                     gpio_set_level(DUT_RELAY_PIN, 0);
                 }
-                // Check if bus voltage is below user-defined minimum voltage
-                else if ((measurements.bus_voltage < safety_data.min_voltage_user))
+                // Check if power exceeds user-defined maximum power
+                else if (measurements.power > safety_data.max_power_user)
+                {
+                    if ((xEventGroupGetBits(safety_event_group) & OVERPOWER_BIT) == 0)
+                    {
+                        ESP_LOGE(TAG, "Overpower detected: %.2f W (Limit: %.2f W)", measurements.power, safety_data.max_power_user);
+                    }
+                    xEventGroupSetBits(safety_event_group, OVERPOWER_BIT);
+                    gpio_set_level(POWER_SWITCH_RELAY_PIN, 0);
+                    gpio_set_level(DUT_RELAY_PIN, 0);
+                }
+                // Check if bus voltage is below user-defined minimum voltage. A discharge test stops the load at
+                // its own cutoff voltage, which is the end of the test and not a fault.
+                else if ((settings.mode != MODE_DISCHARGE) && (measurements.bus_voltage < safety_data.min_voltage_user))
                 {
                     xEventGroupSetBits(safety_event_group, UNDERVOLTAGE_BIT);
                     gpio_set_level(POWER_SWITCH_RELAY_PIN, 0);
                     gpio_set_level(DUT_RELAY_PIN, 0);
                 }
+            }
+
+            // The relays are already open, the recorder only notes the sample
+            uint32_t faults = xEventGroupGetBits(safety_event_group);
+            if ((faults != 0) && !fault_recorded)
+            {
+                blackbox_trigger(faults, &measurements);
+                fault_recorded = true;
+            }
+        }
 
-                if (xEventGroupGetBits(safety_event_group) != 0)
+        // A running load checked on stale samples, or driven by a task that missed its deadline, is switched off
+        int64_t sample_age_us = esp_timer_get_time() - good_sample_us;
+        uint32_t overdue = supervisor_overdue() & ~(1 << SUPERVISED_SAFETY);
+        bool load_on = (load.state == LOAD_ARMED) || (load.state == LOAD_RUNNING);
+        if (load_on && ((sample_age_us > SAFETY_SAMPLE_MAX_AGE_US) || (overdue != 0)))
+        {
+            if ((xEventGroupGetBits(safety_event_group) & DEADLINE_BIT) == 0)
+            {
+                ESP_LOGE(TAG, "Newest sample is %lld us old, overdue tasks 0x%lx, switching off", sample_age_us, overdue);
+                if (sample_age_us > SAFETY_SAMPLE_MAX_AGE_US)
                 {
-                    xEventGroupClearBits(signal_event_group, START_STOP_BIT);
+                    supervisor_note_stale(SUPERVISED_SAFETY);
                 }
             }
+            xEventGroupSetBits(safety_event_group, DEADLINE_BIT);
+            gpio_set_level(POWER_SWITCH_RELAY_PIN, 0);
+            gpio_set_level(DUT_RELAY_PIN, 0);
+        }
+
+#if INA237_HW_PROTECTION
+        // The comparators have already removed the load, report which limit was crossed once it has been read
+        if ((xEventGroupGetBits(safety_event_group) & HW_TRIP_BIT) && !hw_trip_reported && (hw_protection_cause() != 0))
+        {
+            uint16_t cause = hw_protection_cause();
+            ESP_LOGE(TAG, "Hardware protection tripped, DIAG_ALRT limit flags 0x%04x", cause);
+            if (cause & (INA237_DIAG_ALRT_SHNTOL | INA237_DIAG_ALRT_SHNTUL))
+            {
+                xEventGroupSetBits(safety_event_group, OVERCURRENT_BIT);
+            }
+            if (cause & INA237_DIAG_ALRT_BUSOL)
+            {
+                xEventGroupSetBits(safety_event_group, OVERVOLTAGE_BIT);
+            }
+            if (cause & INA237_DIAG_ALRT_BUSUL)
+            {
+                xEventGroupSetBits(safety_event_group, UNDERVOLTAGE_BIT);
+            }
+            hw_trip_reported = true;
+        }
+#endif
+
+        // A deadline or hardware trip is not seen on a sample, and a stalled measurement task may never publish
+        // another one. Record it on the newest sample there is, the recorder stops waiting for the samples after
+        // the trip after BLACKBOX_POST_TIMEOUT_US.
+        uint32_t faults = xEventGroupGetBits(safety_event_group);
+        if ((faults != 0) && !fault_recorded)
+        {
+            MeasurementData latest = {0};
+            sample_ring_latest(&measurement_ring, &latest);
+            blackbox_trigger(faults, &latest);
+            fault_recorded = true;
+        }
+
+        // Any fault bit, from the checks above or the hardware protection interrupt, holds the load in FAULT
+        load.faults = xEventGroupGetBits(safety_event_group);
+        if (load.faults != 0)
+        {
+            load.state = LOAD_FAULT;
+        }
+
+        // Apply the commands in the order they were posted
+        while (xQueueReceive(load_command_queue, &command, 0) == pdTRUE)
+        {
+            LoadState next = load_state_next(load.state, command.type);
+            if (command.type == LOAD_COMMAND_RESET)
+            {
+                hw_protection_rearm();
+#if INA237_HW_PROTECTION
+                hw_trip_reported = false;
+#endif
+                fault_recorded = false;
+                xEventGroupClearBits(safety_event_group, OVERVOLTAGE_BIT | OVERCURRENT_BIT | UNDERVOLTAGE_BIT | OVERTEMPERATURE_BIT |
+                                                             HW_TRIP_BIT | OVERPOWER_BIT | DEADLINE_BIT);
+                gpio_set_level(POWER_SWITCH_RELAY_PIN, 1);
+                load.faults = 0;
+                load.resets++;
+            }
+            else if (next == load.state)
+            {
+                ESP_LOGW(TAG, "Command %d ignored in %s", command.type, load_state_name(load.state));
+                continue;
+            }
+            load.state = next;
+            command_posted_us = (command_posted_us == 0) ? command.posted_us : command_posted_us;
+        }
+
+        // A start or a reset completes on the first sample converted after it was published. That sample has
+        // passed the checks above, and after a reset the measurement task has zeroed its Ah and Wh.
+        if ((load.state == LOAD_ARMED) && (published.state == LOAD_ARMED) && (checked_us > published_us))
+        {
+            load.state = LOAD_RUNNING;
+        }
+        else if ((load.state == LOAD_RESETTING) && (published.state == LOAD_RESETTING) && (load.resets == published.resets) &&
+                 ((checked_us > published_us) || (esp_timer_get_time() - published_us > SAFETY_SAMPLE_MAX_AGE_US)))
+        {
+            load.state = LOAD_IDLE;
         }
 
-        if (xEventGroupGetBits(signal_event_group) & RESET_BIT)
+        // Publish the state once per pass and wake the control task, it may be sleeping while the load is off
+        if ((load.state != published.state) || (load.faults != published.faults) || (load.resets != published.resets))
         {
-            gpio_set_level(POWER_SWITCH_RELAY_PIN, 1);
-            xEventGroupClearBits(safety_event_group, OVERVOLTAGE_BIT);
-            xEventGroupClearBits(safety_event_group, OVERCURRENT_BIT);
-            xEventGroupClearBits(safety_event_group, OVERTEMPERATURE_BIT);
-            xEventGroupClearBits(safety_event_group, UNDERVOLTAGE_BIT);
-            xEventGroupClearBits(signal_event_group, START_STOP_BIT);
+            int64_t now = esp_timer_get_time();
+            if (command_posted_us != 0)
+            {
+                load.command_latency_us = (uint32_t)(now - command_posted_us);
+                command_posted_us = 0;
+            }
+            load_state_publish(&load);
+            published_us = esp_timer_get_time();
+            if (control_task_handle != NULL)
+            {
+                xTaskNotifyGiveIndexed(control_task_handle, LOAD_STATE_NOTIFY_INDEX);
+                xTaskNotifyGive(control_task_handle);
+            }
+            if (load.state != published.state)
+            {
+                ESP_LOGI(TAG, "Load %s -> %s, faults 0x%02lx, command latency %lu us", load_state_name(published.state),
+                         load_state_name(load.state), load.faults, load.command_latency_us);
+            }
+            published = load;
         }
 
-        // Small delay to prevent task starvation
-        vTaskDelay(pdMS_TO_TICKS(10));
+        // Wait for the next sample or command, the timeout keeps the deadline checks alive if the samples stop
+        ulTaskNotifyTake(pdTRUE, pdMS_TO_TICKS(SAFETY_SAMPLE_TIMEOUT_MS));
     }
 }
\ No newline at end of file
@@ -0,0 +1,168 @@
+#include <math.h>
+#include "soa.h"
+#include "config.h"
+
+/**
+ * @file soa.c
+ * @brief Implementation of the safe operating area check of the load MOSFET.
+ *
+ * Each curve of the table allows its current for its pulse duration. Between
+ * two curves the allowed time is interpolated on log-log axes, as they are
+ * drawn in the datasheet, and above the shortest curve it falls with the square
+ * of the current. The last curve is DC, its duration is the time from which
+ * on the heatsink is in steady state.
+ *
+ * A sample at current I uses dt / t_allowed(V, I) of the budget, so a constant
+ * current uses it up in exactly the time the curves allow, and back-to-back
+ * pulses in the sum of their times (Miner's rule). In the power-limited part
+ * of the SOA this is an I²t accumulator, at high voltage the curves fall
+ * faster than constant power, which keeps the MOSFET out of second breakdown.
+ * Below the DC curve the budget comes back with SOA_COOLING_US, the time
+ * constant of the die and case. The heatsink itself is covered by the DC curve
+ * and the temperature limits.
+ *
+ * A sample covers the time since the previous one, so a trip comes at most one
+ * sample (~1.1 ms) after the time allowed.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+#define SOA_VOLTAGE_POINTS 6 /**< Voltages the current limits are given at. */
+#define SOA_CURVE_COUNT 4    /**< Pulse duration curves, the last is DC. */
+
+/**
+ * @brief One curve of the safe operating area.
+ */
+typedef struct
+{
+    float duration_us;                 /**< Pulse duration the curve holds for (us). */
+    float current[SOA_VOLTAGE_POINTS]; /**< Current limit at each of soa_voltages (A). */
+} SoaCurve;
+
+/**
+ * @brief Voltages of the table (V).
+ */
+static const float soa_voltages[SOA_VOLTAGE_POINTS] = {5.0f, 10.0f, 20.0f, 30.0f, 40.0f, 50.0f};
+
+/**
+ * @brief SOA of the load MOSFET on its heatsink, at a case temperature of 25 °C, shortest pulse first.
+ *
+ * Taken from the datasheet curves with some margin and capped at MAX_CURRENT.
+ * The DC curve is about 100 W and falls to 70 W at 50 V.
+ */
+static const SoaCurve soa_curves[SOA_CURVE_COUNT] = {
+    {.duration_us = 1000.0f, .current = {11.0f, 11.0f, 11.0f, 11.0f, 11.0f, 11.0f}},
+    {.duration_us = 10000.0f, .current = {11.0f, 11.0f, 11.0f, 10.0f, 7.0f, 5.0f}},
+    {.duration_us = 100000.0f, .current = {11.0f, 11.0f, 8.0f, 5.0f, 3.3f, 2.4f}},
+    {.duration_us = 1000000.0f, .current = {11.0f, 10.0f, 5.0f, 3.0f, 2.0f, 1.4f}},
+};
+
+/**
+ * @brief Start an empty accumulator.
+ *
+ * @param state The accumulator.
+ */
+void soa_init(SoaState *state)
+{
+    state->used = 0.0f;
+    state->previous_us = 0;
+    state->started = false;
+}
+
+/**
+ * @brief Get the current limit of one SOA curve at a voltage.
+ *
+ * @param curve Index of the curve, 0 is the shortest pulse and the last is DC.
+ * @param voltage Drain voltage (V).
+ * @return The current limit (A).
+ */
+float soa_curve_current(uint32_t curve, float voltage)
+{
+    const float *current = soa_curves[curve].current;
+
+    // Clamp outside the table, below the first voltage the limit is MAX_CURRENT anyway
+    if (voltage <= soa_voltages[0])
+    {
+        return current[0];
+    }
+    for (uint32_t i = 1; i < SOA_VOLTAGE_POINTS; i++)
+    {
+        if (voltage <= soa_voltages[i])
+        {
+            float fraction = (voltage - soa_voltages[i - 1]) / (soa_voltages[i] - soa_voltages[i - 1]);
+            return current[i - 1] + fraction * (current[i] - current[i - 1]);
+        }
+    }
+    return current[SOA_VOLTAGE_POINTS - 1];
+}
+
+/**
+ * @brief Get how long the MOSFET may conduct a current at a voltage.
+ *
+ * @param voltage Drain voltage (V).
+ * @param current Drain current (A), the sign is ignored.
+ * @return The time allowed (us), INFINITY on or below the DC curve.
+ */
+float soa_allowed_time_us(float voltage, float current)
+{
+    current = fabsf(current);
+    float longer_current = soa_curve_current(SOA_CURVE_COUNT - 1, voltage);
+    if (current <= longer_current)
+    {
+        return INFINITY;
+    }
+
+    // Find the shortest curve still above the current, the one after it is below
+    for (int32_t curve = SOA_CURVE_COUNT - 2; curve >= 0; curve--)
+    {
+        float shorter_current = soa_curve_current(curve, voltage);
+        if (current <= shorter_current)
+        {
+            float shorter_us = soa_curves[curve].duration_us;
+            float longer_us = soa_curves[curve + 1].duration_us;
+            float fraction = logf(current / longer_current) / logf(shorter_current / longer_current);
+            return longer_us * powf(shorter_us / longer_us, fraction);
+        }
+        longer_current = shorter_current;
+    }
+
+    // Above the shortest curve, at constant I²t
+    float ratio = longer_current / current;
+    return soa_curves[0].duration_us * ratio * ratio;
+}
+
+/**
+ * @brief Check one sample and update the accumulator.
+ *
+ * The sample is taken to last from the previous sample to this one.
+ *
+ * @param state The accumulator.
+ * @param voltage Drain voltage (V).
+ * @param current Drain current (A).
+ * @param timestamp_us Timestamp of the sample (us).
+ * @return Whether the load may continue, should back off or must be switched off.
+ */
+SoaStatus soa_update(SoaState *state, float voltage, float current, int64_t timestamp_us)
+{
+    float dt_us = state->started ? (float)(timestamp_us - state->previous_us) : 0.0f;
+    state->previous_us = timestamp_us;
+    state->started = true;
+
+    float allowed_us = soa_allowed_time_us(voltage, current);
+    if (isinf(allowed_us))
+    {
+        // Cooling down
+        state->used -= state->used * fminf(dt_us / SOA_COOLING_US, 1.0f);
+    }
+    else
+    {
+        state->used += dt_us / allowed_us;
+    }
+
+    if (state->used >= 1.0f)
+    {
+        return SOA_TRIP;
+    }
+    return (state->used >= SOA_DERATE_LEVEL) ? SOA_DERATE : SOA_OK;
+}
@@ -0,0 +1,82 @@
+#ifndef SOA_H
+#define SOA_H
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @file soa.h
+ * @brief Header file for the safe operating area check of the load MOSFET.
+ *
+ * This file contains the declarations for checking every sample against the
+ * safe operating area (SOA) of the load MOSFET. The SOA is a table of current
+ * limits over the drain voltage for a few pulse durations, as drawn in the
+ * datasheet. Operation above the DC curve uses up a budget, like the I²t of a
+ * fuse, at the rate allowed by the pulse curves. Operation below it gives the
+ * budget back as the MOSFET cools down.
+ *
+ * The module has no FreeRTOS or driver dependencies, so it can be checked on a
+ * host against synthetic sample streams.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Result of the SOA check of one sample.
+ */
+typedef enum
+{
+    SOA_OK,     /**< Inside the SOA. */
+    SOA_DERATE, /**< More than SOA_DERATE_LEVEL of the budget is used, the load should back off. */
+    SOA_TRIP,   /**< The budget is used up, the load must be switched off. */
+} SoaStatus;
+
+/**
+ * @brief State of the SOA accumulator.
+ */
+typedef struct
+{
+    float used;          /**< Fraction of the pulse budget used, the load trips at 1. */
+    int64_t previous_us; /**< Timestamp of the previous sample (us). */
+    bool started;        /**< true once the first sample has been checked. */
+} SoaState;
+
+/**
+ * @brief Start an empty accumulator.
+ *
+ * @param state The accumulator.
+ */
+void soa_init(SoaState *state);
+
+/**
+ * @brief Get the current limit of one SOA curve at a voltage.
+ *
+ * @param curve Index of the curve, 0 is the shortest pulse and the last is DC.
+ * @param voltage Drain voltage (V).
+ * @return The current limit (A).
+ */
+float soa_curve_current(uint32_t curve, float voltage);
+
+/**
+ * @brief Get how long the MOSFET may conduct a current at a voltage.
+ *
+ * @param voltage Drain voltage (V).
+ * @param current Drain current (A), the sign is ignored.
+ * @return The time allowed (us), INFINITY on or below the DC curve.
+ */
+float soa_allowed_time_us(float voltage, float current);
+
+/**
+ * @brief Check one sample and update the accumulator.
+ *
+ * The sample is taken to last from the previous sample to this one.
+ *
+ * @param state The accumulator.
+ * @param voltage Drain voltage (V).
+ * @param current Drain current (A).
+ * @param timestamp_us Timestamp of the sample (us).
+ * @return Whether the load may continue, should back off or must be switched off.
+ */
+SoaStatus soa_update(SoaState *state, float voltage, float current, int64_t timestamp_us);
+
+#endif // SOA_H
@@ -0,0 +1,126 @@
+#include "freertos/FreeRTOS.h"
+#include "freertos/task.h"
+#include "esp_task_wdt.h"
+#include "esp_timer.h"
+#include "esp_log.h"
+#include "supervisor.h"
+
+/**
+ * @file supervisor.c
+ * @brief Implementation of the deadline supervision of the real-time tasks.
+ *
+ * The deadline of a task is an absolute time, set from the heartbeat, so a
+ * task that sleeps on purpose, such as the control task while the load is off,
+ * announces a longer deadline instead of counting misses. The state is shared
+ * between the supervised tasks and the HTTP server and protected by a
+ * spinlock.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+static const char *TAG = "SUPERVISOR"; /**< Tag for logging messages from the supervisor. */
+
+/**
+ * @brief Supervision state of one task.
+ */
+typedef struct
+{
+    bool registered; /**< true once the task is under supervision. */
+    int64_t due_us;  /**< Time the next heartbeat is due by (us). */
+} SupervisedState;
+
+static SupervisedState supervised[SUPERVISED_COUNT] = {0};         /**< State of each supervised task. */
+static SupervisorStatistics supervisor_statistics = {0};            /**< Deadline counters. */
+static portMUX_TYPE supervisor_lock = portMUX_INITIALIZER_UNLOCKED; /**< Protects the state and the counters. */
+
+/**
+ * @brief Put the calling task under supervision and subscribe it to the task watchdog.
+ *
+ * @param task The calling task.
+ * @param deadline_us Time until the first heartbeat is due (us).
+ */
+void supervisor_register(SupervisedTask task, int64_t deadline_us)
+{
+    ESP_ERROR_CHECK(esp_task_wdt_add(NULL));
+
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&supervisor_lock);
+    supervised[task].due_us = now + deadline_us;
+    supervised[task].registered = true;
+    taskEXIT_CRITICAL(&supervisor_lock);
+
+    ESP_LOGI(TAG, "Supervising %s, first deadline in %lld us", pcTaskGetName(NULL), deadline_us);
+}
+
+/**
+ * @brief Check in and set the deadline of the next heartbeat.
+ *
+ * Also resets the task watchdog for the calling task.
+ *
+ * @param task The calling task.
+ * @param deadline_us Time until the next heartbeat is due (us).
+ */
+void supervisor_heartbeat(SupervisedTask task, int64_t deadline_us)
+{
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&supervisor_lock);
+    int64_t late_us = now - supervised[task].due_us;
+    if (late_us > 0)
+    {
+        supervisor_statistics.deadline_misses[task]++;
+        if (late_us > supervisor_statistics.max_late_us[task])
+        {
+            supervisor_statistics.max_late_us[task] = (late_us > UINT32_MAX) ? UINT32_MAX : (uint32_t)late_us;
+        }
+    }
+    supervised[task].due_us = now + deadline_us;
+    taskEXIT_CRITICAL(&supervisor_lock);
+
+    esp_task_wdt_reset();
+}
+
+/**
+ * @brief Count a switch to the safe state because of stale samples.
+ *
+ * @param task The task that found the samples stale.
+ */
+void supervisor_note_stale(SupervisedTask task)
+{
+    taskENTER_CRITICAL(&supervisor_lock);
+    supervisor_statistics.stale_events[task]++;
+    taskEXIT_CRITICAL(&supervisor_lock);
+}
+
+/**
+ * @brief Find the tasks that have not checked in by their deadline.
+ *
+ * @return A bit (1 << SupervisedTask) for each overdue task.
+ */
+uint32_t supervisor_overdue(void)
+{
+    uint32_t overdue = 0;
+    int64_t now = esp_timer_get_time();
+    taskENTER_CRITICAL(&supervisor_lock);
+    for (uint32_t task = 0; task < SUPERVISED_COUNT; task++)
+    {
+        if (supervised[task].registered && (now > supervised[task].due_us))
+        {
+            overdue |= 1 << task;
+        }
+    }
+    taskEXIT_CRITICAL(&supervisor_lock);
+    return overdue;
+}
+
+/**
+ * @brief Copy the deadline counters.
+ *
+ * @param statistics Output, the counters.
+ */
+void supervisor_get_statistics(SupervisorStatistics *statistics)
+{
+    taskENTER_CRITICAL(&supervisor_lock);
+    *statistics = supervisor_statistics;
+    taskEXIT_CRITICAL(&supervisor_lock);
+}
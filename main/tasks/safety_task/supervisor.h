@@ -0,0 +1,81 @@
+#ifndef SUPERVISOR_H
+#define SUPERVISOR_H
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @file supervisor.h
+ * @brief Header file for the deadline supervision of the real-time tasks.
+ *
+ * This file contains the declarations for supervising the measurement, control
+ * and safety tasks. Each task checks in with a heartbeat and says by when it
+ * will check in next. A late heartbeat counts as a deadline miss, and a task
+ * that has not checked in by its deadline is reported as overdue to the safety
+ * task, which switches the load off. The heartbeat also feeds the ESP-IDF task
+ * watchdog, which restarts the ESP32 if a task hangs for good.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+/**
+ * @brief Tasks under supervision.
+ */
+typedef enum
+{
+    SUPERVISED_MEASUREMENT, /**< Measurement task. */
+    SUPERVISED_CONTROL,     /**< Control task. */
+    SUPERVISED_SAFETY,      /**< Safety task. */
+    SUPERVISED_COUNT        /**< Number of supervised tasks. */
+} SupervisedTask;
+
+/**
+ * @brief Deadline counters of the supervised tasks, since start-up.
+ */
+typedef struct
+{
+    uint32_t deadline_misses[SUPERVISED_COUNT]; /**< Heartbeats that came after the deadline. */
+    uint32_t max_late_us[SUPERVISED_COUNT];     /**< Longest time a heartbeat came after the deadline (us). */
+    uint32_t stale_events[SUPERVISED_COUNT];    /**< Times the task found the latest good sample too old. */
+} SupervisorStatistics;
+
+/**
+ * @brief Put the calling task under supervision and subscribe it to the task watchdog.
+ *
+ * @param task The calling task.
+ * @param deadline_us Time until the first heartbeat is due (us).
+ */
+void supervisor_register(SupervisedTask task, int64_t deadline_us);
+
+/**
+ * @brief Check in and set the deadline of the next heartbeat.
+ *
+ * Also resets the task watchdog for the calling task.
+ *
+ * @param task The calling task.
+ * @param deadline_us Time until the next heartbeat is due (us).
+ */
+void supervisor_heartbeat(SupervisedTask task, int64_t deadline_us);
+
+/**
+ * @brief Count a switch to the safe state because of stale samples.
+ *
+ * @param task The task that found the samples stale.
+ */
+void supervisor_note_stale(SupervisedTask task);
+
+/**
+ * @brief Find the tasks that have not checked in by their deadline.
+ *
+ * @return A bit (1 << SupervisedTask) for each overdue task.
+ */
+uint32_t supervisor_overdue(void);
+
+/**
+ * @brief Copy the deadline counters.
+ *
+ * @param statistics Output, the counters.
+ */
+void supervisor_get_statistics(SupervisorStatistics *statistics);
+
+#endif // SUPERVISOR_H
@@ -0,0 +1,174 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include "ina237.h"
+#include "config.h"
+
+/*
+ * Host test of the missed conversion and duplicate sample counters, runs on the
+ * development machine without the board. A simulated INA237 raises ALERT edges,
+ * which are counted into a task notification as the ISR does, and a simulated
+ * measurement task takes the count and passes it through the counting of the
+ * firmware. From the repository root:
+ *
+ *   gcc -Itest_files/host/stubs -Imain -Imain/drivers/i2c -Imain/tasks/measurement_task test_files/host/Alert_count_test.c \
+ *       main/tasks/measurement_task/ina237.c -o alert_count_test && ./alert_count_test
+ */
+
+//Reads the simulated task makes per scenario
+#define ALERT_TEST_READS 10000
+
+//Time the task needs for one read, one fifth of a conversion (us)
+#define ALERT_TEST_READ_US (INA237_CONVERSION_PERIOD_US / 5)
+
+//How late a late read is, three and a half conversions, so three conversions are pending when it finishes (us)
+#define ALERT_TEST_LATE_US (7 * INA237_CONVERSION_PERIOD_US / 2)
+
+//How long ALERT stays silent in a stall, five and a half alert timeouts (us)
+#define ALERT_TEST_STALL_US (11 * INA237_ALERT_TIMEOUT_MS * 1000 / 2)
+
+//Expected count that is not checked, only the balance against the delivered edges is
+#define ALERT_TEST_ANY UINT32_MAX
+
+/**
+ * @brief One sequence of ALERT edges and reads.
+ */
+typedef struct
+{
+    const char *name;
+    float drift;                  //Relative error of the INA237 conversion period
+    uint32_t drop_every;          //Every drop_every-th edge is not seen by the ISR, 0 for none
+    uint32_t late_every;          //Every late_every-th read, from the first, finishes ALERT_TEST_LATE_US late, 0 for none
+    uint32_t stall_after;         //ALERT stays silent for ALERT_TEST_STALL_US after this edge, 0 for none
+    uint32_t expected_missed;     //Missed conversions the firmware has to count
+    uint32_t expected_duplicates; //Duplicate samples the firmware has to count
+} AlertScenario;
+
+//Not used by the counting, ina237.c only needs it to link
+esp_err_t i2c_read_block(i2c_master_dev_handle_t dev_handle_name, uint8_t start_register, uint8_t *read_buffer, size_t length){
+    return ESP_FAIL;
+}
+
+/**
+ * @brief Time of an ALERT edge.
+ *
+ * @param scenario The sequence.
+ * @param edge Number of the edge, counted from 1.
+ * @return Time of the edge (us).
+ */
+static double edge_time(const AlertScenario *scenario, uint32_t edge){
+    double time = edge * INA237_CONVERSION_PERIOD_US * (1.0 + scenario->drift);
+    if ((scenario->stall_after != 0) && (edge > scenario->stall_after)){
+        time += ALERT_TEST_STALL_US;
+    }
+    return time;
+}
+
+/**
+ * @brief Check if the ISR sees an ALERT edge.
+ */
+static bool edge_delivered(const AlertScenario *scenario, uint32_t edge){
+    return (scenario->drop_every == 0) || ((edge % scenario->drop_every) != 0);
+}
+
+/**
+ * @brief Run a sequence through the counting and check the counters.
+ *
+ * The task blocks until an edge arrives or INA237_ALERT_TIMEOUT_MS passes, as
+ * ulTaskNotifyTake() does, and every edge that arrives while it reads adds to
+ * the notification count for the next wake-up.
+ *
+ * @param scenario The sequence.
+ * @return true if the counters are as expected and balance against the delivered edges.
+ */
+static bool run_scenario(const AlertScenario *scenario){
+    MeasurementStatistics statistics = {0};
+    double now = 0;            //Time of the simulated task (us)
+    uint32_t next_edge = 1;    //Next edge that has not happened yet
+    uint32_t notification = 0; //Task notification count
+    uint32_t delivered = 0;    //Edges the ISR has seen
+    uint32_t stamped = 0;      //Reads timestamped with the alert time
+
+    for (uint32_t read = 1; read <= ALERT_TEST_READS; read++){
+        //Edges that arrived while the task was busy
+        for (; edge_time(scenario, next_edge) <= now; next_edge++){
+            if (edge_delivered(scenario, next_edge)){
+                notification++;
+                delivered++;
+            }
+        }
+
+        //Block for the next edge the ISR sees, or time out
+        if (notification == 0){
+            double timeout = now + INA237_ALERT_TIMEOUT_MS * 1000;
+            while ((edge_time(scenario, next_edge) <= timeout) && !edge_delivered(scenario, next_edge)){
+                next_edge++;
+            }
+            if (edge_time(scenario, next_edge) <= timeout){
+                now = edge_time(scenario, next_edge++);
+                notification = 1;
+                delivered++;
+            }
+            else{
+                now = timeout;
+            }
+        }
+
+        uint32_t pending = notification;
+        notification = 0;
+        stamped += ina237_count_conversions(pending, &statistics);
+
+        now += ALERT_TEST_READ_US;
+        if ((scenario->late_every != 0) && ((read % scenario->late_every) == 1)){
+            now += ALERT_TEST_LATE_US;
+        }
+    }
+
+    //Every delivered edge was either read or counted as missed, every other read was a duplicate
+    bool balanced = (ALERT_TEST_READS - statistics.duplicate_samples + statistics.missed_conversions == delivered) &&
+                    (stamped == ALERT_TEST_READS - statistics.duplicate_samples);
+    bool pass = balanced &&
+                ((scenario->expected_missed == ALERT_TEST_ANY) || (statistics.missed_conversions == scenario->expected_missed)) &&
+                ((scenario->expected_duplicates == ALERT_TEST_ANY) || (statistics.duplicate_samples == scenario->expected_duplicates));
+    printf("%s: %s: %u edges, %u seen, %u missed, %u duplicates%s\n", pass ? "PASS" : "FAIL", scenario->name,
+           (unsigned)(next_edge - 1), (unsigned)delivered, (unsigned)statistics.missed_conversions,
+           (unsigned)statistics.duplicate_samples, balanced ? "" : ", counters do not balance");
+    return pass;
+}
+
+/**
+ * @brief Main function
+ *
+ * This function feeds ALERT sequences through the counting of the measurement
+ * task and checks that:
+ * - a task keeping up, with or without drift of the INA237 clock, counts nothing,
+ * - a late read counts the conversions that completed while it was late as missed,
+ * - an edge the ISR never sees is not counted, it only lengthens one wait,
+ * - a silent ALERT gives one duplicate per alert timeout,
+ * - with all of these mixed, the counters still account for every edge.
+ *
+ * @return 0 if every check passed.
+ */
+int main(void){
+    static const AlertScenario scenarios[] = {
+        {"Nominal", 0.0f, 0, 0, 0, 0, 0},
+        {"Clock 5 % fast", -0.05f, 0, 0, 0, 0, 0},
+        {"Clock 5 % slow", 0.05f, 0, 0, 0, 0, 0},
+        //Three conversions pending after each of the 100 late reads, two of them missed
+        {"Every 100th read late", 0.0f, 0, 100, 0, 200, 0},
+        {"Every 100th read late, clock 5 % fast", -0.05f, 0, 100, 0, 200, 0},
+        {"Every 100th read late, clock 5 % slow", 0.05f, 0, 100, 0, 200, 0},
+        {"Every 25th edge dropped", 0.0f, 25, 0, 0, 0, 0},
+        //Five timeouts fit in the stall
+        {"ALERT silent for 5.5 timeouts", 0.0f, 0, 0, 5000, 0, 5},
+        {"Mixed", 0.03f, 25, 100, 5000, ALERT_TEST_ANY, 5},
+    };
+
+    bool pass = true;
+    for (size_t i = 0; i < sizeof(scenarios) / sizeof(scenarios[0]); i++){
+        pass &= run_scenario(&scenarios[i]);
+    }
+
+    printf("Alert count test %s\n", pass ? "PASSED" : "FAILED");
+    return pass ? 0 : 1;
+}
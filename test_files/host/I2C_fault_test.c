@@ -0,0 +1,211 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <string.h>
+#include "i2c.h"
+#include "ina237.h"
+#include "config.h"
+
+/*
+ * Host test of the I2C retry and bus recovery, and of how a failed INA237 read
+ * reaches the sample, runs on the development machine without the board. The
+ * ESP-IDF I2C master driver is replaced by the fake below, which fails transfer
+ * attempts on a chosen pattern. From the repository root:
+ *
+ *   gcc -Itest_files/host/stubs -Imain -Imain/drivers/i2c -Imain/tasks/measurement_task test_files/host/I2C_fault_test.c \
+ *       main/drivers/i2c/i2c.c main/tasks/measurement_task/ina237.c -o i2c_fault_test && ./i2c_fault_test
+ */
+
+//Samples read while every 50th transfer attempt fails
+#define I2C_FAULT_TEST_SAMPLES 1000
+
+//INA237 result frame the fake device returns: 0.32 mV shunt, 20 V bus, 50 C die, 2 A and 0.39 W
+static const uint8_t device_frame[INA237_FRAME_LENGTH] = {0x00, 0x40, 0x19, 0x00, 0x19, 0x00, 0x20, 0x00, 0x00, 0x1F, 0x40};
+
+static const char *fault_pattern = ""; //One character per transfer attempt, repeated, 'F' fails the attempt. Empty never fails.
+static uint32_t attempts = 0;          //Transfer attempts since the pattern was set
+static uint32_t bus_resets = 0;        //Calls to i2c_master_bus_reset()
+static int bus = 0;                    //Stand-in for the bus, only its address is used as the handle
+
+/**
+ * @brief Select the failure pattern and clear the attempt and reset counts.
+ *
+ * @param pattern One character per transfer attempt, repeated, 'F' fails the attempt.
+ */
+static void set_pattern(const char *pattern){
+    fault_pattern = pattern;
+    attempts = 0;
+    bus_resets = 0;
+}
+
+/**
+ * @brief Count one transfer attempt and decide if it fails.
+ *
+ * @return ESP_ERR_TIMEOUT if the pattern fails this attempt, else ESP_OK.
+ */
+static esp_err_t fake_attempt(void){
+    size_t length = strlen(fault_pattern);
+    bool fail = (length > 0) && (fault_pattern[attempts % length] == 'F');
+    attempts++;
+    return fail ? ESP_ERR_TIMEOUT : ESP_OK;
+}
+
+esp_err_t i2c_new_master_bus(const i2c_master_bus_config_t *bus_config, i2c_master_bus_handle_t *ret_bus_handle){
+    *ret_bus_handle = (i2c_master_bus_handle_t)&bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_add_device(i2c_master_bus_handle_t bus_handle, const i2c_device_config_t *dev_config, i2c_master_dev_handle_t *ret_handle){
+    *ret_handle = (i2c_master_dev_handle_t)&bus;
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_bus_rm_device(i2c_master_dev_handle_t handle){
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_probe(i2c_master_bus_handle_t bus_handle, uint16_t address, int xfer_timeout_ms){
+    return ESP_OK;
+}
+
+esp_err_t i2c_master_transmit(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size, int xfer_timeout_ms){
+    return fake_attempt();
+}
+
+esp_err_t i2c_master_transmit_receive(i2c_master_dev_handle_t i2c_dev, const uint8_t *write_buffer, size_t write_size,
+                                      uint8_t *read_buffer, size_t read_size, int xfer_timeout_ms){
+    esp_err_t err = fake_attempt();
+    if (err == ESP_OK){
+        memcpy(read_buffer, device_frame, (read_size < sizeof(device_frame)) ? read_size : sizeof(device_frame));
+    }
+    else{
+        //A failed transfer may have clocked in part of the data
+        memset(read_buffer, 0xA5, read_size);
+    }
+    return err;
+}
+
+esp_err_t i2c_master_bus_reset(i2c_master_bus_handle_t bus_handle){
+    bus_resets++;
+    return ESP_OK;
+}
+
+/**
+ * @brief Print the result of one check.
+ *
+ * @return pass, so the checks can be chained.
+ */
+static bool report(bool pass, const char *name){
+    I2CStatistics statistics;
+    i2c_get_statistics(&statistics);
+    printf("%s: %s: %u attempts, %u bus resets, statistics %u retries, %u recoveries, %u failures\n", pass ? "PASS" : "FAIL",
+           name, (unsigned)attempts, (unsigned)bus_resets, (unsigned)statistics.retries, (unsigned)statistics.recoveries,
+           (unsigned)statistics.failures);
+    return pass;
+}
+
+/**
+ * @brief Check the change of the transfer layer counters since a snapshot.
+ *
+ * @return true if the counters moved by exactly the given amounts.
+ */
+static bool counters_moved(const I2CStatistics *before, uint32_t retries, uint32_t recoveries, uint32_t failures){
+    I2CStatistics after;
+    i2c_get_statistics(&after);
+    return (after.retries - before->retries == retries) && (after.recoveries - before->recoveries == recoveries) &&
+           (after.failures - before->failures == failures);
+}
+
+/**
+ * @brief Main function
+ *
+ * This function runs the I2C layer and the INA237 sample read against a fake
+ * driver and checks that:
+ * - a failed attempt is retried after exactly one bus recovery,
+ * - a transfer failing on every attempt is given up after I2C_RETRIES retries,
+ *   counted once as a failure, and leaves the caller's data unchanged,
+ * - a failed INA237 read gives MEASUREMENT_I2C_ERROR with the previous values kept,
+ * - a sporadic failure is absorbed by the retry without losing a sample,
+ * - validating a register neither retries nor recovers the bus.
+ *
+ * @return 0 if every check passed.
+ */
+int main(void){
+    bool pass = true;
+    I2CStatistics before;
+    i2c_master_bus_handle_t bus_handle;
+    i2c_master_dev_handle_t dev_handle;
+    i2c_init(&bus_handle, 11, 12);
+    i2c_add_device(bus_handle, &dev_handle, INA237_ADDRESS, I2C_SPEED_STANDARD);
+
+    //No failures, one attempt and no recovery
+    int16_t data = 0;
+    set_pattern("");
+    i2c_get_statistics(&before);
+    esp_err_t err = i2c_read(dev_handle, INA237_VSHUNT_REG, &data);
+    pass &= report((err == ESP_OK) && (data == 0x0040) && (attempts == 1) && (bus_resets == 0) &&
+                   counters_moved(&before, 0, 0, 0), "Clean read");
+
+    //The first attempt fails, the retry after one recovery succeeds
+    set_pattern("F.");
+    i2c_get_statistics(&before);
+    data = 0;
+    err = i2c_read(dev_handle, INA237_VSHUNT_REG, &data);
+    pass &= report((err == ESP_OK) && (data == 0x0040) && (attempts == 2) && (bus_resets == 1) &&
+                   counters_moved(&before, 1, 1, 0), "One failed attempt");
+
+    //Every attempt fails, the error is returned and the data is left alone
+    set_pattern("F");
+    i2c_get_statistics(&before);
+    data = 1234;
+    err = i2c_read(dev_handle, INA237_VSHUNT_REG, &data);
+    pass &= report((err == ESP_ERR_TIMEOUT) && (data == 1234) && (attempts == I2C_RETRIES + 1) && (bus_resets == I2C_RETRIES) &&
+                   counters_moved(&before, I2C_RETRIES, I2C_RETRIES, 1), "Every attempt failed, read");
+
+    err = i2c_write(dev_handle, INA237_CONFIG_REG, 0);
+    pass &= report((err == ESP_ERR_TIMEOUT) && (attempts == 2 * (I2C_RETRIES + 1)) && (bus_resets == 2 * I2C_RETRIES) &&
+                   counters_moved(&before, 2 * I2C_RETRIES, 2 * I2C_RETRIES, 2), "Every attempt failed, write");
+
+    //A good INA237 read, then one without a new conversion, then one that fails
+    Ina237Raw raw = {0};
+    MeasurementData measurements = {0};
+    set_pattern("");
+    MeasurementQuality quality = ina237_read_sample(dev_handle, true, &raw, &measurements);
+    pass &= report((quality == MEASUREMENT_OK) && (measurements.quality == MEASUREMENT_OK) && (raw.current == 0x2000) &&
+                   (measurements.current == 2.0f) && (measurements.bus_voltage == 20.0f), "INA237 read");
+
+    quality = ina237_read_sample(dev_handle, false, &raw, &measurements);
+    pass &= report((quality == MEASUREMENT_DUPLICATE) && (measurements.current == 2.0f), "INA237 read without a conversion");
+
+    Ina237Raw previous_raw = raw;
+    MeasurementData previous = measurements;
+    set_pattern("F");
+    quality = ina237_read_sample(dev_handle, true, &raw, &measurements);
+    previous.quality = MEASUREMENT_I2C_ERROR;
+    pass &= report((quality == MEASUREMENT_I2C_ERROR) && (memcmp(&raw, &previous_raw, sizeof(raw)) == 0) &&
+                   (memcmp(&measurements, &previous, sizeof(measurements)) == 0), "INA237 read failed, previous values kept");
+
+    //Every 50th attempt fails, each one costs a retry but no sample
+    set_pattern("F.................................................");
+    i2c_get_statistics(&before);
+    uint32_t errors = 0;
+    for (int i = 0; i < I2C_FAULT_TEST_SAMPLES; i++){
+        errors += (ina237_read_sample(dev_handle, true, &raw, &measurements) == MEASUREMENT_I2C_ERROR);
+    }
+    uint32_t failed_attempts = (attempts + 49) / 50;
+    pass &= report((errors == 0) && (attempts == I2C_FAULT_TEST_SAMPLES + failed_attempts) &&
+                   counters_moved(&before, failed_attempts, failed_attempts, 0), "Every 50th attempt failed");
+
+    //Validation returns the first failure without retrying or recovering
+    set_pattern("F.");
+    i2c_get_statistics(&before);
+    err = i2c_validate_register(dev_handle, INA237_VSHUNT_REG, 0x0040, 5);
+    pass &= report((err == ESP_ERR_TIMEOUT) && (attempts == 1) && (bus_resets == 0) && counters_moved(&before, 0, 0, 0),
+                   "Validation stops at the first failure");
+
+    set_pattern("");
+    err = i2c_validate_register(dev_handle, INA237_VSHUNT_REG, 0x0040, 5);
+    pass &= report((err == ESP_OK) && (attempts == 5), "Validation without failures");
+
+    printf("I2C fault test %s\n", pass ? "PASSED" : "FAILED");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,148 @@
+#include <stdio.h>
+#include <math.h>
+#include "iv_sweep.h"
+#include "regulator.h"
+#include "config.h"
+
+/*
+ * Host test of the I-V sweep settle detection, runs on the development machine
+ * without the board. From the repository root:
+ *
+ *   gcc -Itest_files/host/stubs -Imain -Imain/tasks/control_task test_files/host/IV_sweep_test.c \
+ *       main/tasks/control_task/iv_sweep.c main/tasks/control_task/regulator.c -lm -o iv_sweep_test && ./iv_sweep_test
+ */
+
+//Time between samples, one INA237 conversion (us)
+#define IV_SWEEP_TEST_DT_US 1130
+
+//Longest simulated sweep (us)
+#define IV_SWEEP_TEST_MAX_US 600000000LL
+
+//Simulated DUT: a 24 V source with 8 ohm internal resistance, the same as in Mode_switch_test.c
+#define PLANT_SOURCE_VOLTAGE 24.0f
+#define PLANT_SOURCE_RESISTANCE 8.0f
+
+//Simulated load: conductance at 100 % duty (S) and the MOSFET/filter time constant (s)
+#define PLANT_MAX_CONDUCTANCE 1.0f
+#define PLANT_TIME_CONSTANT 0.002f
+
+static float conductance = 0; //Simulated load conductance (S)
+static float duty_cycle = 0;  //Duty cycle applied to the simulated load (%)
+static MeasurementData measurements;
+
+/**
+ * @brief Advance the simulated load by one sample and fill in the measurements.
+ */
+static void plant_step(void){
+    float dt = IV_SWEEP_TEST_DT_US * 1e-6f;
+    float target = duty_cycle * (PLANT_MAX_CONDUCTANCE / 100.0f);
+    conductance += (target - conductance) * (dt / PLANT_TIME_CONSTANT > 1.0f ? 1.0f : dt / PLANT_TIME_CONSTANT);
+
+    measurements.current = PLANT_SOURCE_VOLTAGE * conductance / (1.0f + PLANT_SOURCE_RESISTANCE * conductance);
+    measurements.bus_voltage = PLANT_SOURCE_VOLTAGE - measurements.current * PLANT_SOURCE_RESISTANCE;
+    measurements.power = measurements.bus_voltage * measurements.current;
+}
+
+/**
+ * @brief Run a sweep against the simulated load, as the control task does.
+ *
+ * @param config Settings of the sweep.
+ * @param report Output, the result.
+ */
+static void run_sweep(const SweepConfig *config, SweepReport *report){
+    Regulator regulator;
+    regulator_init(&regulator, &regulator_descriptors[MODE_CC]);
+    conductance = 0;
+    duty_cycle = 0;
+    plant_step();
+
+    iv_sweep_configure(config);
+    iv_sweep_restart();
+    for (int64_t t = IV_SWEEP_TEST_DT_US; t <= IV_SWEEP_TEST_MAX_US; t += IV_SWEEP_TEST_DT_US){
+        measurements.timestamp_us = t;
+        ControlMode mode;
+        float setpoint;
+        if (!iv_sweep_step(&measurements, &mode, &setpoint)){
+            break;
+        }
+        if (regulator.descriptor != &regulator_descriptors[mode]){
+            regulator_transfer(&regulator, &regulator_descriptors[mode], duty_cycle, setpoint,
+                               regulator_measurement(&regulator_descriptors[mode], &measurements));
+        }
+        duty_cycle = regulator_update(&regulator, setpoint, regulator_measurement(regulator.descriptor, &measurements),
+                                      IV_SWEEP_TEST_DT_US * 1e-6f);
+        plant_step();
+    }
+    iv_sweep_get_report(report);
+}
+
+/**
+ * @brief Check that every settled point of a CC sweep is within the tolerance of its reference.
+ *
+ * @param name Name of the check.
+ * @param config Settings of the sweep.
+ * @param min_settled Fewest points that have to settle.
+ * @return true if the check passed.
+ */
+static bool check_cc_sweep(const char *name, const SweepConfig *config, uint32_t min_settled){
+    static SweepReport report;
+    run_sweep(config, &report);
+
+    uint32_t settled = 0;
+    float worst_error = 0;
+    for (uint32_t i = 0; i < report.count; i++){
+        float reference = config->max_current * (float)i / (float)(config->points - 1);
+        float error = fabsf(report.points[i].current - reference);
+        if (report.points[i].settled){
+            settled++;
+            worst_error = fmaxf(worst_error, error);
+        }
+    }
+    float tolerance = config->settle_tolerance * config->max_current;
+    bool pass = (report.state == SWEEP_FINISHED) && (report.count == config->points) && (settled >= min_settled) &&
+                (worst_error <= tolerance);
+    printf("%s: %s, %u of %u points settled, worst error %.4f A of %.4f A allowed, %.1f s\n", pass ? "PASS" : "FAIL",
+           name, (unsigned)settled, (unsigned)report.count, worst_error, tolerance, report.duration_us * 1e-6);
+    return pass;
+}
+
+/**
+ * @brief Main function
+ *
+ * This function sweeps the simulated 24 V, 8 ohm source with the gains of the
+ * control task and checks that the points are recorded at their reference,
+ * not while the loop is still moving towards it. The loop slows down as the
+ * load approaches full conductance, so the last points of the curve need a
+ * longer timeout than the default, and with the default they have to be
+ * flagged rather than recorded as settled.
+ *
+ * @return 0 if every check passed.
+ */
+int main(void){
+    int failures = 0;
+
+    //Up to 2 A every point settles well inside the default timeout
+    SweepConfig config = {
+        .reference = MODE_CC,
+        .points = 50,
+        .max_current = 2.0f,
+        .settle_tolerance = 0.01f,
+        .settle_timeout_us = SWEEP_SETTLE_TIMEOUT_US,
+    };
+    failures += !check_cc_sweep("CC sweep to 2 A", &config, config.points);
+
+    //Up to 2.5 A the last points are slower than the default timeout, those that settle must still be on the reference
+    config.max_current = 2.5f;
+    failures += !check_cc_sweep("CC sweep to 2.5 A, default timeout", &config, 1);
+
+    //With a longer timeout they all settle
+    config.settle_timeout_us = 10000000;
+    failures += !check_cc_sweep("CC sweep to 2.5 A, 10 s timeout", &config, config.points);
+
+    if (failures != 0){
+        printf("FAIL: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
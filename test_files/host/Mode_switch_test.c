@@ -0,0 +1,244 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include "regulator.h"
+#include "config.h"
+
+/*
+ * Host test of the bumpless mode switch and the anti-windup of both regulator
+ * variants, runs on the development machine without the board. From the
+ * repository root:
+ *
+ *   gcc -Itest_files/host/stubs -Imain -Imain/tasks/control_task test_files/host/Mode_switch_test.c \
+ *       main/tasks/control_task/regulator.c -lm -o mode_switch_test && ./mode_switch_test
+ */
+
+//Time between updates, one INA237 conversion (us)
+#define MODE_SWITCH_TEST_DT_US 1130
+
+//Updates to let the loop settle before each switch, about 2 s
+#define MODE_SWITCH_TEST_SETTLE 1770
+
+//Time step of the first update after a stall, 1 / kb of constant current, which caps the back-calculation factor at 1.0 (us)
+#define MODE_SWITCH_TEST_STALL_US 160000
+
+//Largest integral term allowed after the stall, as a fraction of full output
+#define MODE_SWITCH_MAX_STALL_INTEGRAL 0.01
+
+//Simulated DUT: a 24 V source with 8 ohm internal resistance, so voltage and power move with the current
+#define PLANT_SOURCE_VOLTAGE 24.0f
+#define PLANT_SOURCE_RESISTANCE 8.0f
+
+//Simulated load: conductance at 100 % duty (S) and the MOSFET/filter time constant (s)
+#define PLANT_MAX_CONDUCTANCE 1.0f
+#define PLANT_TIME_CONSTANT 0.002f
+
+//Largest duty cycle step allowed when switching mode at the operating point (%)
+#define MODE_SWITCH_MAX_BUMP 0.5f
+
+//Largest overshoot allowed after a switch, and largest error left at the end, as a fraction of the step
+#define MODE_SWITCH_MAX_OVERSHOOT 0.05f
+#define MODE_SWITCH_MAX_SETTLING_ERROR 0.05f
+
+static float conductance = 0; //Simulated load conductance (S)
+static float duty_cycle = 0;  //Duty cycle applied to the simulated load (%)
+static bool fixed_point = false; //true to run the Q15/Q31 variant of the regulator, as with REGULATOR_FIXED_POINT
+static MeasurementData measurements;
+
+/**
+ * @brief Advance the simulated load by one update and fill in the measurements.
+ */
+static void plant_step(void){
+    float dt = MODE_SWITCH_TEST_DT_US * 1e-6f;
+    float target = duty_cycle * (PLANT_MAX_CONDUCTANCE / 100.0f);
+    conductance += (target - conductance) * (dt / PLANT_TIME_CONSTANT > 1.0f ? 1.0f : dt / PLANT_TIME_CONSTANT);
+
+    measurements.current = PLANT_SOURCE_VOLTAGE * conductance / (1.0f + PLANT_SOURCE_RESISTANCE * conductance);
+    measurements.bus_voltage = PLANT_SOURCE_VOLTAGE - measurements.current * PLANT_SOURCE_RESISTANCE;
+    measurements.power = measurements.bus_voltage * measurements.current;
+}
+
+/**
+ * @brief Run one regulator update in the selected variant, the way the control task does.
+ *
+ * @param regulator The regulator.
+ * @param setpoint The setpoint (unit of the mode).
+ * @param measured The measurement (unit of the mode).
+ * @param dt_us Time since the previous update (us).
+ * @return The duty cycle (%).
+ */
+static float update(Regulator *regulator, float setpoint, float measured, int32_t dt_us){
+    if (fixed_point){
+        int16_t duty_q15 = regulator_update_q15(regulator,
+                                                regulator_to_q15(regulator->descriptor, setpoint),
+                                                regulator_to_q15(regulator->descriptor, measured),
+                                                dt_us);
+        return (float)duty_q15 * (100.0f / 32768.0f);
+    }
+    return regulator_update(regulator, setpoint, measured, (float)dt_us * 1e-6f);
+}
+
+/**
+ * @brief Run the regulator against the simulated load.
+ *
+ * @param regulator The regulator.
+ * @param setpoint The setpoint (unit of the mode).
+ * @param updates Number of updates to run.
+ * @param max_bump Largest duty cycle change between two updates, in the first 100 updates (%).
+ * @param peak Largest measurement seen while the measurement rises towards the setpoint, else the smallest.
+ */
+static void run(Regulator *regulator, float setpoint, int updates, float *max_bump, float *peak){
+    float start = regulator_measurement(regulator->descriptor, &measurements);
+    bool rising = setpoint > start;
+    *max_bump = 0;
+    *peak = start;
+
+    for (int i = 0; i < updates; i++){
+        float measured = regulator_measurement(regulator->descriptor, &measurements);
+        float previous_duty = duty_cycle;
+        duty_cycle = update(regulator, setpoint, measured, MODE_SWITCH_TEST_DT_US);
+        plant_step();
+
+        float bump = duty_cycle - previous_duty;
+        bump = (bump < 0) ? -bump : bump;
+        if (i < 100 && bump > *max_bump){
+            *max_bump = bump;
+        }
+
+        measured = regulator_measurement(regulator->descriptor, &measurements);
+        if (rising ? (measured > *peak) : (measured < *peak)){
+            *peak = measured;
+        }
+    }
+}
+
+/**
+ * @brief Check the overshoot and settling of a step against the limits and print the result.
+ *
+ * @return True if the step settled within the limits.
+ */
+static bool check_step(const char *name, float start, float setpoint, float peak, float end, const char *unit){
+    float step = setpoint - start;
+    float overshoot = (step != 0) ? (peak - setpoint) / step : 0;
+    float settling_error = (step != 0) ? (setpoint - end) / step : 0;
+    settling_error = (settling_error < 0) ? -settling_error : settling_error;
+    bool pass = (overshoot <= MODE_SWITCH_MAX_OVERSHOOT) && (settling_error <= MODE_SWITCH_MAX_SETTLING_ERROR);
+    printf("%s: %s %s: %.2f -> %.2f %s, peak %.2f %s, end %.2f %s, overshoot %.1f %%\n", pass ? "PASS" : "FAIL",
+           fixed_point ? "Q15" : "float", name, start, setpoint, unit, peak, unit, end, unit, overshoot * 100.0f);
+    return pass;
+}
+
+/**
+ * @brief Check the duty cycle bump of a switch against the limit and print the result.
+ *
+ * @return True if the bump is within the limit.
+ */
+static bool check_bump(const char *name, float bump){
+    bool pass = bump <= MODE_SWITCH_MAX_BUMP;
+    printf("%s: %s %s: largest duty step %.3f %%\n", pass ? "PASS" : "FAIL", fixed_point ? "Q15" : "float", name, bump);
+    return pass;
+}
+
+/**
+ * @brief Run the mode switch sequence on a fresh plant with the selected variant.
+ *
+ * @return True if every check passed.
+ */
+static bool run_sequence(void){
+    Regulator regulator;
+    bool pass = true;
+    float bump, peak, start;
+
+    conductance = 0;
+    duty_cycle = 0;
+    plant_step();
+
+    //Settle in constant current at 1.5 A
+    regulator_init(&regulator, &regulator_descriptors[MODE_CC]);
+    run(&regulator, 1.5f, MODE_SWITCH_TEST_SETTLE, &bump, &peak);
+
+    //CC -> CV at the voltage the load is at, nothing should move
+    float voltage = measurements.bus_voltage;
+    regulator_transfer(&regulator, &regulator_descriptors[MODE_CV], duty_cycle, voltage, voltage);
+    run(&regulator, voltage, MODE_SWITCH_TEST_SETTLE, &bump, &peak);
+    pass &= check_bump("CC -> CV", bump);
+
+    //CV -> CP at the power the load is at, nothing should move
+    float power = measurements.power;
+    regulator_transfer(&regulator, &regulator_descriptors[MODE_CP], duty_cycle, power, power);
+    run(&regulator, power, MODE_SWITCH_TEST_SETTLE, &bump, &peak);
+    pass &= check_bump("CV -> CP", bump);
+
+    //CP -> CC with a new setpoint
+    start = measurements.current;
+    regulator_transfer(&regulator, &regulator_descriptors[MODE_CC], duty_cycle, 1.0f, start);
+    run(&regulator, 1.0f, MODE_SWITCH_TEST_SETTLE, &bump, &peak);
+    pass &= check_step("CP -> CC step", start, 1.0f, peak, measurements.current, "A");
+
+    //CC -> CP with a new setpoint, below the maximum power point of the source. Constant power is tuned slow.
+    start = measurements.power;
+    regulator_transfer(&regulator, &regulator_descriptors[MODE_CP], duty_cycle, 12.0f, start);
+    run(&regulator, 12.0f, 40 * MODE_SWITCH_TEST_SETTLE, &bump, &peak);
+    pass &= check_step("CC -> CP step", start, 12.0f, peak, measurements.power, "W");
+
+    //Windup: ask for more current than the source can give, then drop the setpoint to 1 A
+    regulator_transfer(&regulator, &regulator_descriptors[MODE_CC], duty_cycle, 5.0f, measurements.current);
+    run(&regulator, 5.0f, MODE_SWITCH_TEST_SETTLE, &bump, &peak);
+    start = measurements.current;
+    printf("%s: saturated at %.1f %% duty, %.2f A\n", fixed_point ? "Q15" : "float", duty_cycle, start);
+    run(&regulator, 1.0f, 3 * MODE_SWITCH_TEST_SETTLE, &bump, &peak);
+    pass &= check_step("Windup recovery", start, 1.0f, peak, measurements.current, "A");
+
+    return pass;
+}
+
+/**
+ * @brief Check the Q15 back-calculation on the first update after a stall.
+ *
+ * The integral term sits at -100 % and the error is full scale negative, so
+ * the output is far below the saturation limit, and the time step of 1 / kb
+ * caps the tracking factor at 1.0. The integrated error then equals the
+ * proportional term, and full tracking to the zero output leaves an integral
+ * term of zero, unless the back-calculation product overflows.
+ *
+ * @return True if the integral term ended up at zero.
+ */
+static bool check_stall(void){
+    Regulator regulator;
+    regulator_init(&regulator, &regulator_descriptors[MODE_CC]);
+    regulator.integral_q31 = -INT32_MAX;
+
+    int16_t duty_q15 = regulator_update_q15(&regulator, INT16_MIN, INT16_MAX, MODE_SWITCH_TEST_STALL_US);
+
+    int32_t limit = (int32_t)(MODE_SWITCH_MAX_STALL_INTEGRAL * INT32_MAX);
+    bool pass = (duty_q15 == 0) && (regulator.integral_q31 <= limit) && (regulator.integral_q31 >= -limit);
+    printf("%s: Q15 stall of %d us at full-scale error: duty %d, integral %ld\n", pass ? "PASS" : "FAIL",
+           MODE_SWITCH_TEST_STALL_US, duty_q15, (long)regulator.integral_q31);
+    return pass;
+}
+
+/**
+ * @brief Main function
+ *
+ * This function runs both regulator variants against a simulated supply and
+ * load, with the descriptors of the control task, and switches mode in the
+ * middle of the run the way /mode does, checking that:
+ * - switching at the operating point does not step the duty cycle,
+ * - stepping the setpoint while switching stays within the overshoot limit,
+ * - after running into saturation the loop recovers without windup overshoot.
+ * It then checks the fixed point back-calculation on the first update after a
+ * stall.
+ *
+ * @return 0 if every check passed.
+ */
+int main(void){
+    bool pass = true;
+
+    fixed_point = false;
+    pass &= run_sequence();
+    fixed_point = true;
+    pass &= run_sequence();
+    pass &= check_stall();
+
+    printf("Mode switch test %s\n", pass ? "PASSED" : "FAILED");
+    return pass ? 0 : 1;
+}
@@ -0,0 +1,81 @@
+#include <stdio.h>
+#include <stdbool.h>
+#include <math.h>
+#include <time.h>
+#include "ntc.h"
+
+/*
+ * Host test of the NTC lookup table, runs on the development machine without
+ * the board. From the repository root:
+ *
+ *   gcc -Itest_files/host/stubs -Imain -Imain/tasks/measurement_task test_files/host/NTC_test.c \
+ *       main/tasks/measurement_task/ntc.c -lm -o ntc_test && ./ntc_test
+ */
+
+//Temperature range the table accuracy is checked over (°C)
+#define NTC_TEST_MIN_T 0.0
+#define NTC_TEST_MAX_T 150.0
+
+//Largest accepted difference between the table and the exact equation (°C)
+#define NTC_TEST_MAX_ERROR 0.5
+
+//Sweeps of the full ADC range per benchmark, so clock() has something to measure
+#define NTC_TEST_BENCHMARK_PASSES 100
+
+/**
+ * @brief Main function
+ *
+ * This function builds the NTC temperature table, sweeps every ADC code and
+ * compares the table against the exact Beta equation, then measures the time
+ * each conversion takes on the host, only as a guide for the ESP32-S3.
+ *
+ * @return 0 if the error of the table is within NTC_TEST_MAX_ERROR.
+ */
+int main(void){
+    //Table under test
+    static NtcTable table;
+    ntc_table_init(&table, B_NTC_INTERNAL);
+
+    //Sweep every ADC code and track the largest error inside the test range
+    float max_error = 0;
+    int max_error_code = 0;
+    for (int code = 1; code < NTC_ADC_MAX; code++){
+        float exact = R_to_T(B_NTC_INTERNAL, ntc_resistance_calculate(code, R1_NTC_VDIV, NTC_ADC_MAX));
+        if (exact < NTC_TEST_MIN_T || exact > NTC_TEST_MAX_T){
+            continue;
+        }
+        float error = fabsf(ntc_table_lookup(&table, code) - exact);
+        if (error > max_error){
+            max_error = error;
+            max_error_code = code;
+        }
+    }
+    bool pass = max_error <= NTC_TEST_MAX_ERROR;
+    printf("%s: max error %.3f C at ADC code %d, %.2f C allowed\n", pass ? "PASS" : "FAIL", max_error, max_error_code,
+           NTC_TEST_MAX_ERROR);
+
+    //Benchmark both conversions over the full ADC range
+    volatile float sink = 0;
+    clock_t start = clock();
+    for (int pass_index = 0; pass_index < NTC_TEST_BENCHMARK_PASSES; pass_index++){
+        for (int code = 1; code < NTC_ADC_MAX; code++){
+            sink = R_to_T(B_NTC_INTERNAL, ntc_resistance_calculate(code, R1_NTC_VDIV, NTC_ADC_MAX));
+        }
+    }
+    double exact_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    start = clock();
+    for (int pass_index = 0; pass_index < NTC_TEST_BENCHMARK_PASSES; pass_index++){
+        for (int code = 1; code < NTC_ADC_MAX; code++){
+            sink = ntc_table_lookup(&table, code);
+        }
+    }
+    double table_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    (void)sink;
+
+    printf("Exact: %.1f ns/conversion, table: %.1f ns/conversion on the host\n",
+           exact_s * 1e9 / ((double)NTC_TEST_BENCHMARK_PASSES * (NTC_ADC_MAX - 1)),
+           table_s * 1e9 / ((double)NTC_TEST_BENCHMARK_PASSES * (NTC_ADC_MAX - 1)));
+
+    return pass ? 0 : 1;
+}
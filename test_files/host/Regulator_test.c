@@ -0,0 +1,86 @@
+#include <stdio.h>
+#include <time.h>
+#include "regulator.h"
+#include "config.h"
+
+/*
+ * Host test of the float and fixed point regulators, runs on the development
+ * machine without the board. From the repository root:
+ *
+ *   gcc -Itest_files/host/stubs -Imain -Imain/tasks/control_task test_files/host/Regulator_test.c \
+ *       main/tasks/control_task/regulator.c -lm -o regulator_test && ./regulator_test
+ */
+
+//Number of regulator updates per benchmark
+#define REGULATOR_TEST_UPDATES 1000000
+
+//Largest difference allowed between the float and the fixed point output (% duty)
+#define REGULATOR_TEST_MAX_DIFFERENCE 0.01f
+
+//Time between updates, one INA237 conversion (us)
+#define REGULATOR_TEST_DT_US 1130
+
+//Constant current descriptor of the control task
+static const RegulatorDescriptor *const descriptor = &regulator_descriptors[MODE_CC];
+
+/**
+ * @brief Main function
+ *
+ * This function runs the float and the Q15/Q31 fixed point regulator on the same
+ * error sequence and prints the time per update of each variant, only as a
+ * guide since the host has a different FPU and pipeline than the ESP32-S3. It
+ * then checks that the outputs of the two variants agree on a step response.
+ *
+ * @return 0 if the outputs agree.
+ */
+int main(void){
+    Regulator regulator_float;
+    Regulator regulator_fixed;
+    regulator_init(&regulator_float, descriptor);
+    regulator_init(&regulator_fixed, descriptor);
+
+    //Small errors around a 5 A setpoint, so neither variant saturates
+    const float setpoint = 5.0f;
+    volatile float sink_float = 0;
+    volatile int16_t sink_fixed = 0;
+
+    //Benchmark the float variant
+    clock_t start = clock();
+    for (int i = 0; i < REGULATOR_TEST_UPDATES; i++){
+        float measured = setpoint + ((i & 63) - 32) * 0.001f;
+        sink_float = regulator_update(&regulator_float, setpoint, measured, REGULATOR_TEST_DT_US * 1e-6f);
+    }
+    double float_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    //Benchmark the fixed point variant, inputs are converted beforehand like a raw sensor value would be
+    int16_t setpoint_q15 = regulator_to_q15(descriptor, setpoint);
+    start = clock();
+    for (int i = 0; i < REGULATOR_TEST_UPDATES; i++){
+        int16_t measured_q15 = setpoint_q15 + ((i & 63) - 32) * 3;
+        sink_fixed = regulator_update_q15(&regulator_fixed, setpoint_q15, measured_q15, REGULATOR_TEST_DT_US);
+    }
+    double fixed_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+
+    printf("Float: %.1f ns/update, fixed point: %.1f ns/update on the host\n",
+           float_s * 1e9 / REGULATOR_TEST_UPDATES, fixed_s * 1e9 / REGULATOR_TEST_UPDATES);
+
+    //Compare the two variants on a step response
+    regulator_reset(&regulator_float);
+    regulator_reset(&regulator_fixed);
+    float max_difference = 0;
+    for (int i = 0; i < 200; i++){
+        float measured = (i < 100) ? 4.9f : 5.1f;
+        float duty_float = regulator_update(&regulator_float, setpoint, measured, REGULATOR_TEST_DT_US * 1e-6f);
+        int16_t duty_q15 = regulator_update_q15(&regulator_fixed, setpoint_q15, regulator_to_q15(descriptor, measured), REGULATOR_TEST_DT_US);
+        float difference = duty_float - duty_q15 * (100.0f / 32768.0f);
+        difference = (difference < 0) ? -difference : difference;
+        max_difference = (difference > max_difference) ? difference : max_difference;
+    }
+    (void)sink_float;
+    (void)sink_fixed;
+
+    bool pass = max_difference <= REGULATOR_TEST_MAX_DIFFERENCE;
+    printf("%s: largest difference between float and fixed point %.4f %% duty of %.4f %% allowed\n",
+           pass ? "PASS" : "FAIL", max_difference, REGULATOR_TEST_MAX_DIFFERENCE);
+    return pass ? 0 : 1;
+}
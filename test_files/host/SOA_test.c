@@ -0,0 +1,123 @@
+#include <stdio.h>
+#include <math.h>
+#include <time.h>
+#include "soa.h"
+
+/*
+ * Host test of the SOA accumulator, runs on the development machine without
+ * the board. From the repository root:
+ *
+ *   gcc -Imain -Imain/tasks/safety_task test_files/host/SOA_test.c main/tasks/safety_task/soa.c -lm -o soa_test && ./soa_test
+ */
+
+//Time between synthetic samples, one INA237 conversion (us)
+#define SOA_TEST_DT_US 1130
+
+//Longest synthetic stream (us)
+#define SOA_TEST_MAX_US 20000000
+
+/**
+ * @brief Feed a constant operating point to a fresh accumulator
+ *
+ * @param voltage Drain voltage (V)
+ * @param current Drain current (A)
+ * @param derate_us Output, time of the first derate (us), -1 if it never derated
+ * @return Time of the trip (us), -1 if it never tripped
+ */
+static int64_t soa_test_constant(float voltage, float current, int64_t *derate_us){
+    SoaState state;
+    soa_init(&state);
+    *derate_us = -1;
+    for (int64_t t = 0; t <= SOA_TEST_MAX_US; t += SOA_TEST_DT_US){
+        SoaStatus status = soa_update(&state, voltage, current, t);
+        if (status == SOA_DERATE && *derate_us < 0){
+            *derate_us = t;
+        }
+        if (status == SOA_TRIP){
+            return t;
+        }
+    }
+    return -1;
+}
+
+/**
+ * @brief Check that a constant operating point trips in the time the SOA allows
+ *
+ * @param voltage Drain voltage (V)
+ * @param current Drain current (A)
+ * @return true if the trip was within one sample of the allowed time and came after a derate
+ */
+static bool soa_test_trip_time(float voltage, float current){
+    int64_t derate_us;
+    int64_t trip_us = soa_test_constant(voltage, current, &derate_us);
+    float allowed_us = soa_allowed_time_us(voltage, current);
+    bool pass = (trip_us >= 0) && (fabsf(trip_us - allowed_us) <= SOA_TEST_DT_US) &&
+                (allowed_us < 2 * SOA_TEST_DT_US || (derate_us >= 0 && derate_us < trip_us));
+    printf("%s: %.1f V, %.2f A allowed %.0f us, derate at %lld us, trip at %lld us\n",
+           pass ? "PASS" : "FAIL", voltage, current, allowed_us, (long long)derate_us, (long long)trip_us);
+    return pass;
+}
+
+/**
+ * @brief Main function
+ *
+ * This function feeds synthetic sample streams to the SOA accumulator and
+ * checks that points inside the DC curve never trip, that constant points
+ * above it trip in the time the curves allow, and that a pulsed load is given
+ * its cooling time back. It then measures the time per sample on the host,
+ * only as a guide, the cost on the ESP32-S3 is several times higher.
+ *
+ * @return 0 if every check passed.
+ */
+int main(void){
+    int failures = 0;
+    int64_t derate_us;
+
+    //Inside the DC curve, should never trip
+    float inside[][2] = {{12.0f, 8.0f}, {24.0f, 4.0f}, {48.0f, 1.4f}, {5.0f, 11.0f}};
+    for (int i = 0; i < 4; i++){
+        int64_t trip_us = soa_test_constant(inside[i][0], inside[i][1], &derate_us);
+        bool pass = (trip_us < 0) && (derate_us < 0);
+        printf("%s: %.1f V, %.2f A inside the DC curve\n", pass ? "PASS" : "FAIL", inside[i][0], inside[i][1]);
+        failures += !pass;
+    }
+
+    //Outside, from just above DC to the 48 V x 10 A the load would otherwise allow
+    float outside[][2] = {{48.0f, 1.6f}, {30.0f, 4.0f}, {20.0f, 9.0f}, {40.0f, 7.0f}, {48.0f, 10.0f}, {50.0f, 11.0f}};
+    for (int i = 0; i < 6; i++){
+        failures += !soa_test_trip_time(outside[i][0], outside[i][1]);
+    }
+
+    //Pulses of 40 V x 3 A, 20 ms on and 80 ms off. Each pulse uses a fraction of the budget that cools off
+    //before the next, so the load may pulse indefinitely while a continuous 3 A trips
+    SoaState state;
+    soa_init(&state);
+    bool tripped = false;
+    for (int64_t t = 0; t <= SOA_TEST_MAX_US; t += SOA_TEST_DT_US){
+        float current = ((t % 100000) < 20000) ? 3.0f : 0.0f;
+        tripped |= soa_update(&state, 40.0f, current, t) == SOA_TRIP;
+    }
+    int64_t continuous_us = soa_test_constant(40.0f, 3.0f, &derate_us);
+    bool pass = !tripped && (continuous_us >= 0);
+    printf("%s: 40 V, 3 A pulsed at 20 %% duty, used %.2f, continuous trip at %lld us\n",
+           pass ? "PASS" : "FAIL", state.used, (long long)continuous_us);
+    failures += !pass;
+
+    //Benchmark one sample above the DC curve, the slowest path
+    volatile SoaStatus sink = SOA_OK;
+    soa_init(&state);
+    clock_t start = clock();
+    for (int i = 0; i < 1000000; i++){
+        sink = soa_update(&state, 45.0f, 2.5f, 0);
+    }
+    double elapsed_s = (double)(clock() - start) / CLOCKS_PER_SEC;
+    printf("%.1f ns per sample on the host\n", elapsed_s * 1e9 / 1000000);
+    (void)sink;
+
+    if (failures != 0){
+        printf("FAIL: %d checks failed\n", failures);
+        return 1;
+    }
+    printf("PASS\n");
+    return 0;
+}
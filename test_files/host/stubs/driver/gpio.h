@@ -0,0 +1,15 @@
+#ifndef HOST_GPIO_H
+#define HOST_GPIO_H
+#include "esp_err.h"
+
+/**
+ * @file gpio.h
+ * @brief Host stand-in for the GPIO types the tested modules use.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+typedef int gpio_num_t;
+
+#endif // HOST_GPIO_H
@@ -0,0 +1,5 @@
+#ifndef HOST_I2C_SLAVE_H
+#define HOST_I2C_SLAVE_H
+#include "driver/i2c_master.h"
+
+#endif // HOST_I2C_SLAVE_H
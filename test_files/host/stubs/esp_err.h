@@ -0,0 +1,32 @@
+#ifndef HOST_ESP_ERR_H
+#define HOST_ESP_ERR_H
+#include <stdint.h>
+
+/**
+ * @file esp_err.h
+ * @brief Host stand-in for the ESP-IDF error codes the tested modules use.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+typedef int esp_err_t;
+
+#define ESP_OK 0
+#define ESP_FAIL -1
+#define ESP_ERR_INVALID_STATE 0x103
+#define ESP_ERR_NOT_FOUND 0x105
+#define ESP_ERR_TIMEOUT 0x107
+#define ESP_ERR_INVALID_RESPONSE 0x108
+
+#define ESP_ERROR_CHECK(x) ((void)(x))
+
+/**
+ * @brief Name of an error code, the host tests only print it.
+ */
+static inline const char *esp_err_to_name(esp_err_t code)
+{
+    return (code == ESP_OK) ? "ESP_OK" : (code == ESP_ERR_TIMEOUT) ? "ESP_ERR_TIMEOUT" : "ESP_FAIL";
+}
+
+#endif // HOST_ESP_ERR_H
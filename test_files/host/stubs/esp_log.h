@@ -0,0 +1,18 @@
+#ifndef HOST_ESP_LOG_H
+#define HOST_ESP_LOG_H
+#include <stdio.h>
+
+/**
+ * @file esp_log.h
+ * @brief Host stand-in for the ESP-IDF log, the modules under test log to stdout.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+#define ESP_LOGE(tag, format, ...) printf("E (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGW(tag, format, ...) printf("W (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGI(tag, format, ...) printf("I (%s) " format "\n", tag, ##__VA_ARGS__)
+#define ESP_LOGD(tag, format, ...) ((void)(tag))
+
+#endif // HOST_ESP_LOG_H
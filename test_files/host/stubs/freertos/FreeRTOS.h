@@ -0,0 +1,39 @@
+#ifndef HOST_FREERTOS_H
+#define HOST_FREERTOS_H
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+/**
+ * @file FreeRTOS.h
+ * @brief Host stand-in for the FreeRTOS types the tested modules use.
+ *
+ * The host tests are single threaded, so the critical sections are empty.
+ *
+ *
+ * @date 2025-05-12
+ */
+
+typedef uint32_t TickType_t;
+typedef int BaseType_t;
+typedef unsigned int UBaseType_t;
+typedef void *QueueHandle_t;
+typedef void *TaskHandle_t;
+typedef void *EventGroupHandle_t;
+typedef uint32_t EventBits_t;
+
+typedef struct
+{
+    int owner;
+} portMUX_TYPE;
+
+#define portMUX_INITIALIZER_UNLOCKED {0}
+#define pdTRUE 1
+#define pdFALSE 0
+#define configTICK_RATE_HZ 100
+#define pdMS_TO_TICKS(ms) ((TickType_t)(((TickType_t)(ms) * configTICK_RATE_HZ) / 1000U))
+
+#define portENTER_CRITICAL(mux) ((void)(mux))
+#define portEXIT_CRITICAL(mux) ((void)(mux))
+
+#endif // HOST_FREERTOS_H
@@ -0,0 +1,5 @@
+#ifndef HOST_EVENT_GROUPS_H
+#define HOST_EVENT_GROUPS_H
+#include "freertos/FreeRTOS.h"
+
+#endif // HOST_EVENT_GROUPS_H
@@ -0,0 +1,5 @@
+#ifndef HOST_QUEUE_H
+#define HOST_QUEUE_H
+#include "freertos/FreeRTOS.h"
+
+#endif // HOST_QUEUE_H
@@ -0,0 +1,9 @@
+#ifndef HOST_TASK_H
+#define HOST_TASK_H
+#include "freertos/FreeRTOS.h"
+
+#define taskENTER_CRITICAL(mux) portENTER_CRITICAL(mux)
+#define taskEXIT_CRITICAL(mux) portEXIT_CRITICAL(mux)
+#define vTaskDelay(ticks) ((void)(ticks))
+
+#endif // HOST_TASK_H